@@ -0,0 +1,351 @@
+/* Compact binary encoding of API responses for esp32-weather-epd.
+ * Copyright (C) 2023  Luke Marzen
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef __API_CODEC_H__
+#define __API_CODEC_H__
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "api_response.h"
+
+/* The API proxy (see simulation/apiproxy.cpp) serves responses in this
+ * encoding instead of JSON. An encoded response is an api_codec_header_t
+ * followed by the fields of owm_resp_onecall_t or owm_resp_air_pollution_t,
+ * in the order the structures declare them:
+ *   int, int64_t, float and Quantity  int32, int64, float32 (IEEE 754)
+ *   uint8_t, int8_t                   as is
+ *   char[N]                           uint8 length, then that many bytes
+ *   arrays of records                 uint8 count, then that many records
+ * Fields are little-endian. The encoding does not depend on the layout of the
+ * structures in memory, which differs between the esp32 and the host the
+ * proxy runs on (StaticVector's size_t), nor on the capacities configured in
+ * api_response.h. Records beyond the capacity of the device are skipped and
+ * strings are truncated as the JSON deserializers would.
+ *
+ * Both sides share transcode(), the list of fields, so they can not disagree
+ * on the order. Bump API_CODEC_VERSION whenever it changes.
+ */
+#define API_CODEC_MAGIC_ONECALL       0x43505745 // "EWPC"
+#define API_CODEC_MAGIC_AIR_POLLUTION 0x41505745 // "EWPA"
+#define API_CODEC_VERSION             3
+
+static_assert(__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__,
+              "the encoding is little-endian, as are the esp32 and x86");
+
+struct api_codec_header_t
+{
+  uint32_t magic;
+  uint16_t version;
+  uint16_t reserved;
+};
+
+static_assert(sizeof(api_codec_header_t) == 8,
+              "api_codec_header_t must be packed");
+
+/* Appends the encoding of a response to a byte vector.
+ */
+class ApiEncoder
+{
+public:
+  std::vector<uint8_t> bytes;
+
+  bool ok() const { return true; }
+
+  void raw(const void *src, size_t len)
+  {
+    const uint8_t *p = static_cast<const uint8_t *>(src);
+    bytes.insert(bytes.end(), p, p + len);
+  }
+
+  template<typename T>
+  void value(T &v) { raw(&v, sizeof(v)); }
+
+  template<typename U>
+  void value(Quantity<U> &q)
+  {
+    float v = q.val();
+    value(v);
+  }
+
+  template<size_t N>
+  void text(char (&s)[N])
+  {
+    uint8_t len = static_cast<uint8_t>(std::min<size_t>(strnlen(s, N), 255));
+    value(len);
+    raw(s, len);
+  }
+
+  size_t count(size_t size)
+  {
+    uint8_t n = static_cast<uint8_t>(std::min<size_t>(size, 255));
+    value(n);
+    return n;
+  }
+};
+
+/* Decodes a response from a source with readBytes(char *, size_t), such as an
+ * Arduino Stream. Once a read comes up short ok() is false and every field
+ * that follows is left as it was.
+ */
+template<typename Source>
+class ApiDecoder
+{
+public:
+  ApiDecoder(Source &src) : _src(src), _ok(true), _count(0) {}
+
+  bool ok() const { return _ok; }
+  // bytes consumed from the source
+  size_t bytesRead() const { return _count; }
+
+  void raw(void *dst, size_t len)
+  {
+    char *p = static_cast<char *>(dst);
+    while (_ok && len > 0)
+    { // a source may return fewer bytes than were asked for
+      size_t n = _src.readBytes(p, len);
+      _ok = n > 0;
+      _count += n;
+      p += n;
+      len -= n;
+    }
+  }
+
+  template<typename T>
+  void value(T &v)
+  {
+    T in;
+    raw(&in, sizeof(in));
+    if (_ok)
+    {
+      v = in;
+    }
+  }
+
+  template<typename U>
+  void value(Quantity<U> &q)
+  {
+    float v = q.val();
+    value(v);
+    q = v;
+  }
+
+  template<size_t N>
+  void text(char (&s)[N])
+  {
+    uint8_t len = 0;
+    value(len);
+    char buf[256];
+    raw(buf, len);
+    if (_ok)
+    {
+      buf[len] = '\0';
+      setField(s, buf);
+    }
+  }
+
+  size_t count(size_t)
+  {
+    uint8_t n = 0;
+    value(n);
+    return n;
+  }
+
+private:
+  Source &_src;
+  bool    _ok;
+  size_t  _count;
+};
+
+template<class Codec>
+void transcode(Codec &c, owm_weather_t &w)
+{
+  c.value(w.id);
+  c.text(w.main);
+  c.text(w.description);
+  c.text(w.icon);
+}
+
+template<class Codec>
+void transcode(Codec &c, owm_current_t &w)
+{
+  c.value(w.dt);
+  c.value(w.sunrise);
+  c.value(w.sunset);
+  c.value(w.temp);
+  c.value(w.feels_like);
+  c.value(w.pressure);
+  c.value(w.humidity);
+  c.value(w.dew_point);
+  c.value(w.clouds);
+  c.value(w.uvi);
+  c.value(w.visibility);
+  c.value(w.wind_speed);
+  c.value(w.wind_gust);
+  c.value(w.wind_deg);
+  c.value(w.rain_1h);
+  c.value(w.snow_1h);
+  transcode(c, w.weather);
+}
+
+template<class Codec>
+void transcode(Codec &c, owm_precip_next_hour_t &p)
+{
+  for (uint8_t &b : p.bucket)
+  {
+    c.value(b);
+  }
+  c.value(p.first_rain);
+  c.value(p.samples);
+}
+
+template<class Codec>
+void transcode(Codec &c, owm_hourly_t &h)
+{
+  c.value(h.dt);
+  c.value(h.temp);
+  c.value(h.feels_like);
+  c.value(h.pressure);
+  c.value(h.humidity);
+  c.value(h.dew_point);
+  c.value(h.clouds);
+  c.value(h.uvi);
+  c.value(h.visibility);
+  c.value(h.wind_speed);
+  c.value(h.wind_gust);
+  c.value(h.wind_deg);
+  c.value(h.pop);
+  c.value(h.rain_1h);
+  c.value(h.snow_1h);
+}
+
+template<class Codec>
+void transcode(Codec &c, owm_daily_t &d)
+{
+  c.value(d.dt);
+  c.value(d.sunrise);
+  c.value(d.sunset);
+  c.value(d.moonrise);
+  c.value(d.moonset);
+  c.value(d.moon_phase);
+  c.value(d.temp.morn);
+  c.value(d.temp.day);
+  c.value(d.temp.eve);
+  c.value(d.temp.night);
+  c.value(d.temp.min);
+  c.value(d.temp.max);
+  c.value(d.feels_like.morn);
+  c.value(d.feels_like.day);
+  c.value(d.feels_like.eve);
+  c.value(d.feels_like.night);
+  c.value(d.pressure);
+  c.value(d.humidity);
+  c.value(d.dew_point);
+  c.value(d.clouds);
+  c.value(d.uvi);
+  c.value(d.visibility);
+  c.value(d.wind_speed);
+  c.value(d.wind_gust);
+  c.value(d.wind_deg);
+  c.value(d.pop);
+  c.value(d.rain);
+  c.value(d.snow);
+  transcode(c, d.weather);
+}
+
+template<class Codec>
+void transcode(Codec &c, owm_alerts_t &a)
+{
+  c.text(a.sender_name);
+  c.text(a.event);
+  c.value(a.start);
+  c.value(a.end);
+  c.text(a.description);
+  c.text(a.tags);
+}
+
+/* Transcodes the first size records of items, or when decoding, as many
+ * records as were encoded, of which the first capacity are kept. Returns the
+ * number of records kept.
+ */
+template<class Codec, typename T>
+size_t transcodeRecords(Codec &c, T *items, size_t capacity, size_t size)
+{
+  size_t n = c.count(size);
+  for (size_t i = 0; i < n && c.ok(); ++i)
+  {
+    T skipped = {};
+    transcode(c, i < capacity ? items[i] : skipped);
+  }
+  return std::min(n, capacity);
+}
+
+template<class Codec>
+void transcode(Codec &c, owm_resp_onecall_t &r)
+{
+  c.value(r.lat);
+  c.value(r.lon);
+  c.text(r.timezone);
+  c.value(r.timezone_offset);
+  transcode(c, r.current);
+  transcode(c, r.precip_next_hour);
+  transcodeRecords(c, r.hourly, OWM_NUM_HOURLY, OWM_NUM_HOURLY);
+  transcodeRecords(c, r.daily, OWM_NUM_DAILY, OWM_NUM_DAILY);
+  r.alerts._size = transcodeRecords(c, r.alerts._items, OWM_NUM_ALERTS,
+                                    r.alerts.size());
+}
+
+/* One hour of owm_resp_air_pollution_t, which is stored by column.
+ */
+template<class Codec>
+void transcodeHour(Codec &c, owm_resp_air_pollution_t &r, size_t i)
+{
+  c.value(r.dt[i]);
+  c.value(r.main_aqi[i]);
+  c.value(r.components.co[i]);
+  c.value(r.components.no[i]);
+  c.value(r.components.no2[i]);
+  c.value(r.components.o3[i]);
+  c.value(r.components.so2[i]);
+  c.value(r.components.pm2_5[i]);
+  c.value(r.components.pm10[i]);
+  c.value(r.components.nh3[i]);
+}
+
+template<class Codec>
+void transcode(Codec &c, owm_resp_air_pollution_t &r)
+{
+  c.value(r.coord.lat);
+  c.value(r.coord.lon);
+  size_t n = c.count(OWM_NUM_AIR_POLLUTION);
+  for (size_t i = 0; i < n && c.ok(); ++i)
+  {
+    if (i < OWM_NUM_AIR_POLLUTION)
+    {
+      transcodeHour(c, r, i);
+    }
+    else
+    {
+      owm_resp_air_pollution_t skipped = {};
+      transcodeHour(c, skipped, 0);
+    }
+  }
+}
+
+#endif
@@ -2,11 +2,51 @@
 
 #include <ArduinoJson.h>
 
-class WiFiClient;
+class SegmentedStream;
 struct owm_resp_onecall_t;
 struct owm_resp_air_pollution_t;
 
-DeserializationError deserializeOneCall(WiFiClient &json, 
+/* Deserialization statistics. These are kept in RTC memory so that the JSON
+ * document capacity of the next wake can be sized from what was actually
+ * needed instead of a fixed guess. They double as a profile of the parser on
+ * real responses, printed after every request; bestParseRate is the baseline
+ * that changes to the parser can be compared against.
+ *
+ * heapUsed and allocations cover the parse alone, from before its document is
+ * created to after it is filled, in the arena and on the heap alike. The heap
+ * only tells how many blocks are in use, so of its allocations only those the
+ * parse still holds at the end are counted.
+ */
+struct json_stats_t
+{
+  size_t        capacity;      // document capacity for the next parse, bytes
+  size_t        memoryUsage;   // doc.memoryUsage() of the last successful parse
+  size_t        peakUsage;     // high-water mark of doc.memoryUsage(), bytes
+  size_t        bytesRx;       // bytes read from the stream by the last parse
+  unsigned long parseTime;     // duration of the last parse, us
+  unsigned long bestParseRate; // fastest successful parse, us per KiB
+  size_t        allocations;   // allocations made by the last parse
+  long          heapUsed;      // memory taken by the last parse, bytes
+};
+
+extern json_stats_t onecallJsonStats;
+extern json_stats_t airPollutionJsonStats;
+// of deserializeOneCallIndexed, whose index is no JsonDocument
+extern json_stats_t onecallIndexJsonStats;
+
+void discountRxWait(json_stats_t &s, unsigned long waitTime);
+
+DeserializationError deserializeOneCall(SegmentedStream &json,
                                         owm_resp_onecall_t &r);
-DeserializationError deserializeAirQuality(WiFiClient &json, 
+DeserializationError deserializeOneCallIndexed(SegmentedStream &json,
+                                               owm_resp_onecall_t &r);
+DeserializationError deserializeAirQuality(SegmentedStream &json,
                                            owm_resp_air_pollution_t &r);
+DeserializationError deserializeOpenMeteoForecast(SegmentedStream &json,
+                                                  owm_resp_onecall_t &r);
+DeserializationError deserializeOpenMeteoAirQuality(SegmentedStream &json,
+                                                  owm_resp_air_pollution_t &r);
+DeserializationError deserializeOneCallProxy(SegmentedStream &body,
+                                             owm_resp_onecall_t &r);
+DeserializationError deserializeAirQualityProxy(SegmentedStream &body,
+                                                owm_resp_air_pollution_t &r);
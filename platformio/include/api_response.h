@@ -20,22 +20,48 @@
 
 #include "quantities.h"
 
+#include <cmath>
 #include <cstdint>
-#include <vector>
+#include <cstring>
+#include <type_traits>
 #include <Arduino.h>
+#include "static_vector.h"
 
 #define OWM_NUM_MINUTELY       1 // 61
 #define OWM_NUM_HOURLY        48 // 48
 #define OWM_NUM_DAILY          8 // 8
 #define OWM_NUM_ALERTS         8 // OpenWeatherMaps does not specify a limit, but if you need more alerts you are probably doomed.
 #define OWM_NUM_AIR_POLLUTION 24 // Depending on AQI scale, hourly concentrations will need to be averaged over a period of 1h to 24h
+#define OWM_PRECIP_BUCKETS    12 // 5 minute buckets covering the next hour
+#define OWM_ALERT_DESC_LEN   120 // Alert descriptions are truncated to this many bytes while parsing
+
+/* Copies src into the fixed-size text field dst, truncating at a UTF-8
+ * character boundary if it does not fit. The result is always
+ * null-terminated.
+ */
+template<size_t N>
+inline void setField(char (&dst)[N], const char *src)
+{
+  size_t len = (src == nullptr) ? 0 : strnlen(src, N);
+  if (len == N)
+  { // does not fit, back up to the start of a character
+    len = N - 1;
+    while (len > 0 && (static_cast<uint8_t>(src[len]) & 0xC0) == 0x80)
+    {
+      --len;
+    }
+  }
+  memcpy(dst, src, len);
+  dst[len] = '\0';
+  return;
+}
 
 struct owm_weather_t
 {
   int     id;               // Weather condition id
-  String  main;             // Group of weather parameters (Rain, Snow, Extreme etc.)
-  String  description;      // Weather condition within the group (full list of weather conditions). Get the output in your language
-  String  icon;             // Weather icon id.
+  char    main[16];         // Group of weather parameters (Rain, Snow, Extreme etc.)
+  char    description[48];  // Weather condition within the group (full list of weather conditions). Get the output in your language
+  char    icon[4];          // Weather icon id. (3 characters, ex: "10d")
 };
 
 /*
@@ -95,6 +121,43 @@ struct owm_minutely_t
   float   precipitation;    // Precipitation volume, mm
 };
 
+/*
+ * Summary of the minute forecast for the next hour. The minutely values are
+ * folded into this as they stream in, so the raw array is never stored.
+ */
+struct owm_precip_next_hour_t
+{
+  uint8_t bucket[OWM_PRECIP_BUCKETS]; // Peak precipitation in each 5 minute bucket, 0.1 mm/h, saturates at 25.5 mm/h
+  int8_t  first_rain;       // Minutes from now until precipitation begins, -1 if none is forecast
+  uint8_t samples;          // Number of minutely values folded in, 0 if unavailable
+};
+
+/* Folds the next minutely precipitation value, mm/h, into the summary. Values
+ * beyond the hour, the 61st is the start of the next one, are ignored.
+ */
+inline void foldMinutelyPrecip(owm_precip_next_hour_t &p, float value)
+{
+  int minute = p.samples;
+  if (minute >= OWM_PRECIP_BUCKETS * 5)
+  {
+    return;
+  }
+  ++p.samples;
+
+  long q = lroundf(value * 10);
+  q = (q < 0) ? 0 : (q > 255) ? 255 : q;
+  uint8_t &bucket = p.bucket[minute / 5];
+  if (q > bucket)
+  {
+    bucket = q;
+  }
+  if (q > 0 && p.first_rain < 0)
+  {
+    p.first_rain = minute;
+  }
+  return;
+}
+
 /*
  * Hourly forecast weather data API response
  */
@@ -151,12 +214,12 @@ struct owm_daily_t
  */
 struct owm_alerts_t
 {
-  String  sender_name;      // Name of the alert source.
-  String  event;            // Alert event name
+  char    sender_name[32];  // Name of the alert source. (not requested, see deserializeOneCall)
+  char    event[64];        // Alert event name
   int64_t start;            // Date and time of the start of the alert, Unix, UTC
   int64_t end;              // Date and time of the end of the alert, Unix, UTC
-  String  description;      // Description of the alert
-  String  tags;             // Type of severe weather
+  char    description[OWM_ALERT_DESC_LEN + 1]; // Description of the alert, truncated
+  char    tags[32];         // Type of severe weather (first tag only)
 };
 
 /* 
@@ -168,16 +231,21 @@ struct owm_resp_onecall_t
 {
   float   lat;              // Geographical coordinates of the location (latitude)
   float   lon;              // Geographical coordinates of the location (longitude)
-  String  timezone;         // Timezone name for the requested location
+  char    timezone[40];     // Timezone name for the requested location
   int     timezone_offset;  // Shift in seconds from UTC
   owm_current_t   current;
   // owm_minutely_t  minutely[OWM_NUM_MINUTELY];
+  owm_precip_next_hour_t  precip_next_hour;
   
   owm_hourly_t    hourly[OWM_NUM_HOURLY];
   owm_daily_t     daily[OWM_NUM_DAILY];
-  std::vector<owm_alerts_t> alerts;
+  StaticVector<owm_alerts_t, OWM_NUM_ALERTS> alerts;
 };
 
+// The response holds no pointers, so it can be copied into a cache as is.
+static_assert(std::is_trivially_copyable<owm_resp_onecall_t>::value,
+              "owm_resp_onecall_t must be trivially copyable");
+
 /*
  * Coordinates from the specified location (latitude, longitude)
  */
@@ -210,4 +278,7 @@ struct owm_resp_air_pollution_t
   int64_t          dt[OWM_NUM_AIR_POLLUTION];         // Date and time, Unix, UTC;
 };
 
+static_assert(std::is_trivially_copyable<owm_resp_air_pollution_t>::value,
+              "owm_resp_air_pollution_t must be trivially copyable");
+
 #endif
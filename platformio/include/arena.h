@@ -0,0 +1,139 @@
+/* Per-wake arena allocator declarations for esp32-weather-epd.
+ * Copyright (C) 2023  Luke Marzen
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef __ARENA_H__
+#define __ARENA_H__
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+
+// Size of the arena backing transient allocations during a wake, bytes.
+// Allocations that do not fit fall back to the general heap.
+#define WAKE_ARENA_SIZE (64 * 1024)
+
+/* Bump allocator for transient allocations.
+ *
+ * Memory is handed out by advancing a pointer through a single block that is
+ * allocated on first use, so allocating costs a few instructions and does not
+ * fragment the heap. Freeing the most recent allocation returns its memory to
+ * the arena, everything else is only returned by reset() at the end of a
+ * phase (fetch, parse, render). reset() also frees the allocations that fell
+ * back to the heap, and the block itself, so that it is not held through the
+ * phases that do not use it. The arena counts live allocations so that
+ * reset() can report allocations that escaped their phase. Freeing one of
+ * those after reset() is harmless, it was released already.
+ *
+ * Requests may be fetched and parsed by concurrent tasks, so every operation
+ * holds a lock. Allocations are few and large (whole JSON documents), so this
+ * costs next to nothing.
+ */
+class Arena
+{
+public:
+  explicit Arena(size_t capacity);
+  ~Arena();
+
+  void *allocate(size_t size);
+  void  deallocate(void *ptr);
+  void *reallocate(void *ptr, size_t size);
+
+  // Releases all allocations. Returns the number of allocations that were
+  // still live, which should be 0 at the end of a phase.
+  size_t reset();
+
+  size_t used() const { return _top; }
+  size_t peak() const { return _peak; }
+  size_t live() const { return _live; }
+  size_t allocations() const { return _allocations; }
+  // number of those that fell back to the heap
+  size_t fallbacks() const { return _fallbackAllocations; }
+  // bytes of heap held by the block, 0 until first use and after reset()
+  size_t reserved() const { return _base != nullptr ? _capacity : 0; }
+
+private:
+  // precedes every allocation that fell back to the heap
+  struct fallback_t
+  {
+    fallback_t *prev;
+    fallback_t *next;
+  };
+
+  bool owns(const void *ptr) const;
+  fallback_t *findFallback(const void *ptr) const;
+  void *allocateFallback(size_t size);
+  void  linkFallback(fallback_t *f);
+  void  unlinkFallback(fallback_t *f);
+  void  release();
+
+  uint8_t    *_base;
+  size_t      _capacity;
+  size_t      _top;  // offset of the first free byte
+  size_t      _peak; // high-water mark of _top
+  size_t      _live; // number of allocations not yet freed
+  size_t      _allocations; // number of allocations made, including heap fallbacks
+  size_t      _fallbackAllocations; // number of heap fallbacks made
+  uint32_t    _generation; // number of resets, stamped on every allocation
+  fallback_t *_fallbacks;  // live heap fallbacks, most recent first
+  std::recursive_mutex _mutex;
+};
+
+extern Arena wakeArena;
+
+/* Allocator for ArduinoJson's BasicJsonDocument<> that uses the wake arena.
+ */
+struct ArenaAllocator
+{
+  void *allocate(size_t size) { return wakeArena.allocate(size); }
+  void  deallocate(void *ptr) { wakeArena.deallocate(ptr); }
+  void *reallocate(void *ptr, size_t size)
+  {
+    return wakeArena.reallocate(ptr, size);
+  }
+};
+
+/* Allocator for standard containers that uses the wake arena.
+ */
+template<typename T>
+struct ArenaStdAllocator
+{
+  using value_type = T;
+
+  ArenaStdAllocator() = default;
+  template<typename U>
+  ArenaStdAllocator(const ArenaStdAllocator<U> &) {}
+
+  T *allocate(size_t n)
+  {
+    return static_cast<T *>(wakeArena.allocate(n * sizeof(T)));
+  }
+  void deallocate(T *ptr, size_t) { wakeArena.deallocate(ptr); }
+};
+
+template<typename T, typename U>
+bool operator==(const ArenaStdAllocator<T> &, const ArenaStdAllocator<U> &)
+{
+  return true;
+}
+
+template<typename T, typename U>
+bool operator!=(const ArenaStdAllocator<T> &, const ArenaStdAllocator<U> &)
+{
+  return false;
+}
+
+#endif
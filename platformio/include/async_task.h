@@ -0,0 +1,53 @@
+/* Work run in a task of its own declarations for esp32-weather-epd.
+ * Copyright (C) 2023  Luke Marzen
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef __ASYNC_TASK_H__
+#define __ASYNC_TASK_H__
+
+#include <cstdint>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <freertos/task.h>
+
+/* A future of the result of some work, done by a task of its own so that the
+ * caller can do other work until it needs the result. If the task cannot be
+ * created the work is done by await instead. await must be called before the
+ * task goes out of scope, the destructor does if it was not.
+ */
+class AsyncTask
+{
+public:
+  typedef int (*work_t)(void *arg);
+
+  AsyncTask(work_t work, void *arg);
+  ~AsyncTask();
+
+  bool start(const char *name, uint32_t stackSize);
+  int await();
+
+private:
+  static void run(void *self);
+
+  work_t            _work;
+  void             *_arg;
+  int               _result;
+  bool              _pending; // started and not yet awaited
+  SemaphoreHandle_t _done;
+  StaticSemaphore_t _doneBuffer;
+};
+
+#endif
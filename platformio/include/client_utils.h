@@ -19,12 +19,183 @@
 #define __CLIENT_UTILS_H__
 
 #include <Arduino.h>
+#include <ArduinoJson.h>
+#include <HTTPClient.h>
+#include <WiFiClient.h>
+#include "async_task.h"
+#include "config.h"
+#ifdef USE_HTTPS
+#include "tls_client.h"
+#endif
+
+class SegmentedStream;
+
+// Size of the receive buffer of a session, bytes. One TCP segment (lwIP's
+// TCP_MSS).
+#define RX_BUFFER_SIZE 1436
+#ifdef USE_HTTPS
+typedef TlsClient ApiClient;
+#define API_PORT 443
+// Stack of the task of an AsyncRequest, bytes. A handshake needs more.
+#define ASYNC_REQUEST_STACK (12 * 1024)
+#else
+typedef WiFiClient ApiClient;
+#define API_PORT 80
+// Stack of the task of an AsyncRequest, bytes.
+#define ASYNC_REQUEST_STACK (8 * 1024)
+#endif
+
+#ifdef DOWNLOAD_THEN_PARSE
+struct json_stats_t;
+
+/* Body of a response that has been downloaded but not parsed yet, see
+ * DOWNLOAD_THEN_PARSE. The body is kept as it was received, compressed if it
+ * was, in PSRAM if there is any. It remembers how to deserialize itself and
+ * into what.
+ */
+class DownloadedBody
+{
+public:
+  DownloadedBody();
+  ~DownloadedBody();
+  DownloadedBody(const DownloadedBody &) = delete;
+  DownloadedBody &operator=(const DownloadedBody &) = delete;
+
+  // Reads the whole body of the response to http, received through rxBuffer.
+  // Returns false if it could not be read in full.
+  bool download(HTTPClient &http, uint8_t *rxBuffer);
+
+  template<typename T>
+  void expect(DeserializationError (*deserialize)(SegmentedStream &, T &),
+              const json_stats_t &stats, T &r)
+  {
+    _deserialize = reinterpret_cast<deserialize_t>(deserialize);
+    _thunk       = &thunk<T>;
+    _stats       = &stats;
+    _r           = &r;
+  }
+
+  // Deserializes the body, then releases it. Returns HTTP_CODE_OK, or the
+  // deserialization error code offset by -100 (see getJson).
+  int parse();
+
+  bool empty() const { return _data == nullptr; }
+  void swap(DownloadedBody &other);
+  void release();
+
+private:
+  // deserialize is called through the type it was given to expect with
+  typedef DeserializationError (*deserialize_t)(SegmentedStream &, void *);
+  template<typename T>
+  static DeserializationError thunk(deserialize_t deserialize,
+                                    SegmentedStream &s, void *r)
+  {
+    typedef DeserializationError (*typed_t)(SegmentedStream &, T &);
+    return reinterpret_cast<typed_t>(deserialize)(s, *static_cast<T *>(r));
+  }
+
+  uint8_t            *_data;
+  size_t              _len;
+  String              _encoding; // Content-Encoding of the response
+  deserialize_t       _deserialize;
+  DeserializationError (*_thunk)(deserialize_t, SegmentedStream &, void *);
+  const json_stats_t *_stats;
+  void               *_r;
+};
+#endif
+
+/* HTTP connection that is kept open across the requests made on it to the
+ * same host (HTTP keep-alive), retries included, so that only the first
+ * request pays for the DNS lookup and TCP handshake.
+ *
+ * Sessions are independent of each other, so concurrent requests each use
+ * their own. The forecast and air pollution, which are fetched concurrently
+ * (see AsyncRequest), therefore make a connection each: the second handshake
+ * overlaps the first request rather than following it.
+ */
+class HttpSession
+{
+public:
+  HttpSession(ApiClient &client);
+  ~HttpSession();
+
+  HTTPClient &begin(const String &host, const String &uri,
+                    uint16_t port = API_PORT);
+  void sent(int httpResponse);
+  void end(bool keepAlive);
+  void close();
+
+  // buffer that response bodies are received into, reused by every request
+  uint8_t *rxBuffer() { return _rxBuffer; }
+#ifdef DOWNLOAD_THEN_PARSE
+  // body of the last response, when its parsing is deferred
+  DownloadedBody &body() { return _body; }
+#endif
+
+private:
+  ApiClient  &_client;
+  HTTPClient  _http;
+  String      _host; // host and port of the open connection, if any
+  uint16_t    _port;
+  unsigned    _requests;    // made on the session
+  unsigned    _connections; // made for them
+  uint8_t     _rxBuffer[RX_BUFFER_SIZE];
+#ifdef DOWNLOAD_THEN_PARSE
+  DownloadedBody _body;
+#endif
+};
+
+/* An HTTP request made by a task of its own, on a connection of its own, so
+ * that the caller can do other work, or make other requests, until it needs
+ * the result. await must be called before the request goes out of scope.
+ */
+class AsyncRequest
+{
+public:
+  // makes the request on the given session, returns the HTTP Status Code
+  typedef int (*request_t)(HttpSession &session, void *arg);
 
-wl_status_t startWiFi(int &wifiRSSI);
+  AsyncRequest(request_t request, void *arg);
+
+  void start(const char *name);
+  int await();
+#ifdef DOWNLOAD_THEN_PARSE
+  int parse();
+#endif
+
+private:
+  static int run(void *self);
+
+  request_t         _request;
+  void             *_arg;
+  int               _status;
+#ifdef DOWNLOAD_THEN_PARSE
+  DownloadedBody    _body;   // taken over from the session of the request
+#endif
+  AsyncTask         _task;   // last, awaited before the rest is destroyed
+};
+
+void beginWiFi();
+wl_status_t awaitWiFi(int &wifiRSSI);
 void killWiFi();
 bool setupTime(tm *timeInfo);
 bool printLocalTime(tm *timeInfo);
-int getOWMonecall(WiFiClient &client, owm_resp_onecall_t &r);
-int getOWMairpollution(WiFiClient &client, owm_resp_air_pollution_t &r);
+int getOWMonecall(HttpSession &session, owm_resp_onecall_t &r,
+                  uint8_t sections);
+int getOWMairpollution(HttpSession &session, owm_resp_air_pollution_t &r,
+                       int hours);
+int getOpenMeteoForecast(HttpSession &session, owm_resp_onecall_t &r);
+int getOpenMeteoAirQuality(HttpSession &session, owm_resp_air_pollution_t &r,
+                           int hours);
+#ifdef WEATHER_PROVIDER_OWM_PROXY
+int getProxyOneCall(HttpSession &session, owm_resp_onecall_t &r,
+                    uint8_t sections);
+int getProxyAirPollution(HttpSession &session, owm_resp_air_pollution_t &r,
+                         int hours);
+#endif
+#ifdef RENDER_SERVER
+String urlEncode(const String &s);
+int getRenderedFrame(const String &status);
+#endif
 
 #endif
@@ -159,6 +159,100 @@
 // Disable alerts by defining the DISABLE_ALERTS macro.
 // #define DISABLE_ALERTS
 
+// MINUTELY PRECIPITATION
+// OpenWeatherMap provides a minute-by-minute precipitation forecast for the
+// next hour in some regions. When enabled, the 61 minutely values are folded
+// into 5 minute buckets as they are received (see owm_precip_next_hour_t), so
+// the cost is a slightly larger download rather than memory.
+// Enable by defining the ENABLE_MINUTELY_PRECIP macro.
+// #define ENABLE_MINUTELY_PRECIP
+
+// LAZY JSON INDEX
+// By default the One Call response is deserialized into a JSON document, then
+// copied into structures. When enabled, the response body is instead buffered
+// and indexed, and the same fields are converted straight out of the buffer,
+// with no document in between. Compare the timing and memory printed after
+// each request, or run the host benchmark of the simulation, to choose between
+// the two.
+// Enable by defining the JSON_LAZY_INDEX macro.
+// #define JSON_LAZY_INDEX
+
+// DOWNLOAD THEN PARSE
+// By default responses are parsed as they are received, so wifi stays on,
+// drawing 100 mA or more, for as long as the esp32 takes to parse them. When
+// enabled, each response body is only read into memory as fast as the network
+// delivers it (compressed if the server compressed it, in PSRAM if the board
+// has any), then wifi is turned off, then the bodies are parsed. A parse that
+// runs out of memory is attempted again from memory instead of downloading
+// the body again. The time the radio was on is printed every wake, compare it
+// with and without this option.
+// Enable by defining the DOWNLOAD_THEN_PARSE macro.
+// #define DOWNLOAD_THEN_PARSE
+
+// WEATHER PROVIDER
+// Uncomment your preferred weather provider. (exactly 1 must be defined)
+//   OpenWeatherMap: One Call and Air Pollution APIs. Requires an API key, see
+//     OWM_APIKEY.
+//   Open-Meteo: Forecast and Air Quality APIs. No API key is required. Only
+//     the variables that are drawn are requested, for only as many hours and
+//     days as are drawn, so responses are several times smaller. Weather
+//     alerts and moon rise/set times are not available.
+//   OpenWeatherMap through the API proxy (see simulation/apiproxy.cpp): the
+//     proxy makes the One Call and Air Pollution requests with its own API
+//     key, on behalf of every display in the same location, and answers from
+//     its cache while the data is fresh. Responses are sent in a compact
+//     binary encoding that is decoded straight into the response structures,
+//     so no JSON is parsed on the esp32. Set API_PROXY_HOST, API_PROXY_PORT
+//     and API_PROXY_TOKEN in config.cpp. The proxy is reached over plain
+//     HTTP, USE_HTTPS has no effect.
+#define WEATHER_PROVIDER_OWM
+// #define WEATHER_PROVIDER_OPEN_METEO
+// #define WEATHER_PROVIDER_OWM_PROXY
+
+// RENDER SERVER
+// Instead of fetching the weather and rendering it on the esp32, download the
+// frame rendered by the render server (see simulation/renderserver.cpp) and
+// stream it onto the display. JSON parsing and drawing are skipped entirely, a
+// wake only connects, downloads a few kB and refreshes the display. The
+// battery voltage, signal strength and indoor temperature and humidity are
+// sent to the server to be drawn.
+// The server renders the location the request is for (LAT and LON in
+// config.cpp), but only in the units it was built with, and refuses requests
+// for any others.
+// Enable by defining the RENDER_SERVER macro, then set RENDER_SERVER_HOST,
+// RENDER_SERVER_PORT and RENDER_SERVER_TOKEN in config.cpp.
+// #define RENDER_SERVER
+
+// HTTPS
+// By default API requests are made over plain HTTP, which sends the API key in
+// the clear. When enabled, requests are made over HTTPS instead. The TLS
+// session is kept in RTC memory and resumed by the next connection, including
+// on later wakes, so the full handshake (several hundred ms of CPU) is only
+// paid when the server no longer accepts the session. The duration of each
+// handshake is printed. The server is always verified: set the root
+// certificate of your weather provider's hosts in config.cpp (OWM_ROOT_CA or
+// OPEN_METEO_ROOT_CA).
+// Enable by defining the USE_HTTPS macro.
+// #define USE_HTTPS
+#if defined(USE_HTTPS) && defined(WEATHER_PROVIDER_OWM_PROXY)
+  #undef USE_HTTPS
+#endif
+
+// WIFI FAST CONNECT
+// A cold connect scans every channel, then waits for DHCP, then looks up the
+// API host name, which often keeps the radio on for several seconds. When
+// enabled, the access point, channel and address of the last successful
+// connection, and the addresses the API hosts resolved to, are kept in RTC
+// memory, and the next wake connects straight to them. If the directed connect
+// fails (the access point moved, the router was replaced) the device falls
+// back to a full scan and DHCP on the same wake. The time taken to connect is
+// printed each wake.
+// Note: the address from the last DHCP lease is reused without asking the
+//   router again until half the lease time has passed, or for at most 48
+//   wakes, after which DHCP is asked for a new lease.
+// Disable by commenting out the WIFI_FAST_CONNECT macro.
+#define WIFI_FAST_CONNECT
+
 // Set the below constants in "config.cpp"
 extern const uint8_t PIN_BAT_ADC;
 extern const uint8_t PIN_EPD_BUSY;
@@ -175,7 +269,17 @@ extern const char *WIFI_SSID;
 extern const char *WIFI_PASSWORD;
 extern const String OWM_APIKEY;
 extern const String OWM_ENDPOINT;
+extern const char *OWM_ROOT_CA;
+extern const String RENDER_SERVER_HOST;
+extern const uint16_t RENDER_SERVER_PORT;
+extern const String RENDER_SERVER_TOKEN;
+extern const String API_PROXY_HOST;
+extern const uint16_t API_PROXY_PORT;
+extern const String API_PROXY_TOKEN;
 extern const String OWM_ONECALL_VERSION;
+extern const String OPEN_METEO_ENDPOINT;
+extern const String OPEN_METEO_AQ_ENDPOINT;
+extern const char *OPEN_METEO_ROOT_CA;
 extern const String LAT;
 extern const String LON;
 extern const String CITY_STRING;
@@ -186,9 +290,13 @@ extern const char *DATE_FORMAT;
 extern const char *REFRESH_TIME_FORMAT;
 extern const char *NTP_SERVER_1;
 extern const char *NTP_SERVER_2;
+extern const int TIME_SYNC_INTERVAL;
+extern const int DAILY_REFRESH_INTERVAL;
+extern const int AIR_POLLUTION_REFRESH_INTERVAL;
 extern const long SLEEP_DURATION;
 extern const int BED_TIME;
 extern const int WAKE_TIME;
+extern const unsigned long RETRY_INTERVAL;
 extern const char UNITS;
 extern const int HOURLY_GRAPH_MAX;
 extern const float BATTERY_WARN_VOLTAGE;
@@ -22,6 +22,8 @@
 #include <time.h>
 #include <WiFiType.h>
 #include "api_response.h"
+#include "forecast_store.h"
+#include "timeline.h"
 
 enum alert_category {
   NOT_FOUND = -1,
@@ -55,16 +57,18 @@ int calcBatPercent(double v);
 const uint8_t *getBatBitmap24(int batPercent);
 void getDateStr(String &s, tm *timeInfo);
 void getRefreshTimeStr(String &s, bool timeSuccess, tm *timeInfo);
-void toTitleCase(String &text);
-void truncateExtraAlertInfo(String &text);
-void filterAlerts(std::vector<owm_alerts_t> &resp, int *ignore_list);
+void toTitleCase(char *text);
+void truncateExtraAlertInfo(char *text);
+void flattenAlertDescription(char *text);
+void filterAlerts(StaticVector<owm_alerts_t, OWM_NUM_ALERTS> &resp,
+                  int *ignore_list);
 const char *getUVIdesc(unsigned int uvi);
-float getAvgConc(const float pollutant[], int hours);
-int getAQI(const owm_resp_air_pollution_t &p);
+float getAvgConc(const timeline_t &tl, const float pollutant[], int hours);
+int getAQI(const owm_resp_air_pollution_t &p, const timeline_t &tl);
 const char *getAQIdesc(int aqi);
 const char *getWiFidesc(int rssi);
 const uint8_t *getWiFiBitmap16(int rssi);
-const uint8_t *getForecastBitmap64(const owm_daily_t &daily);
+const uint8_t *getForecastBitmap64(const daily_store_t &daily, int i);
 const uint8_t *getCurrentConditionsBitmap196(const owm_current_t &current, 
                                              const owm_daily_t &today);
 const uint8_t *getAlertBitmap32(owm_alerts_t &alert);
@@ -0,0 +1,54 @@
+/* Fetch planner declarations for esp32-weather-epd.
+ * Copyright (C) 2023  Luke Marzen
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef __FETCH_PLAN_H__
+#define __FETCH_PLAN_H__
+
+#include <cstdint>
+#include "api_response.h"
+#include "forecast_store.h"
+
+/* Sections of the weather that are refreshed on schedules of their own.
+ * Current conditions (and alerts) are fetched every wake. The hourly forecast
+ * is fetched once its first hour has passed, the daily forecast every
+ * DAILY_REFRESH_INTERVAL hours and on a new day, the air pollution history
+ * every AIR_POLLUTION_REFRESH_INTERVAL hours. In between, the sections are
+ * drawn from the model kept in RTC memory.
+ *
+ * The air pollution history is kept as a ring of hours (air_history_t), so
+ * only the hours since the newest one are fetched. It is fetched whole at
+ * first and after a gap of more than its length.
+ */
+#define FETCH_HOURLY        0x01
+#define FETCH_DAILY         0x02
+#define FETCH_AIR_POLLUTION 0x04
+#define FETCH_ALL           (FETCH_HOURLY | FETCH_DAILY | FETCH_AIR_POLLUTION)
+
+// Returns the sections that are due, given the time now. If the forecast can
+// not be fetched in parts, the hourly and daily forecast are always due.
+uint8_t planFetch(int64_t now, bool partialForecast);
+// Returns the number of hours of air pollution history, ending now, to fetch.
+int airPollutionHours(int64_t now);
+// Merges the sections that were fetched into the model, then fills in every
+// section that was not from it. hourly and daily are packed from onecall
+// when fetched, onecall.daily[0] is restored when not. air holds the hours
+// fetched, and is replaced by the whole history.
+void mergeFetched(uint8_t fetched, int64_t now, owm_resp_onecall_t &onecall,
+                  owm_resp_air_pollution_t &air, hourly_store_t &hourly,
+                  daily_store_t &daily);
+
+#endif
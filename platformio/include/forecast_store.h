@@ -0,0 +1,116 @@
+/* Compact forecast store declarations for esp32-weather-epd.
+ * Copyright (C) 2023  Luke Marzen
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef __FORECAST_STORE_H__
+#define __FORECAST_STORE_H__
+
+#include <cstdint>
+#include <type_traits>
+#include "api_response.h"
+
+// Temperatures are stored in centi-Kelvin relative to 0 °C (273.15 K) so that
+// an int16_t covers -327 °C to +327 °C at 0.01 K resolution.
+#define STORE_TEMP_BIAS 27315
+
+/*
+ * Hourly forecast in structure-of-arrays form with quantized columns, packed
+ * from owm_hourly_t after parsing. About 1/5 the size of owm_hourly_t[] and
+ * each column is a contiguous array, so a pass over one field (min/max of
+ * temp, ...) only touches the bytes it needs.
+ */
+struct hourly_store_t
+{
+  uint32_t base_dt;                   // Time of the first hour, Unix, UTC
+  uint8_t  count;                     // Number of hours stored
+  uint8_t  hour[OWM_NUM_HOURLY];      // Hours after base_dt
+  int16_t  temp[OWM_NUM_HOURLY];      // Temperature, centi-Kelvin - STORE_TEMP_BIAS
+  uint8_t  pop[OWM_NUM_HOURLY];       // Probability of precipitation, %
+  uint16_t rain_1h[OWM_NUM_HOURLY];   // Rain volume for the hour, 0.01 mm
+  uint16_t snow_1h[OWM_NUM_HOURLY];   // Snow volume for the hour, 0.01 mm
+
+  int64_t          dt(int i)      const { return base_dt + 3600 * hour[i]; }
+  Quantity<Kelvin> tempAt(int i)  const;
+  float            popAt(int i)   const { return pop[i] / 100.f; }
+  float            rainAt(int i)  const { return rain_1h[i] / 100.f; }
+  float            snowAt(int i)  const { return snow_1h[i] / 100.f; }
+  void tempRange(int n, Quantity<Kelvin> &lo, Quantity<Kelvin> &hi) const;
+};
+
+/*
+ * Daily forecast in structure-of-arrays form with quantized columns, packed
+ * from owm_daily_t after parsing.
+ */
+struct daily_store_t
+{
+  uint32_t base_dt;                   // Time of the first day, Unix, UTC
+  uint8_t  count;                     // Number of days stored
+  uint8_t  day[OWM_NUM_DAILY];        // Days after base_dt
+  int16_t  temp_min[OWM_NUM_DAILY];   // Min daily temperature, centi-Kelvin - STORE_TEMP_BIAS
+  int16_t  temp_max[OWM_NUM_DAILY];   // Max daily temperature, centi-Kelvin - STORE_TEMP_BIAS
+  uint16_t weather_id[OWM_NUM_DAILY]; // Weather condition id
+  uint8_t  clouds[OWM_NUM_DAILY];     // Cloudiness, %
+  uint8_t  pop[OWM_NUM_DAILY];        // Probability of precipitation, %
+  uint16_t wind_speed[OWM_NUM_DAILY]; // Wind speed, cm/s
+  uint16_t wind_gust[OWM_NUM_DAILY];  // Wind gust, cm/s
+
+  int64_t dt(int i) const { return base_dt + 86400 * day[i]; }
+  Quantity<Kelvin>          tempMinAt(int i)   const;
+  Quantity<Kelvin>          tempMaxAt(int i)   const;
+  float                     popAt(int i)       const { return pop[i] / 100.f; }
+  Quantity<MetersPerSecond> windSpeedAt(int i) const { return wind_speed[i] / 100.f; }
+  Quantity<MetersPerSecond> windGustAt(int i)  const { return wind_gust[i] / 100.f; }
+};
+
+// both are small enough to be kept in RTC memory across deep sleep
+static_assert(std::is_trivially_copyable<hourly_store_t>::value
+              && std::is_trivially_copyable<daily_store_t>::value,
+              "forecast stores must be trivially copyable");
+static_assert(sizeof(hourly_store_t) + sizeof(daily_store_t) <= 1024,
+              "forecast stores must stay small enough for RTC memory");
+
+/*
+ * The last OWM_NUM_AIR_POLLUTION hours of air pollution history, a ring of
+ * consecutive hours ending at newest_dt, with quantized columns. It is kept
+ * across wakes so that only the hours since the newest one have to be fetched.
+ * About 2/5 the size of owm_resp_air_pollution_t.
+ */
+struct air_history_t
+{
+  uint32_t newest_dt;                      // Time of the newest hour, Unix, UTC
+  uint8_t  head;                           // Slot of the newest hour
+  uint8_t  count;                          // Number of hours stored
+  uint8_t  aqi[OWM_NUM_AIR_POLLUTION];     // Air Quality Index, 1-5
+  uint16_t co[OWM_NUM_AIR_POLLUTION];      // CO, μg/m^3
+  uint16_t no[OWM_NUM_AIR_POLLUTION];      // NO, 0.1 μg/m^3
+  uint16_t no2[OWM_NUM_AIR_POLLUTION];     // NO2, 0.1 μg/m^3
+  uint16_t o3[OWM_NUM_AIR_POLLUTION];      // O3, 0.1 μg/m^3
+  uint16_t so2[OWM_NUM_AIR_POLLUTION];     // SO2, 0.1 μg/m^3
+  uint16_t pm2_5[OWM_NUM_AIR_POLLUTION];   // PM2.5, 0.1 μg/m^3
+  uint16_t pm10[OWM_NUM_AIR_POLLUTION];    // PM10, 0.1 μg/m^3
+  uint16_t nh3[OWM_NUM_AIR_POLLUTION];     // NH3, 0.1 μg/m^3
+};
+
+static_assert(std::is_trivially_copyable<air_history_t>::value,
+              "air_history_t must be trivially copyable");
+
+void packHourly(const owm_hourly_t *hourly, int n, hourly_store_t &s);
+void packDaily(const owm_daily_t *daily, int n, daily_store_t &s);
+int  missingAirHours(const air_history_t &s, int64_t now);
+int  pushAirHistory(const owm_resp_air_pollution_t &r, air_history_t &s);
+void unpackAirHistory(const air_history_t &s, owm_resp_air_pollution_t &r);
+
+#endif
@@ -0,0 +1,46 @@
+/* Render server frame format for esp32-weather-epd.
+ * Copyright (C) 2023  Luke Marzen
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef __FRAME_H__
+#define __FRAME_H__
+
+#include <cstdint>
+
+#include "renderer.h"
+
+/* A frame is a frame_header_t followed by DISP_HEIGHT rows, top to bottom.
+ * Each row is the row of the black plane then, if there are 2 planes, the row
+ * of the color plane. Rows are FRAME_ROW_BYTES, the leftmost pixel in the most
+ * significant bit, and a bit is 0 where there is ink, the layout GxEPD2 writes
+ * to the panel. The render server deflates frames (Content-Encoding: deflate).
+ * Fields are little-endian.
+ */
+#define FRAME_MAGIC     0x46504545 // "EEPF"
+#define FRAME_ROW_BYTES (DISP_WIDTH / 8)
+
+struct frame_header_t
+{
+  uint32_t magic;
+  uint16_t width;
+  uint16_t height;
+  uint8_t  planes; // 1: black, 2: black and color
+  uint8_t  reserved[3];
+};
+
+static_assert(sizeof(frame_header_t) == 12, "frame_header_t must be packed");
+
+#endif
@@ -0,0 +1,120 @@
+/* Lazy JSON index declarations for esp32-weather-epd.
+ * Copyright (C) 2023  Luke Marzen
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef __JSON_INDEX_H__
+#define __JSON_INDEX_H__
+
+#include <cstddef>
+#include <cstdint>
+#include <ArduinoJson.h>
+
+class Stream;
+
+// Offset used for tokens without a key (array elements and the root).
+#define JSON_NO_KEY UINT32_MAX
+
+/* One value of the document: where it starts, where its key starts, and how
+ * many tokens its subtree spans so that siblings can be reached without
+ * visiting children.
+ */
+struct json_token_t
+{
+  uint32_t key;   // offset of the first character of the key, or JSON_NO_KEY
+  uint32_t value; // offset of the first character of the value
+  uint32_t next;  // number of tokens up to the next sibling, 1 for scalars
+};
+
+/* Structural index over a JSON document held in one contiguous buffer.
+ *
+ * The body is read once into a buffer from the wake arena and indexed in a
+ * single pass that records only the offsets of values and keys. Nothing is
+ * converted until it is asked for: numbers are parsed and strings unescaped
+ * by the accessors of Value, straight out of the buffer. Compared to
+ * materializing a JsonDocument, fields that are not read cost only their
+ * index entry.
+ *
+ * Keys are matched as raw bytes, so keys containing escapes are not found.
+ */
+class JsonIndex
+{
+public:
+  class Value
+  {
+  public:
+    Value() : _index(nullptr), _tok(-1), _end(0) {}
+    Value(const JsonIndex *index, int tok, int end)
+      : _index(index), _tok(tok), _end(end) {}
+
+    Value operator[](const char *key) const;
+    Value operator[](int i) const;
+
+    bool isNull() const;
+    bool isObject() const;
+    bool isArray() const;
+    // Number of members or elements, 0 for anything else.
+    int  size() const;
+
+    // Iteration over members or elements.
+    Value first() const;
+    Value next() const;
+
+    float   asFloat() const;
+    int     asInt() const;
+    int64_t asInt64() const;
+    // Unescapes a string into dst, cut at a character boundary to fit.
+    // Anything other than a string is copied as an empty string.
+    size_t  copyString(char *dst, size_t size) const;
+
+  private:
+    const char *text() const;
+
+    const JsonIndex *_index;
+    int              _tok;  // -1 if the value does not exist
+    int              _end;  // token past the last sibling
+  };
+
+  JsonIndex();
+  ~JsonIndex();
+
+  // Reads one document from the stream and indexes it. The stream is read up
+  // to the end of the document, not to the end of the stream.
+  DeserializationError read(Stream &json);
+
+  Value root() const { return Value(this, _count > 0 ? 0 : -1, _count); }
+
+  size_t length() const { return _len; }
+  size_t tokens() const { return _count; }
+  // bytes of the buffer and the index
+  size_t memoryUsage() const
+  {
+    return _bufCap + _tokCap * sizeof(json_token_t);
+  }
+
+private:
+  DeserializationError buffer(Stream &json);
+  DeserializationError index();
+  bool push(uint32_t key, uint32_t value);
+
+  char         *_buf;
+  size_t        _len;
+  size_t        _bufCap;
+  json_token_t *_tok;
+  size_t        _count;
+  size_t        _tokCap;
+};
+
+#endif
@@ -0,0 +1,69 @@
+/* Cross-wake memoization declarations for esp32-weather-epd.
+ * Copyright (C) 2023  Luke Marzen
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef __MEMO_H__
+#define __MEMO_H__
+
+#include <cstddef>
+#include <cstdint>
+
+/* Kinds of memoized values. Only computations that cost more than hashing
+ * their inputs are memoized. Each kind is keyed by a hash of every input its
+ * computation reads, which is also its invalidation rule: an entry is only
+ * used while the inputs hash to the same key. Memory is kept in RTC memory,
+ * which is reinitialized on every reset other than a deep sleep wake, so
+ * flashing new firmware (fonts, locale, config) also drops every entry.
+ */
+enum memo_kind_t
+{
+  MEMO_AQI,               // air pollution concentrations and times
+  MEMO_TEXT_WIDTH,        // font and text
+  MEMO_NUM_KINDS
+};
+
+const uint32_t FNV_OFFSET_BASIS = 2166136261u;
+const uint32_t FNV_PRIME        = 16777619u;
+
+/* 32-bit FNV-1a hash of len bytes, continuing from hash.
+ */
+inline uint32_t fnv1a(const void *data, size_t len,
+                      uint32_t hash = FNV_OFFSET_BASIS)
+{
+  const uint8_t *p = static_cast<const uint8_t *>(data);
+  for (size_t i = 0; i < len; ++i)
+  {
+    hash = (hash ^ p[i]) * FNV_PRIME;
+  }
+  return hash;
+}
+
+/* Hashes any number of scalar arguments into a memo key.
+ */
+template<typename... Args>
+inline uint32_t memoKey(const Args &...args)
+{
+  uint32_t hash = FNV_OFFSET_BASIS;
+  ((hash = fnv1a(&args, sizeof(args), hash)), ...);
+  return hash;
+}
+
+bool memoGet(memo_kind_t kind, uint32_t key, uintptr_t &value);
+void memoPut(memo_kind_t kind, uint32_t key, uintptr_t value);
+uint32_t memoHits();
+uint32_t memoMisses();
+
+#endif
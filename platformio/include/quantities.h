@@ -150,3 +150,27 @@ protected:
 using TemperatureUnit = UNITS_TEMP;
 using DistanceUnit = UNITS_DIST;
 using SpeedUnit = UNITS_SPEED;
+
+#if defined(UNITS_PRES_HECTOPASCALS)
+#define UNITS_PRES_NAME "Hectopascals"
+#elif defined(UNITS_PRES_PASCALS)
+#define UNITS_PRES_NAME "Pascals"
+#elif defined(UNITS_PRES_MILLIMETERSOFMERCURY)
+#define UNITS_PRES_NAME "MillimetersOfMercury"
+#elif defined(UNITS_PRES_INCHESOFMERCURY)
+#define UNITS_PRES_NAME "InchesOfMercury"
+#elif defined(UNITS_PRES_MILLIBARS)
+#define UNITS_PRES_NAME "Millibars"
+#elif defined(UNITS_PRES_ATMOSPHERES)
+#define UNITS_PRES_NAME "Atmospheres"
+#elif defined(UNITS_PRES_GRAMSPERSQUARECENTIMETER)
+#define UNITS_PRES_NAME "GramsPerSquareCentimeter"
+#elif defined(UNITS_PRES_POUNDSPERSQUAREINCH)
+#define UNITS_PRES_NAME "PoundsPerSquareInch"
+#endif
+
+#define UNITS_NAME_(unit) #unit
+#define UNITS_NAME(unit) UNITS_NAME_(unit)
+// The units drawn, so that a render server can tell whether it draws the same.
+#define UNITS_STRING \
+    UNITS_NAME(UNITS_TEMP) "," UNITS_NAME(UNITS_SPEED) "," UNITS_NAME(UNITS_DIST) "," UNITS_PRES_NAME
@@ -24,6 +24,8 @@
 #include <time.h>
 #include "api_response.h"
 #include "config.h"
+#include "forecast_store.h"
+#include "timeline.h"
 
 #define DISP_WIDTH  800
 #define DISP_HEIGHT 480
@@ -50,6 +52,7 @@ typedef enum alignment
 } alignment_t;
 
 uint16_t getStringWidth(String text);
+uint16_t getStringWidthMemo(const GFXfont *font, const String &text);
 uint16_t getStringHeight(String text);
 void drawString(int16_t x, int16_t y, String text, alignment_t alignment, 
                 uint16_t color=GxEPD_BLACK);
@@ -60,16 +63,21 @@ void initDisplay();
 void drawCurrentConditions(const owm_current_t &current,
                            const owm_daily_t &today,
                            const owm_resp_air_pollution_t &owm_air_pollution,
+                           const timeline_t &tl,
                            const std::optional<Quantity<TemperatureUnit>> &inTemp,
                            const std::optional<float> &inHumidity);
-void drawForecast(owm_daily_t *const daily, tm timeInfo);
-void drawAlerts(std::vector<owm_alerts_t> &alerts,
+void drawForecast(const daily_store_t &daily, const timeline_t &tl);
+void drawAlerts(StaticVector<owm_alerts_t, OWM_NUM_ALERTS> &alerts,
                 const String &city, const String &date);
 void drawLocationDate(const String &city, const String &date);
-void drawOutlookGraph(owm_hourly_t *const hourly, tm timeInfo);
+void drawOutlookGraph(const timeline_t &tl);
+void drawPrecipNextHour(const owm_precip_next_hour_t &precip);
 void drawStatusBar(String statusStr, String refreshTimeStr, int rssi, 
                    double batVoltage);
 void drawError(const uint8_t *bitmap_196x196, 
                const String &errMsgLn1, const String &errMsgLn2);
+#ifdef ARDUINO
+bool streamFrame(Stream &frame);
+#endif
 
 #endif
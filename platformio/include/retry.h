@@ -0,0 +1,53 @@
+/* Failure-aware retry scheduling declarations for esp32-weather-epd.
+ * Copyright (C) 2023  Luke Marzen
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef __RETRY_H__
+#define __RETRY_H__
+
+#include <cstdint>
+
+/* Steps of a wake that can fail and end it early.
+ */
+enum wake_step_t
+{
+  WAKE_STEP_WIFI = 1,
+  WAKE_STEP_TIME,
+  WAKE_STEP_FORECAST,
+  WAKE_STEP_AIR_POLLUTION,
+};
+
+/* Consecutive failed wakes are counted in RTC memory. After a transient
+ * failure the next wake is brought forward to RETRY_INTERVAL minutes,
+ * doubling with each consecutive failure, with jitter so that displays that
+ * failed together do not retry together. Once the delay reaches
+ * SLEEP_DURATION the regular schedule is resumed.
+ */
+
+// Whether a request that failed with this HTTP Status Code (or deserialization
+// error, see getJson) may succeed if retried.
+bool isTransientError(int httpCode);
+// Records a failed wake. Returns false if the same error is already drawn on
+// the display, so that it is not drawn again.
+bool retryFailed(wake_step_t step, int code);
+// Records a successful wake.
+void retrySucceeded();
+// Records that something other than an error was drawn on the display.
+void retryScreenReplaced();
+// Seconds until the next wake should retry, or 0 to keep to the schedule.
+uint64_t retryDelay(bool transient);
+
+#endif
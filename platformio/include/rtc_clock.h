@@ -0,0 +1,45 @@
+/* Drift calibrated RTC clock declarations for esp32-weather-epd.
+ * Copyright (C) 2023  Luke Marzen
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef __RTC_CLOCK_H__
+#define __RTC_CLOCK_H__
+
+#include <cstdint>
+#include <Arduino.h>
+
+/* The system clock keeps running through deep sleep on the RTC slow clock,
+ * which drifts by far more than the crystal used while awake. The drift is
+ * measured against NTP, over the time spent asleep between two syncs, and kept
+ * in RTC memory. Each wake corrects the clock by the drift accumulated while
+ * asleep, and the sleep timer is scaled by it, so NTP is only needed every
+ * TIME_SYNC_INTERVAL hours.
+ */
+
+// Corrects the clock for the drift of the last deep sleep. Call first thing.
+void clockWake();
+// Whether this wake should sync with NTP.
+bool clockNeedsSync();
+// Records an NTP sync: the clock read clockUs when the time was trueUs.
+void clockSynced(int64_t clockUs, int64_t trueUs);
+// Checks the clock against an HTTP Date header, for wakes without NTP.
+void clockCheckDate(const String &date);
+// Returns the timer to sleep for sleepDuration seconds, in microseconds.
+uint64_t clockSleepTimer(uint64_t sleepDuration);
+// Microseconds since the epoch.
+int64_t clockNow();
+
+#endif
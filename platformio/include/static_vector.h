@@ -0,0 +1,60 @@
+/* Fixed-capacity vector for esp32-weather-epd.
+ * Copyright (C) 2023  Luke Marzen
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef __STATIC_VECTOR_H__
+#define __STATIC_VECTOR_H__
+
+#include <cstddef>
+
+/* Vector with inline storage for at most N elements.
+ *
+ * Elements live inside the object, so it never allocates and it is trivially
+ * copyable whenever T is. push_back() on a full vector drops the element and
+ * returns false.
+ */
+template<typename T, size_t N>
+struct StaticVector
+{
+  T      _items[N];
+  size_t _size;
+
+  size_t size() const { return _size; }
+  static constexpr size_t capacity() { return N; }
+  bool empty() const { return _size == 0; }
+  bool full() const { return _size == N; }
+  void clear() { _size = 0; }
+
+  bool push_back(const T &item)
+  {
+    if (_size == N)
+    {
+      return false;
+    }
+    _items[_size++] = item;
+    return true;
+  }
+
+  T       &operator[](size_t i)       { return _items[i]; }
+  const T &operator[](size_t i) const { return _items[i]; }
+
+  T       *begin()       { return _items; }
+  T       *end()         { return _items + _size; }
+  const T *begin() const { return _items; }
+  const T *end()   const { return _items + _size; }
+};
+
+#endif
@@ -0,0 +1,295 @@
+/* Stream adapter declarations for esp32-weather-epd.
+ * Copyright (C) 2023  Luke Marzen
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef __STREAM_UTILS_H__
+#define __STREAM_UTILS_H__
+
+#include <Arduino.h>
+#ifdef ARDUINO
+#include <esp32/rom/miniz.h>
+#endif
+
+/* Read-only stream that holds what it has read from its source in a buffer of
+ * its own, which a reader can take out a segment at a time instead of with a
+ * call per byte (see JsonBodyReader).
+ */
+class SegmentedStream : public Stream
+{
+public:
+  // Points data at the next unread bytes of the buffer, refilling it first if
+  // it has been read, waiting for the source as read() does, and marks them
+  // read. Returns how many there are, 0 once the stream has ended.
+  virtual size_t readSegment(const uint8_t *&data) = 0;
+};
+
+/* Read-only stream that passes bytes through from another stream while
+ * counting how many have been consumed.
+ */
+class CountingStream : public Stream
+{
+public:
+  CountingStream(Stream &src) : _src(src), _count(0) {}
+
+  int available() override { return _src.available(); }
+  int peek() override { return _src.peek(); }
+  int read() override;
+  size_t readBytes(char *buffer, size_t length) override;
+  size_t write(uint8_t) override { return 0; }
+  void flush() override {}
+
+  size_t count() const { return _count; }
+
+private:
+  Stream &_src;
+  size_t  _count;
+};
+
+/* Read-only stream over bytes held in memory.
+ */
+class MemoryStream : public SegmentedStream
+{
+public:
+  MemoryStream(const uint8_t *data, size_t len)
+    : _data(data), _len(len), _pos(0) {}
+
+  int available() override { return _len - _pos; }
+  int peek() override { return _pos < _len ? _data[_pos] : -1; }
+  int read() override { return _pos < _len ? _data[_pos++] : -1; }
+  size_t readBytes(char *buffer, size_t length) override;
+  size_t readSegment(const uint8_t *&data) override;
+  size_t write(uint8_t) override { return 0; }
+  void flush() override {}
+
+private:
+  const uint8_t *_data;
+  size_t         _len;
+  size_t         _pos;
+};
+
+/* Read-only stream over a network client that receives in bulk.
+ *
+ * Reading a client one byte at a time goes through the client's locking and
+ * timeout logic for every byte. Here whole segments are copied out of the
+ * client at once into a caller-provided buffer that can be reused from request
+ * to request, and bytes are served from it without calling the client again.
+ *
+ * readBytes() returns as soon as some bytes are available instead of waiting
+ * for all of length, and the stream ends as soon as the server has closed the
+ * connection and everything was read, instead of after the timeout.
+ */
+class BufferedClientStream : public SegmentedStream
+{
+public:
+  BufferedClientStream(Client &src, uint8_t *buffer, size_t size);
+
+  int available() override;
+  int peek() override;
+  int read() override;
+  size_t readBytes(char *buffer, size_t length) override;
+  size_t readSegment(const uint8_t *&data) override;
+  size_t write(uint8_t) override { return 0; }
+  void flush() override {}
+
+  // number of reads from the client, to compare against the bytes received
+  size_t fills() const { return _fills; }
+  // time spent waiting for the client to receive, us
+  unsigned long waitTime() const { return _waitTime; }
+
+private:
+  bool fill();
+
+  Client  &_src;
+  uint8_t *_buf;
+  size_t   _size;
+  size_t   _pos;  // unread bytes are [_pos, _len)
+  size_t   _len;
+  size_t   _fills;
+  unsigned long _waitTime;
+};
+
+#ifdef ARDUINO
+/* Read-only stream that inflates a gzip, zlib or raw deflate compressed
+ * stream on the fly.
+ *
+ * Decompressed bytes are served straight out of the deflate window, so
+ * memory use is bounded by the window (32 KB, the largest window a deflate
+ * stream may reference) plus a small input buffer regardless of the size of
+ * the body. The window and decompressor state (~11 KB, too large for the
+ * stack) are only allocated once the first byte is read. If the allocation
+ * fails or the stream is corrupt, the stream simply ends, which the
+ * JSON deserializer reports as incomplete input.
+ */
+class InflateStream : public SegmentedStream
+{
+public:
+  enum Format { GZIP, ZLIB, RAW };
+
+  InflateStream(Stream &src, Format format);
+  ~InflateStream();
+
+  int available() override;
+  int peek() override;
+  int read() override;
+  size_t readBytes(char *buffer, size_t length) override;
+  size_t readSegment(const uint8_t *&data) override;
+  size_t write(uint8_t) override { return 0; }
+  void flush() override {}
+
+  bool failed() const { return _failed; }
+
+private:
+  bool begin();
+  bool skipGzipHeader();
+  int  srcRead();
+  bool fill();
+
+  Stream            &_src;
+  Format             _format;
+  tinfl_decompressor *_decomp;
+  uint8_t           *_window;   // circular output window
+  size_t             _winOfs;   // next write position in the window
+  size_t             _outPos;   // unread output is [_outPos, _outEnd)
+  size_t             _outEnd;
+  uint8_t            _in[256];  // compressed input buffer
+  size_t             _inPos;
+  size_t             _inLen;
+  bool               _srcEnd;
+  bool               _started;
+  bool               _done;
+  bool               _failed;
+};
+#endif
+
+/* Incremental scanner that follows the structure of a JSON document one byte
+ * at a time without storing it. It tracks just enough state for stream
+ * adapters to tell which key the current value belongs to.
+ */
+class JsonScanner
+{
+public:
+  JsonScanner();
+
+  // Advances by one byte. Returns true if the byte terminated a number or
+  // literal, which is then available from scalar().
+  bool feed(char c);
+
+  bool   inString() const { return _inString; }
+  // the current string is the value of key(), as opposed to a key or an array
+  // element
+  bool   inMemberString() const { return _inString && _memberString; }
+  // inside an escape sequence of a string, past its backslash
+  bool   inEscape() const { return _escape > 0; }
+  // the string so far ends with a whole character: not inside an escape
+  // sequence, nor after a \u escape of a high surrogate, which is only a
+  // character together with the low surrogate escape that follows
+  bool   atCharBoundary() const { return _escape == 0 && !_highSurrogate; }
+  size_t stringLength() const { return _strLen; }
+  // most recent key at any depth, and most recent key of the root object
+  const char *key() const { return _key; }
+  const char *rootKey() const { return _rootKey; }
+  // last number or literal, and whether it was the value of key()
+  const char *scalar() const { return _scalar; }
+  bool   scalarIsMember() const { return _scalarMember; }
+
+private:
+  uint32_t _objects;      // bit n set if nesting level n is an object
+  int      _depth;
+  bool     _expectKey;    // next string is an object key
+  bool     _afterColon;   // next value is the value of key()
+  bool     _inString;
+  bool     _isKey;
+  bool     _memberString;
+  uint8_t  _escape;       // bytes of the escape sequence still to come
+  bool     _highSurrogate;
+  uint16_t _codeUnit;     // of the \u escape being read
+  bool     _scalarMember;
+  size_t   _strLen;
+  size_t   _keyLen;
+  size_t   _scalarLen;
+  char     _key[24];
+  char     _rootKey[24];
+  char     _scalar[24];
+};
+
+/* The input of the JSON deserializer: a SegmentedStream read a segment at a
+ * time, and handed to ArduinoJson a byte at a time by an inline, non-virtual
+ * read() (see the Reader specialization in api_deserializer.cpp). Reading a
+ * Stream, ArduinoJson makes a virtual call per byte, and another through each
+ * adapter stacked below it.
+ *
+ * What adapters did to the document as it streamed past is done here in the
+ * same pass: the bytes read are counted, the string values of one key can be
+ * truncated and the numbers of another tapped.
+ */
+class JsonBodyReader
+{
+public:
+  typedef void (*tap_t)(float value, void *ctx);
+
+  JsonBodyReader(SegmentedStream &src);
+
+  // Truncates the string values of key to at most maxLen bytes. The remainder
+  // of a truncated string is skipped as it streams past, so it never reaches
+  // the deserializer and costs no memory. Strings are only cut at UTF-8
+  // character and escape sequence boundaries, so the output is always valid
+  // JSON.
+  void truncate(const char *key, size_t maxLen);
+  // Hands every numeric value of key, found anywhere below the root member
+  // rootKey, to fn as it streams past. Paired with a deserialization filter
+  // that excludes rootKey, this folds large arrays into a summary without
+  // ever storing them.
+  void tap(const char *rootKey, const char *key, tap_t fn, void *ctx);
+
+  int read()
+  {
+    while (_pos < _len || fill())
+    {
+      char c = static_cast<char>(_seg[_pos++]);
+      if (!_scanning || keep(c))
+      {
+        return static_cast<uint8_t>(c);
+      }
+    }
+    return -1;
+  }
+
+  size_t readBytes(char *buffer, size_t length);
+
+  // bytes read from the stream
+  size_t count() const { return _count + _pos; }
+
+private:
+  bool fill();
+  bool keep(char c);
+
+  SegmentedStream &_src;
+  const uint8_t   *_seg;      // unread bytes of the segment are [_pos, _len)
+  size_t           _pos;
+  size_t           _len;
+  size_t           _count;    // bytes of the segments before this one
+  bool             _scanning; // truncating or tapping
+  const char      *_truncKey; // key whose string values are truncated
+  size_t           _maxLen;
+  bool             _skipping; // current string has been truncated
+  const char      *_tapRoot;
+  const char      *_tapKey;
+  tap_t            _tapFn;
+  void            *_tapCtx;
+  JsonScanner      _scanner;
+};
+
+#endif
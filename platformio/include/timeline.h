@@ -0,0 +1,72 @@
+/* Forecast timeline declarations for esp32-weather-epd.
+ * Copyright (C) 2023  Luke Marzen
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef __TIMELINE_H__
+#define __TIMELINE_H__
+
+#include <cstdint>
+#include <time.h>
+#include "api_response.h"
+#include "forecast_store.h"
+
+// The timeline reaches back as far as the air pollution history (the current
+// hour is its last sample) and forward as far as the hourly forecast.
+#define TIMELINE_PAST  (OWM_NUM_AIR_POLLUTION - 1)
+#define TIMELINE_SLOTS (TIMELINE_PAST + OWM_NUM_HOURLY)
+
+/*
+ * Hourly, daily and air pollution data merged onto a single time axis of one
+ * hour slots. Everything the renderer needs is computed once here, the local
+ * time of every slot, temperatures in display units and which daily forecast
+ * and air pollution sample each hour falls in, so drawing does no time zone
+ * or unit conversions of its own.
+ */
+struct timeline_t
+{
+  int64_t start;                     // Top of the hour of slot 0, Unix, UTC
+  int     now;                       // Slot of the current hour
+  int     count;                     // Number of slots
+  int8_t  hour[TIMELINE_SLOTS];      // Local hour of day
+  float   temp[TIMELINE_SLOTS];      // Temperature, TemperatureUnit, NAN if not forecast
+  uint8_t pop[TIMELINE_SLOTS];       // Probability of precipitation, %
+  int8_t  day[TIMELINE_SLOTS];       // Index into the daily forecast of the local day, -1 if none
+  int8_t  air[TIMELINE_SLOTS];       // Index into the air pollution samples, -1 if none
+  float   graph_temp_min;            // Lowest temperature of the outlook graph, TemperatureUnit, NAN if not forecast
+  float   graph_temp_max;            // Highest temperature of the outlook graph, TemperatureUnit, NAN if not forecast
+
+  int8_t  day_wday[OWM_NUM_DAILY];     // Local day of week of each daily forecast
+  float   day_temp_min[OWM_NUM_DAILY]; // Min daily temperature, TemperatureUnit
+  float   day_temp_max[OWM_NUM_DAILY]; // Max daily temperature, TemperatureUnit
+
+  tm      sunrise;                   // Today's sunrise, local time
+  tm      sunset;                    // Today's sunset, local time
+
+  // Returns the slot h hours from now, or -1 if it is not on the timeline.
+  int slot(int h) const
+  {
+    int s = now + h;
+    return (s >= 0 && s < count) ? s : -1;
+  }
+};
+
+void buildTimeline(timeline_t &tl,
+                   const hourly_store_t &hourly,
+                   const daily_store_t &daily,
+                   const owm_current_t &current,
+                   const owm_resp_air_pollution_t &air);
+
+#endif
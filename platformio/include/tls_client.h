@@ -0,0 +1,86 @@
+/* TLS client with session resumption declarations for esp32-weather-epd.
+ * Copyright (C) 2023  Luke Marzen
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef __TLS_CLIENT_H__
+#define __TLS_CLIENT_H__
+
+#include <Arduino.h>
+#include <WiFiClient.h>
+#include <mbedtls/ctr_drbg.h>
+#include <mbedtls/entropy.h>
+#include <mbedtls/net_sockets.h>
+#include <mbedtls/ssl.h>
+#include <mbedtls/x509_crt.h>
+
+/* TLS over a WiFiClient connection, usable by HTTPClient in place of one.
+ *
+ * Unlike WiFiClientSecure, the TLS session negotiated by a full handshake is
+ * kept in RTC memory, and the next connection to the same host, on this wake
+ * or a later one, offers it to the server (session ticket or session ID).
+ * A resumed handshake skips the certificate exchange and key agreement, which
+ * is most of the CPU time of a handshake.
+ *
+ * The server is always verified, against the root certificate set for its
+ * host, see rootCA() in client_utils.cpp. Without one no connection is made.
+ */
+class TlsClient : public WiFiClient
+{
+public:
+  TlsClient();
+  ~TlsClient();
+
+  // host name sent (SNI) and verified when connecting by address
+  void setServerName(const char *host) { _serverName = host; }
+  // root certificate (PEM) that the server's chain must lead to
+  void setCACert(const char *rootCA) { _rootCA = rootCA; }
+
+  int connect(IPAddress ip, uint16_t port);
+  int connect(IPAddress ip, uint16_t port, int32_t timeout);
+  int connect(const char *host, uint16_t port);
+  int connect(const char *host, uint16_t port, int32_t timeout);
+  size_t write(uint8_t data);
+  size_t write(const uint8_t *buf, size_t size);
+  int available();
+  int read();
+  int read(uint8_t *buf, size_t size);
+  int peek();
+  void flush();
+  void stop();
+  uint8_t connected();
+
+  // duration of the last handshake, ms, and whether it resumed a session
+  unsigned long handshakeTime() const { return _handshakeTime; }
+  bool resumed() const { return _resumed; }
+
+private:
+  int handshake();
+
+  mbedtls_ssl_context      _ssl;
+  mbedtls_ssl_config       _conf;
+  mbedtls_ctr_drbg_context _drbg;
+  mbedtls_entropy_context  _entropy;
+  mbedtls_x509_crt         _ca;
+  mbedtls_net_context      _net;
+  bool                     _tls; // handshake done, contexts in use
+  int                      _peek;
+  String                   _serverName;
+  const char              *_rootCA;
+  unsigned long            _handshakeTime;
+  bool                     _resumed;
+};
+
+#endif
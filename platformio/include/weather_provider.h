@@ -0,0 +1,55 @@
+/* Weather provider declarations for esp32-weather-epd.
+ * Copyright (C) 2023  Luke Marzen
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef __WEATHER_PROVIDER_H__
+#define __WEATHER_PROVIDER_H__
+
+#include <Arduino.h>
+#include "api_response.h"
+#include "client_utils.h"
+
+/* A source of forecast and air pollution data.
+ *
+ * Every provider fills the structures of OpenWeatherMap's APIs, which is what
+ * the rest of the program is written against. Fields a provider has no data
+ * for are left zeroed.
+ */
+class WeatherProvider
+{
+public:
+  virtual ~WeatherProvider() = default;
+
+  // Names of the APIs, shown on the display if a request fails.
+  virtual String forecastApi() const = 0;
+  virtual String airPollutionApi() const = 0;
+
+  // Whether getForecast can leave out the hourly or daily forecast.
+  virtual bool partialForecast() const { return false; }
+
+  // Perform the requests. Return the HTTP Status Code. sections are the
+  // FETCH_HOURLY and FETCH_DAILY flags of the parts of the forecast that are
+  // needed, the current conditions always are. hours are the hours of air
+  // pollution history needed, ending with the current hour.
+  virtual int getForecast(HttpSession &session, owm_resp_onecall_t &r,
+                          uint8_t sections) = 0;
+  virtual int getAirPollution(HttpSession &session,
+                              owm_resp_air_pollution_t &r, int hours) = 0;
+};
+
+WeatherProvider &weatherProvider();
+
+#endif
@@ -5,6 +5,8 @@
 #include <Arduino.h>
 #include <gfxfont.h>
 
+#include "arena.h"
+
 namespace W {
 
 struct Font
@@ -51,6 +53,9 @@ private:
 
 class Item;
 
+// widget trees only live for the render phase, so they use the wake arena
+using ItemList = std::vector<Item *, ArenaStdAllocator<Item *>>;
+
 class Window
 {
 public:
@@ -60,7 +65,7 @@ public:
     Window &operator<<(Item &item);
 
 private:
-    std::vector<Item *> _children;
+    ItemList _children;
 };
 
 class Item
@@ -74,7 +79,7 @@ protected:
     virtual void paint(Painter &painter);
 
 private:
-    std::vector<Item *> _children;
+    ItemList _children;
 };
 
 class Text : public Item
@@ -15,15 +15,210 @@
  * along with this program.  If not, see <https://www.gnu.org/licenses/>.
  */
 
+#include <algorithm>
+#include <cstring>
+#include <iterator>
 #include <vector>
+#include <Arduino.h>
 #include <ArduinoJson.h>
 #include <WiFiClient.h>
 #include <HTTPClient.h>
+#ifdef ARDUINO
+#include <esp_heap_caps.h>
+#endif
 
+#include "api_codec.h"
+#include "api_deserializer.h"
 #include "api_response.h"
+#include "arena.h"
+#include "config.h"
+#include "json_index.h"
+#include "stream_utils.h"
 
-DeserializationError deserializeOneCall(WiFiClient &json, 
-                                        owm_resp_onecall_t &r) 
+// JSON document capacities, bytes. The defaults are used until a parse has
+// succeeded, afterwards documents are sized from the observed high-water mark.
+#define ONECALL_JSON_CAPACITY       (48 * 1024)
+#define AIR_POLLUTION_JSON_CAPACITY ( 8 * 1024)
+#define OPEN_METEO_JSON_CAPACITY    (16 * 1024)
+#define JSON_CAPACITY_MAX           (96 * 1024)
+
+// JSON documents are allocated from the wake arena rather than the heap
+using ArenaJsonDocument = BasicJsonDocument<ArenaAllocator>;
+
+// ArduinoJson reads a JsonBodyReader through its inline read(), rather than
+// through Stream::readBytes with a virtual call per byte
+#ifdef ARDUINOJSON_BEGIN_PRIVATE_NAMESPACE
+ARDUINOJSON_BEGIN_PRIVATE_NAMESPACE
+#else
+namespace ARDUINOJSON_NAMESPACE {
+#endif
+template<>
+struct Reader<JsonBodyReader, void>
+{
+public:
+  Reader(JsonBodyReader &source) : _source(&source) {}
+
+  int read() { return _source->read(); }
+
+  size_t readBytes(char *buffer, size_t length)
+  {
+    return _source->readBytes(buffer, length);
+  }
+
+private:
+  JsonBodyReader *_source;
+};
+#ifdef ARDUINOJSON_END_PRIVATE_NAMESPACE
+ARDUINOJSON_END_PRIVATE_NAMESPACE
+#else
+}
+#endif
+
+// deserialization statistics, retained through deep-sleep
+RTC_DATA_ATTR json_stats_t onecallJsonStats      = {};
+RTC_DATA_ATTR json_stats_t airPollutionJsonStats = {};
+#ifdef JSON_LAZY_INDEX
+RTC_DATA_ATTR json_stats_t onecallIndexJsonStats = {};
+#endif
+
+/* Returns the JSON document capacity to use for the next parse.
+ */
+static size_t jsonCapacity(const json_stats_t &s, size_t defaultCapacity)
+{
+  if (s.capacity == 0)
+  { // nothing has been recorded yet
+    return defaultCapacity;
+  }
+  return s.capacity;
+} // end jsonCapacity
+
+/* Memory and time in use at a point of a parse, see parseMark.
+ */
+struct parse_mark_t
+{
+  unsigned long time;       // us
+  size_t        heapBytes;  // allocated on the heap, but for the arena block
+  size_t        heapBlocks; // allocated on the heap, but for the arena block
+  size_t        arenaBytes;
+  size_t        arenaBlocks; // allocated in the arena, but for heap fallbacks
+};
+
+/* Marks the start (or end) of a parse. The difference of two marks is what the
+ * parse took, as long as nothing else allocates at the same time; other tasks
+ * allocating concurrently are counted too.
+ *
+ * Walking the heap takes a while, so the time is taken after it at the start
+ * and before it at the end. On the host the heap is not walked, the benchmark
+ * there counts allocations itself.
+ */
+static parse_mark_t parseMark(bool start)
+{
+  parse_mark_t m = {};
+  if (!start)
+  {
+    m.time = micros();
+  }
+#ifdef ARDUINO
+  multi_heap_info_t info;
+  heap_caps_get_info(&info, MALLOC_CAP_8BIT);
+  m.heapBytes  = info.total_allocated_bytes;
+  m.heapBlocks = info.allocated_blocks;
+  if (wakeArena.reserved() != 0)
+  {
+    m.heapBytes  -= wakeArena.reserved();
+    m.heapBlocks -= 1;
+  }
+#endif
+  m.arenaBytes  = wakeArena.used();
+  m.arenaBlocks = wakeArena.allocations() - wakeArena.fallbacks();
+  if (start)
+  {
+    m.time = micros();
+  }
+  return m;
+} // end parseMark
+
+/* Keeps the fastest rate of parsing seen as the baseline. parseTime includes
+ * waiting on the network until discountRxWait takes that out, the rate is
+ * updated again then.
+ */
+static void updateParseRate(json_stats_t &s)
+{
+  if (s.bytesRx >= 1024)
+  {
+    unsigned long rate = s.parseTime / (s.bytesRx / 1024);
+    if (s.bestParseRate == 0 || rate < s.bestParseRate)
+    {
+      s.bestParseRate = rate;
+    }
+  }
+  return;
+} // end updateParseRate
+
+/* Records the outcome of a parse started at start and determines the document
+ * capacity for the next parse.
+ *
+ * On success the capacity is sized from the high-water mark of memory usage
+ * plus a 25% margin. If the document ran out of memory, the capacity is
+ * doubled so that the caller's next attempt succeeds instead of failing the
+ * wake.
+ */
+static void recordJsonStats(json_stats_t &s, size_t memoryUsage,
+                            size_t capacity, size_t bytesRx,
+                            const parse_mark_t &start,
+                            DeserializationError error)
+{
+  parse_mark_t end = parseMark(false);
+  s.bytesRx     = bytesRx;
+  s.parseTime   = end.time - start.time;
+  s.allocations = (end.arenaBlocks - start.arenaBlocks)
+                  + std::max(static_cast<long>(end.heapBlocks)
+                             - static_cast<long>(start.heapBlocks), 0L);
+  s.heapUsed    = static_cast<long>(end.heapBytes - start.heapBytes)
+                  + static_cast<long>(end.arenaBytes - start.arenaBytes);
+
+  if (error == DeserializationError::NoMemory)
+  {
+    s.capacity = std::min<size_t>(2 * capacity, JSON_CAPACITY_MAX);
+    return;
+  }
+  if (error)
+  {
+    return;
+  }
+
+  updateParseRate(s);
+  s.memoryUsage = memoryUsage;
+  s.peakUsage   = std::max(s.peakUsage, s.memoryUsage);
+  s.capacity    = std::min<size_t>(s.peakUsage + s.peakUsage / 4,
+                                   JSON_CAPACITY_MAX);
+  return;
+} // end recordJsonStats
+
+/* Takes the time spent waiting on the network for the body, which the parse
+ * of a stream can not tell apart from parsing, out of the last parse recorded
+ * in s.
+ */
+void discountRxWait(json_stats_t &s, unsigned long waitTime)
+{
+  s.parseTime -= std::min(waitTime, s.parseTime);
+  updateParseRate(s);
+  return;
+} // end discountRxWait
+
+#ifdef ENABLE_MINUTELY_PRECIP
+/* JsonBodyReader tap, folds a minutely precipitation value into the
+ * owm_precip_next_hour_t ctx.
+ */
+static void tapMinutelyPrecip(float value, void *ctx)
+{
+  foldMinutelyPrecip(*static_cast<owm_precip_next_hour_t *>(ctx), value);
+  return;
+} // end tapMinutelyPrecip
+#endif
+
+DeserializationError deserializeOneCall(SegmentedStream &json,
+                                        owm_resp_onecall_t &r)
 {
   int i;
 
@@ -35,76 +230,92 @@ DeserializationError deserializeOneCall(WiFiClient &json,
 
   JsonArray filter_alerts = filter.createNestedArray("alerts");
 
-  // description can be very long so they are filtered out to save on memory
-  // along with sender_name
+  // sender_name is filtered out to save on memory, description can be very
+  // long so it is truncated as it streams in (see JsonBodyReader)
   JsonObject filter_alerts_0 = filter_alerts.createNestedObject();
   filter_alerts_0["sender_name"] = false;
   filter_alerts_0["event"]       = true;
   filter_alerts_0["start"]       = true;
   filter_alerts_0["end"]         = true;
-  filter_alerts_0["description"] = false;
+  filter_alerts_0["description"] = true;
   filter_alerts_0["tags"]        = true;
   JsonObject filter_alerts_1 = filter_alerts.createNestedObject();
   filter_alerts_1["sender_name"] = false;
   filter_alerts_1["event"]       = true;
   filter_alerts_1["start"]       = true;
   filter_alerts_1["end"]         = true;
-  filter_alerts_1["description"] = false;
+  filter_alerts_1["description"] = true;
   filter_alerts_1["tags"]        = true;
   JsonObject filter_alerts_2 = filter_alerts.createNestedObject();
   filter_alerts_2["sender_name"] = false;
   filter_alerts_2["event"]       = true;
   filter_alerts_2["start"]       = true;
   filter_alerts_2["end"]         = true;
-  filter_alerts_2["description"] = false;
+  filter_alerts_2["description"] = true;
   filter_alerts_2["tags"]        = true;
   JsonObject filter_alerts_3 = filter_alerts.createNestedObject();
   filter_alerts_3["sender_name"] = false;
   filter_alerts_3["event"]       = true;
   filter_alerts_3["start"]       = true;
   filter_alerts_3["end"]         = true;
-  filter_alerts_3["description"] = false;
+  filter_alerts_3["description"] = true;
   filter_alerts_3["tags"]        = true;
   JsonObject filter_alerts_4 = filter_alerts.createNestedObject();
   filter_alerts_4["sender_name"] = false;
   filter_alerts_4["event"]       = true;
   filter_alerts_4["start"]       = true;
   filter_alerts_4["end"]         = true;
-  filter_alerts_4["description"] = false;
+  filter_alerts_4["description"] = true;
   filter_alerts_4["tags"]        = true;
   JsonObject filter_alerts_5 = filter_alerts.createNestedObject();
   filter_alerts_5["sender_name"] = false;
   filter_alerts_5["event"]       = true;
   filter_alerts_5["start"]       = true;
   filter_alerts_5["end"]         = true;
-  filter_alerts_5["description"] = false;
+  filter_alerts_5["description"] = true;
   filter_alerts_5["tags"]        = true;
   JsonObject filter_alerts_6 = filter_alerts.createNestedObject();
   filter_alerts_6["sender_name"] = false;
   filter_alerts_6["event"]       = true;
   filter_alerts_6["start"]       = true;
   filter_alerts_6["end"]         = true;
-  filter_alerts_6["description"] = false;
+  filter_alerts_6["description"] = true;
   filter_alerts_6["tags"]        = true;
   JsonObject filter_alerts_7 = filter_alerts.createNestedObject();
   filter_alerts_7["sender_name"] = false;
   filter_alerts_7["event"]       = true;
   filter_alerts_7["start"]       = true;
   filter_alerts_7["end"]         = true;
-  filter_alerts_7["description"] = false;
+  filter_alerts_7["description"] = true;
   filter_alerts_7["tags"]        = true;
 
-  DynamicJsonDocument doc(48 * 1024);
+  parse_mark_t start = parseMark(true);
+  size_t capacity = jsonCapacity(onecallJsonStats, ONECALL_JSON_CAPACITY);
+  ArenaJsonDocument doc(capacity);
+  JsonBodyReader input(json);
+  // Weather descriptions share the key, but are far shorter than the limit.
+  // A character started just below the limit may overshoot it by up to 3
+  // bytes once decoded, leave room for that so setField never drops one.
+  input.truncate("description", OWM_ALERT_DESC_LEN - 3);
+  r.precip_next_hour = {};
+  r.precip_next_hour.first_rain = -1;
+#ifdef ENABLE_MINUTELY_PRECIP
+  // minutely stays filtered out of the document, it is summarized in passing
+  input.tap("minutely", "precipitation", tapMinutelyPrecip,
+            &r.precip_next_hour);
+#endif
 
-  DeserializationError error = deserializeJson(doc, json, 
+  DeserializationError error = deserializeJson(doc, input,
                                          DeserializationOption::Filter(filter));
+  recordJsonStats(onecallJsonStats, doc.memoryUsage(), capacity,
+                  input.count(), start, error);
   if (error) {
     return error;
   }
 
   r.lat             = doc["lat"]            .as<float>();
   r.lon             = doc["lon"]            .as<float>();
-  r.timezone        = doc["timezone"]       .as<const char *>();
+  setField(r.timezone, doc["timezone"]      .as<const char *>());
   r.timezone_offset = doc["timezone_offset"].as<int>();
 
   JsonObject current = doc["current"];
@@ -126,11 +337,11 @@ DeserializationError deserializeOneCall(WiFiClient &json,
   r.current.snow_1h    = current["snow"]["1h"].as<float>();
   JsonObject current_weather = current["weather"][0];
   r.current.weather.id          = current_weather["id"]         .as<int>();
-  r.current.weather.main        = current_weather["main"]       .as<const char *>();
-  r.current.weather.description = current_weather["description"].as<const char *>();
-  r.current.weather.icon        = current_weather["icon"]       .as<const char *>();
+  setField(r.current.weather.main,        current_weather["main"]       .as<const char *>());
+  setField(r.current.weather.description, current_weather["description"].as<const char *>());
+  setField(r.current.weather.icon,        current_weather["icon"]       .as<const char *>());
 
-  // minutely forecast is currently unused
+  // minutely forecast is only summarized, see foldMinutelyPrecip
   // i = 0;
   // for (JsonObject minutely : doc["minutely"].as<JsonArray>()) 
   // {
@@ -164,9 +375,9 @@ DeserializationError deserializeOneCall(WiFiClient &json,
     r.hourly[i].snow_1h    = hourly["snow"]["1h"].as<float>();
     // JsonObject hourly_weather = hourly["weather"][0];
     // r.hourly[i].weather.id          = hourly_weather["id"]         .as<int>();
-    // r.hourly[i].weather.main        = hourly_weather["main"]       .as<const char *>();
-    // r.hourly[i].weather.description = hourly_weather["description"].as<const char *>();
-    // r.hourly[i].weather.icon        = hourly_weather["icon"]       .as<const char *>();
+    // setField(r.hourly[i].weather.main,        hourly_weather["main"]       .as<const char *>());
+    // setField(r.hourly[i].weather.description, hourly_weather["description"].as<const char *>());
+    // setField(r.hourly[i].weather.icon,        hourly_weather["icon"]       .as<const char *>());
 
     if (i == OWM_NUM_HOURLY - 1) 
     {
@@ -210,9 +421,9 @@ DeserializationError deserializeOneCall(WiFiClient &json,
     r.daily[i].snow       = daily["snow"]      .as<float>();
     JsonObject daily_weather = daily["weather"][0];
     r.daily[i].weather.id          = daily_weather["id"]         .as<int>();
-    r.daily[i].weather.main        = daily_weather["main"]       .as<const char *>();
-    r.daily[i].weather.description = daily_weather["description"].as<const char *>();
-    r.daily[i].weather.icon        = daily_weather["icon"]       .as<const char *>();
+    setField(r.daily[i].weather.main,        daily_weather["main"]       .as<const char *>());
+    setField(r.daily[i].weather.description, daily_weather["description"].as<const char *>());
+    setField(r.daily[i].weather.icon,        daily_weather["icon"]       .as<const char *>());
 
     if (i == OWM_NUM_DAILY - 1) 
     {
@@ -222,15 +433,16 @@ DeserializationError deserializeOneCall(WiFiClient &json,
   }
 
   i = 0;
+  r.alerts.clear();
   for (JsonObject alerts : doc["alerts"].as<JsonArray>()) 
   {
     owm_alerts_t new_alert = {};
-    // new_alert.sender_name = alerts["sender_name"].as<const char *>();
-    new_alert.event       = alerts["event"]      .as<const char *>();
-    new_alert.start       = alerts["start"]      .as<int64_t>();
-    new_alert.end         = alerts["end"]        .as<int64_t>();
-    // new_alert.description = alerts["description"].as<const char *>();
-    new_alert.tags        = alerts["tags"][0]    .as<const char *>();
+    // setField(new_alert.sender_name, alerts["sender_name"].as<const char *>());
+    setField(new_alert.event,       alerts["event"]      .as<const char *>());
+    new_alert.start = alerts["start"].as<int64_t>();
+    new_alert.end   = alerts["end"]  .as<int64_t>();
+    setField(new_alert.description, alerts["description"].as<const char *>());
+    setField(new_alert.tags,        alerts["tags"][0]    .as<const char *>());
     r.alerts.push_back(new_alert);
 
     if (i == OWM_NUM_ALERTS - 1) 
@@ -243,14 +455,170 @@ DeserializationError deserializeOneCall(WiFiClient &json,
   return error;
 } // end deserializeOneCall
 
-DeserializationError deserializeAirQuality(WiFiClient& json, 
-                                           owm_resp_air_pollution_t &r) 
+#ifdef JSON_LAZY_INDEX
+/* Deserializes a response from OpenWeatherMap's One Call API through a lazy
+ * index of the body (see JsonIndex) instead of a JsonDocument. Every field
+ * deserializeOneCall reads is read, so that either fills r the same.
+ *
+ * The index keeps the whole body rather than a filtered document, so its
+ * memory is recorded in stats of its own; sizing the capacity of the
+ * document from it would be wrong.
+ */
+DeserializationError deserializeOneCallIndexed(SegmentedStream &json,
+                                               owm_resp_onecall_t &r)
+{
+  parse_mark_t start = parseMark(true);
+  CountingStream counter(json);
+  JsonIndex index;
+
+  DeserializationError error = index.read(counter);
+  recordJsonStats(onecallIndexJsonStats, index.memoryUsage(),
+                  index.memoryUsage(), counter.count(), start, error);
+  if (error) {
+    return error;
+  }
+
+  JsonIndex::Value doc = index.root();
+  // r is too large to zero through a temporary on the stack
+  memset(&r, 0, sizeof(r));
+  r.lat             = doc["lat"]            .asFloat();
+  r.lon             = doc["lon"]            .asFloat();
+  doc["timezone"].copyString(r.timezone, sizeof(r.timezone));
+  r.timezone_offset = doc["timezone_offset"].asInt();
+
+  JsonIndex::Value current = doc["current"];
+  r.current.dt         = current["dt"]        .asInt64();
+  r.current.sunrise    = current["sunrise"]   .asInt64();
+  r.current.sunset     = current["sunset"]    .asInt64();
+  r.current.temp       = current["temp"]      .asFloat();
+  r.current.feels_like = current["feels_like"].asFloat();
+  r.current.pressure   = current["pressure"]  .asInt();
+  r.current.humidity   = current["humidity"]  .asInt();
+  r.current.dew_point  = current["dew_point"] .asFloat();
+  r.current.clouds     = current["clouds"]    .asInt();
+  r.current.uvi        = current["uvi"]       .asFloat();
+  r.current.visibility = current["visibility"].asInt();
+  r.current.wind_speed = current["wind_speed"].asFloat();
+  r.current.wind_gust  = current["wind_gust"] .asFloat();
+  r.current.wind_deg   = current["wind_deg"]  .asInt();
+  r.current.rain_1h    = current["rain"]["1h"].asFloat();
+  r.current.snow_1h    = current["snow"]["1h"].asFloat();
+  JsonIndex::Value current_weather = current["weather"][0];
+  r.current.weather.id = current_weather["id"].asInt();
+  current_weather["main"].copyString(r.current.weather.main,
+                                     sizeof(r.current.weather.main));
+  current_weather["description"].copyString(r.current.weather.description,
+                                 sizeof(r.current.weather.description));
+  current_weather["icon"].copyString(r.current.weather.icon,
+                                     sizeof(r.current.weather.icon));
+
+  r.precip_next_hour = {};
+  r.precip_next_hour.first_rain = -1;
+#ifdef ENABLE_MINUTELY_PRECIP
+  for (JsonIndex::Value minutely = doc["minutely"].first(); !minutely.isNull();
+       minutely = minutely.next())
+  {
+    foldMinutelyPrecip(r.precip_next_hour,
+                       minutely["precipitation"].asFloat());
+  }
+#endif
+
+  int i = 0;
+  for (JsonIndex::Value hourly = doc["hourly"].first();
+       !hourly.isNull() && i < OWM_NUM_HOURLY; hourly = hourly.next(), ++i)
+  {
+    r.hourly[i].dt         = hourly["dt"]        .asInt64();
+    r.hourly[i].temp       = hourly["temp"]      .asFloat();
+    r.hourly[i].feels_like = hourly["feels_like"].asFloat();
+    r.hourly[i].pressure   = hourly["pressure"]  .asInt();
+    r.hourly[i].humidity   = hourly["humidity"]  .asInt();
+    r.hourly[i].dew_point  = hourly["dew_point"] .asFloat();
+    r.hourly[i].clouds     = hourly["clouds"]    .asInt();
+    r.hourly[i].uvi        = hourly["uvi"]       .asFloat();
+    r.hourly[i].visibility = hourly["visibility"].asInt();
+    r.hourly[i].wind_speed = hourly["wind_speed"].asFloat();
+    r.hourly[i].wind_gust  = hourly["wind_gust"] .asFloat();
+    r.hourly[i].wind_deg   = hourly["wind_deg"]  .asInt();
+    r.hourly[i].pop        = hourly["pop"]       .asFloat();
+    r.hourly[i].rain_1h    = hourly["rain"]["1h"].asFloat();
+    r.hourly[i].snow_1h    = hourly["snow"]["1h"].asFloat();
+  }
+
+  i = 0;
+  for (JsonIndex::Value daily = doc["daily"].first();
+       !daily.isNull() && i < OWM_NUM_DAILY; daily = daily.next(), ++i)
+  {
+    r.daily[i].dt         = daily["dt"]        .asInt64();
+    r.daily[i].sunrise    = daily["sunrise"]   .asInt64();
+    r.daily[i].sunset     = daily["sunset"]    .asInt64();
+    r.daily[i].moonrise   = daily["moonrise"]  .asInt64();
+    r.daily[i].moonset    = daily["moonset"]   .asInt64();
+    r.daily[i].moon_phase = daily["moon_phase"].asFloat();
+    JsonIndex::Value daily_temp = daily["temp"];
+    r.daily[i].temp.morn  = daily_temp["morn"] .asFloat();
+    r.daily[i].temp.day   = daily_temp["day"]  .asFloat();
+    r.daily[i].temp.eve   = daily_temp["eve"]  .asFloat();
+    r.daily[i].temp.night = daily_temp["night"].asFloat();
+    r.daily[i].temp.min   = daily_temp["min"]  .asFloat();
+    r.daily[i].temp.max   = daily_temp["max"]  .asFloat();
+    JsonIndex::Value daily_feels_like = daily["feels_like"];
+    r.daily[i].feels_like.morn  = daily_feels_like["morn"] .asFloat();
+    r.daily[i].feels_like.day   = daily_feels_like["day"]  .asFloat();
+    r.daily[i].feels_like.eve   = daily_feels_like["eve"]  .asFloat();
+    r.daily[i].feels_like.night = daily_feels_like["night"].asFloat();
+    r.daily[i].pressure   = daily["pressure"]  .asInt();
+    r.daily[i].humidity   = daily["humidity"]  .asInt();
+    r.daily[i].dew_point  = daily["dew_point"] .asFloat();
+    r.daily[i].clouds     = daily["clouds"]    .asInt();
+    r.daily[i].uvi        = daily["uvi"]       .asFloat();
+    r.daily[i].visibility = daily["visibility"].asInt();
+    r.daily[i].wind_speed = daily["wind_speed"].asFloat();
+    r.daily[i].wind_gust  = daily["wind_gust"] .asFloat();
+    r.daily[i].wind_deg   = daily["wind_deg"]  .asInt();
+    r.daily[i].pop        = daily["pop"]       .asFloat();
+    r.daily[i].rain       = daily["rain"]      .asFloat();
+    r.daily[i].snow       = daily["snow"]      .asFloat();
+    JsonIndex::Value daily_weather = daily["weather"][0];
+    r.daily[i].weather.id = daily_weather["id"].asInt();
+    daily_weather["main"].copyString(r.daily[i].weather.main,
+                                     sizeof(r.daily[i].weather.main));
+    daily_weather["description"].copyString(r.daily[i].weather.description,
+                                 sizeof(r.daily[i].weather.description));
+    daily_weather["icon"].copyString(r.daily[i].weather.icon,
+                                     sizeof(r.daily[i].weather.icon));
+  }
+
+  for (JsonIndex::Value alerts = doc["alerts"].first();
+       !alerts.isNull() && !r.alerts.full(); alerts = alerts.next())
+  {
+    owm_alerts_t new_alert = {};
+    alerts["event"].copyString(new_alert.event, sizeof(new_alert.event));
+    new_alert.start = alerts["start"].asInt64();
+    new_alert.end   = alerts["end"]  .asInt64();
+    alerts["description"].copyString(new_alert.description,
+                                     sizeof(new_alert.description));
+    alerts["tags"][0].copyString(new_alert.tags, sizeof(new_alert.tags));
+    r.alerts.push_back(new_alert);
+  }
+
+  return error;
+} // end deserializeOneCallIndexed
+#endif
+
+DeserializationError deserializeAirQuality(SegmentedStream &json,
+                                           owm_resp_air_pollution_t &r)
 {
   int i = 0;
 
-  DynamicJsonDocument doc(8 * 1024);
+  parse_mark_t start = parseMark(true);
+  size_t capacity = jsonCapacity(airPollutionJsonStats,
+                                 AIR_POLLUTION_JSON_CAPACITY);
+  ArenaJsonDocument doc(capacity);
+  JsonBodyReader input(json);
 
-  DeserializationError error = deserializeJson(doc, json);
+  DeserializationError error = deserializeJson(doc, input);
+  recordJsonStats(airPollutionJsonStats, doc.memoryUsage(), capacity,
+                  input.count(), start, error);
   if (error) {
     return error;
   }
@@ -284,3 +652,256 @@ DeserializationError deserializeAirQuality(WiFiClient& json,
 
   return error;
 } // end deserializeAirQuality
+
+/* Returns the OpenWeatherMap condition id closest to a WMO weather
+ * interpretation code, as used by Open-Meteo. The renderer chooses icons by
+ * OpenWeatherMap id.
+ *
+ * https://open-meteo.com/en/docs#weathervariables
+ * https://openweathermap.org/weather-conditions
+ */
+static int wmoToOwmId(int code)
+{
+  switch (code)
+  {
+  case 0:  return 800; // Clear sky
+  case 1:  return 801; // Mainly clear
+  case 2:  return 802; // Partly cloudy
+  case 3:  return 804; // Overcast
+  case 45: return 741; // Fog
+  case 48: return 741; // Depositing rime fog
+  case 51: return 300; // Drizzle: light
+  case 53: return 301; // Drizzle: moderate
+  case 55: return 302; // Drizzle: dense
+  case 56: return 511; // Freezing drizzle: light
+  case 57: return 511; // Freezing drizzle: dense
+  case 61: return 500; // Rain: slight
+  case 63: return 501; // Rain: moderate
+  case 65: return 502; // Rain: heavy
+  case 66: return 511; // Freezing rain: light
+  case 67: return 511; // Freezing rain: heavy
+  case 71: return 600; // Snow fall: slight
+  case 73: return 601; // Snow fall: moderate
+  case 75: return 602; // Snow fall: heavy
+  case 77: return 600; // Snow grains
+  case 80: return 520; // Rain showers: slight
+  case 81: return 521; // Rain showers: moderate
+  case 82: return 522; // Rain showers: violent
+  case 85: return 620; // Snow showers: slight
+  case 86: return 622; // Snow showers: heavy
+  case 95: return 211; // Thunderstorm: slight or moderate
+  case 96: return 201; // Thunderstorm with slight hail
+  case 99: return 202; // Thunderstorm with heavy hail
+  default: return 0;
+  }
+} // end wmoToOwmId
+
+/* Deserializes a response from Open-Meteo's Forecast API into the structure
+ * used for OpenWeatherMap's One Call API.
+ *
+ * The response is column oriented, one array per variable. Only the variables
+ * that are drawn are requested (see getOpenMeteoForecast), everything else is
+ * left zeroed, as are the hourly and daily forecasts past the end of the
+ * requested window. Units are Celsius, m/s, mm and cm for snowfall.
+ */
+DeserializationError deserializeOpenMeteoForecast(SegmentedStream &json,
+                                                  owm_resp_onecall_t &r)
+{
+  StaticJsonDocument<128> filter;
+  filter["latitude"]           = true;
+  filter["longitude"]          = true;
+  filter["timezone"]           = true;
+  filter["utc_offset_seconds"] = true;
+  filter["current"]            = true;
+  filter["hourly"]             = true;
+  filter["daily"]              = true;
+
+  parse_mark_t start = parseMark(true);
+  size_t capacity = jsonCapacity(onecallJsonStats, OPEN_METEO_JSON_CAPACITY);
+  ArenaJsonDocument doc(capacity);
+  JsonBodyReader input(json);
+
+  DeserializationError error = deserializeJson(doc, input,
+                                         DeserializationOption::Filter(filter));
+  recordJsonStats(onecallJsonStats, doc.memoryUsage(), capacity,
+                  input.count(), start, error);
+  if (error) {
+    return error;
+  }
+
+  r.lat             = doc["latitude"]          .as<float>();
+  r.lon             = doc["longitude"]         .as<float>();
+  setField(r.timezone, doc["timezone"]         .as<const char *>());
+  r.timezone_offset = doc["utc_offset_seconds"].as<int>();
+
+  JsonObject daily = doc["daily"];
+  JsonArray daily_time = daily["time"];
+  int numDaily = std::min<int>(daily_time.size(), OWM_NUM_DAILY);
+  std::fill(std::begin(r.daily), std::end(r.daily), owm_daily_t{});
+  for (int i = 0; i < numDaily; ++i)
+  {
+    r.daily[i].dt         = daily_time[i]                     .as<int64_t>();
+    r.daily[i].sunrise    = daily["sunrise"][i]               .as<int64_t>();
+    r.daily[i].sunset     = daily["sunset"][i]                .as<int64_t>();
+    r.daily[i].temp.min   = Quantity<Celsius>(
+                            daily["temperature_2m_min"][i]    .as<float>());
+    r.daily[i].temp.max   = Quantity<Celsius>(
+                            daily["temperature_2m_max"][i]    .as<float>());
+    r.daily[i].clouds     = daily["cloud_cover_mean"][i]      .as<int>();
+    r.daily[i].uvi        = daily["uv_index_max"][i]          .as<float>();
+    r.daily[i].wind_speed = daily["wind_speed_10m_max"][i]    .as<float>();
+    r.daily[i].wind_gust  = daily["wind_gusts_10m_max"][i]    .as<float>();
+    r.daily[i].pop        = daily["precipitation_probability_max"][i]
+                                                              .as<float>() / 100;
+    r.daily[i].rain       = daily["rain_sum"][i]              .as<float>();
+    r.daily[i].snow       = daily["snowfall_sum"][i]          .as<float>() * 10;
+    r.daily[i].weather.id = wmoToOwmId(daily["weather_code"][i].as<int>());
+    setField(r.daily[i].weather.icon, "01d");
+  }
+
+  JsonObject current = doc["current"];
+  // precipitation is summed over the interval preceding the current time
+  float perHour = 3600.f / std::max(current["interval"].as<int>(), 1);
+  r.current.dt         = current["time"]                .as<int64_t>();
+  r.current.sunrise    = r.daily[0].sunrise;
+  r.current.sunset     = r.daily[0].sunset;
+  r.current.temp       = Quantity<Celsius>(
+                         current["temperature_2m"]      .as<float>());
+  r.current.feels_like = Quantity<Celsius>(
+                         current["apparent_temperature"].as<float>());
+  r.current.pressure   = current["pressure_msl"]        .as<int>();
+  r.current.humidity   = current["relative_humidity_2m"].as<int>();
+  r.current.dew_point  = Quantity<Celsius>(
+                         current["dew_point_2m"]        .as<float>())
+                         .in<Kelvin>();
+  r.current.clouds     = current["cloud_cover"]         .as<int>();
+  r.current.uvi        = current["uv_index"]            .as<float>();
+  r.current.visibility = current["visibility"]          .as<float>();
+  r.current.wind_speed = current["wind_speed_10m"]      .as<float>();
+  r.current.wind_gust  = current["wind_gusts_10m"]      .as<float>();
+  r.current.wind_deg   = current["wind_direction_10m"]  .as<int>();
+  r.current.rain_1h    = current["rain"]                .as<float>() * perHour;
+  r.current.snow_1h    = current["snowfall"]            .as<float>() * perHour
+                                                                     * 10;
+  r.current.weather.id = wmoToOwmId(current["weather_code"].as<int>());
+  setField(r.current.weather.icon,
+           current["is_day"].as<int>() ? "01d" : "01n");
+
+  JsonObject hourly = doc["hourly"];
+  JsonArray hourly_time = hourly["time"];
+  int numHourly = std::min<int>(hourly_time.size(), OWM_NUM_HOURLY);
+  std::fill(std::begin(r.hourly), std::end(r.hourly), owm_hourly_t{});
+  for (int i = 0; i < numHourly; ++i)
+  {
+    r.hourly[i].dt      = hourly_time[i]                       .as<int64_t>();
+    r.hourly[i].temp    = Quantity<Celsius>(
+                          hourly["temperature_2m"][i]          .as<float>());
+    r.hourly[i].pop     = hourly["precipitation_probability"][i].as<float>()
+                                                                       / 100;
+    r.hourly[i].rain_1h = hourly["rain"][i]                    .as<float>();
+    r.hourly[i].snow_1h = hourly["snowfall"][i]                .as<float>() * 10;
+  }
+
+  r.precip_next_hour = {};
+  r.precip_next_hour.first_rain = -1;
+  r.alerts.clear();
+
+  return error;
+} // end deserializeOpenMeteoForecast
+
+/* Deserializes a response from Open-Meteo's Air Quality API into the
+ * structure used for OpenWeatherMap's Air Pollution API. Concentrations are
+ * in μg/m³ for both.
+ */
+DeserializationError deserializeOpenMeteoAirQuality(SegmentedStream &json,
+                                                  owm_resp_air_pollution_t &r)
+{
+  parse_mark_t start = parseMark(true);
+  size_t capacity = jsonCapacity(airPollutionJsonStats,
+                                 AIR_POLLUTION_JSON_CAPACITY);
+  ArenaJsonDocument doc(capacity);
+  JsonBodyReader input(json);
+
+  DeserializationError error = deserializeJson(doc, input);
+  recordJsonStats(airPollutionJsonStats, doc.memoryUsage(), capacity,
+                  input.count(), start, error);
+  if (error) {
+    return error;
+  }
+
+  r = {};
+  r.coord.lat = doc["latitude"] .as<float>();
+  r.coord.lon = doc["longitude"].as<float>();
+
+  // the last sample is the current hour, as for OpenWeatherMap
+  JsonObject hourly = doc["hourly"];
+  JsonArray hourly_time = hourly["time"];
+  int n = std::min<int>(hourly_time.size(), OWM_NUM_AIR_POLLUTION);
+  int first = hourly_time.size() - n;
+  for (int j = 0; j < n; ++j)
+  {
+    int i = OWM_NUM_AIR_POLLUTION - n + j;
+    r.dt[i]               = hourly_time[first + j]                .as<int64_t>();
+    r.components.co[i]    = hourly["carbon_monoxide"][first + j]  .as<float>();
+    r.components.no2[i]   = hourly["nitrogen_dioxide"][first + j] .as<float>();
+    r.components.o3[i]    = hourly["ozone"][first + j]            .as<float>();
+    r.components.so2[i]   = hourly["sulphur_dioxide"][first + j]  .as<float>();
+    r.components.pm2_5[i] = hourly["pm2_5"][first + j]            .as<float>();
+    r.components.pm10[i]  = hourly["pm10"][first + j]             .as<float>();
+    r.components.nh3[i]   = hourly["ammonia"][first + j]          .as<float>();
+  }
+
+  return error;
+} // end deserializeOpenMeteoAirQuality
+
+#ifdef WEATHER_PROVIDER_OWM_PROXY
+/* Decodes a response of the API proxy (see api_codec.h) into r. Nothing is
+ * buffered, fields are read off the stream straight into r. The statistics of
+ * the JSON deserializers are kept too, for comparison.
+ */
+template<typename T>
+static DeserializationError decodeProxyResponse(Stream &body, uint32_t magic,
+                                                json_stats_t &stats, T &r)
+{
+  parse_mark_t start = parseMark(true);
+  ApiDecoder<Stream> decoder(body);
+  api_codec_header_t header = {};
+  decoder.raw(&header, sizeof(header));
+
+  DeserializationError error;
+  if (!decoder.ok())
+  {
+    error = DeserializationError::EmptyInput;
+  }
+  else if (header.magic != magic || header.version != API_CODEC_VERSION)
+  {
+    Serial.printf("Unexpected proxy response %08x version %u\n",
+                  static_cast<unsigned>(header.magic), header.version);
+    error = DeserializationError::InvalidInput;
+  }
+  else
+  {
+    transcode(decoder, r);
+    if (!decoder.ok())
+    {
+      error = DeserializationError::IncompleteInput;
+    }
+  }
+  recordJsonStats(stats, 0, 0, decoder.bytesRead(), start, error);
+  return error;
+} // end decodeProxyResponse
+
+DeserializationError deserializeOneCallProxy(SegmentedStream &body,
+                                             owm_resp_onecall_t &r)
+{
+  return decodeProxyResponse(body, API_CODEC_MAGIC_ONECALL, onecallJsonStats,
+                             r);
+} // end deserializeOneCallProxy
+
+DeserializationError deserializeAirQualityProxy(SegmentedStream &body,
+                                                owm_resp_air_pollution_t &r)
+{
+  return decodeProxyResponse(body, API_CODEC_MAGIC_AIR_POLLUTION,
+                             airPollutionJsonStats, r);
+} // end deserializeAirQualityProxy
+#endif
@@ -0,0 +1,261 @@
+/* Per-wake arena allocator for esp32-weather-epd.
+ * Copyright (C) 2023  Luke Marzen
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+#include "arena.h"
+
+Arena wakeArena(WAKE_ARENA_SIZE);
+
+// every allocation is preceded by a header holding its (aligned) size and the
+// generation of the arena it was made in
+struct block_t
+{
+  size_t   size;
+  uint32_t generation;
+};
+
+static const size_t ALIGNMENT = alignof(std::max_align_t);
+
+static inline size_t alignUp(size_t n)
+{
+  return (n + ALIGNMENT - 1) & ~(ALIGNMENT - 1);
+}
+
+static const size_t HEADER = alignUp(sizeof(block_t));
+
+Arena::Arena(size_t capacity)
+  : _base(nullptr), _capacity(capacity), _top(0), _peak(0), _live(0),
+    _allocations(0), _fallbackAllocations(0), _generation(0),
+    _fallbacks(nullptr)
+{
+} // end Arena::Arena
+
+Arena::~Arena()
+{
+  release();
+} // end Arena::~Arena
+
+/* Returns true if ptr lies in the block, as opposed to the heap fallback.
+ */
+bool Arena::owns(const void *ptr) const
+{
+  const uint8_t *p = static_cast<const uint8_t *>(ptr);
+  return _base != nullptr && p >= _base && p < _base + _capacity;
+} // end Arena::owns
+
+/* Returns the header of ptr if it is a live heap fallback, nullptr if it was
+ * already released by reset(). Fallbacks are rare, the list is short.
+ */
+Arena::fallback_t *Arena::findFallback(const void *ptr) const
+{
+  for (fallback_t *f = _fallbacks; f != nullptr; f = f->next)
+  {
+    if (reinterpret_cast<const uint8_t *>(f) + alignUp(sizeof(fallback_t))
+        == ptr)
+    {
+      return f;
+    }
+  }
+  return nullptr;
+} // end Arena::findFallback
+
+/* Allocates size bytes from the heap, linked into the list of fallbacks so
+ * that reset() can free them.
+ */
+void *Arena::allocateFallback(size_t size)
+{
+  ++_fallbackAllocations;
+  fallback_t *f = static_cast<fallback_t *>(
+                    malloc(alignUp(sizeof(fallback_t)) + size));
+  if (f == nullptr)
+  {
+    return nullptr;
+  }
+  linkFallback(f);
+  ++_live;
+  return reinterpret_cast<uint8_t *>(f) + alignUp(sizeof(fallback_t));
+} // end Arena::allocateFallback
+
+void Arena::linkFallback(fallback_t *f)
+{
+  f->prev = nullptr;
+  f->next = _fallbacks;
+  if (_fallbacks != nullptr)
+  {
+    _fallbacks->prev = f;
+  }
+  _fallbacks = f;
+} // end Arena::linkFallback
+
+void Arena::unlinkFallback(fallback_t *f)
+{
+  if (f->prev != nullptr)
+  {
+    f->prev->next = f->next;
+  }
+  else
+  {
+    _fallbacks = f->next;
+  }
+  if (f->next != nullptr)
+  {
+    f->next->prev = f->prev;
+  }
+} // end Arena::unlinkFallback
+
+/* Frees the block and every heap fallback.
+ */
+void Arena::release()
+{
+  while (_fallbacks != nullptr)
+  {
+    fallback_t *next = _fallbacks->next;
+    free(_fallbacks);
+    _fallbacks = next;
+  }
+  free(_base);
+  _base = nullptr;
+} // end Arena::release
+
+/* Allocates size bytes from the arena. Falls back to the heap if the arena is
+ * exhausted.
+ */
+void *Arena::allocate(size_t size)
+{
+  std::lock_guard<std::recursive_mutex> lock(_mutex);
+  if (_base == nullptr)
+  {
+    _base = static_cast<uint8_t *>(malloc(_capacity));
+  }
+
+  ++_allocations;
+  size_t need = HEADER + alignUp(size);
+  if (_base == nullptr || _top + need > _capacity)
+  {
+    return allocateFallback(size);
+  }
+
+  uint8_t *block = _base + _top;
+  *reinterpret_cast<block_t *>(block) = {alignUp(size), _generation};
+  _top += need;
+  _peak = std::max(_peak, _top);
+  ++_live;
+  return block + HEADER;
+} // end Arena::allocate
+
+/* Frees an allocation. Memory is only returned to the arena if ptr is the most
+ * recent allocation. Allocations released by reset() are ignored.
+ */
+void Arena::deallocate(void *ptr)
+{
+  std::lock_guard<std::recursive_mutex> lock(_mutex);
+  if (ptr == nullptr)
+  {
+    return;
+  }
+  if (!owns(ptr))
+  {
+    fallback_t *f = findFallback(ptr);
+    if (f != nullptr)
+    {
+      unlinkFallback(f);
+      free(f);
+      --_live;
+    }
+    return;
+  }
+
+  uint8_t *p = static_cast<uint8_t *>(ptr);
+  if (p < _base + HEADER || p > _base + _top)
+  {
+    return;
+  }
+  uint8_t *block = p - HEADER;
+  const block_t &header = *reinterpret_cast<block_t *>(block);
+  if (header.generation != _generation || _live == 0)
+  { // made before the last reset, in a block since released
+    return;
+  }
+  --_live;
+  if (p + header.size == _base + _top)
+  {
+    _top = block - _base;
+  }
+} // end Arena::deallocate
+
+/* Resizes an allocation, in place if it is the most recent allocation.
+ */
+void *Arena::reallocate(void *ptr, size_t size)
+{
+  std::lock_guard<std::recursive_mutex> lock(_mutex);
+  if (ptr == nullptr)
+  {
+    return allocate(size);
+  }
+  if (!owns(ptr))
+  {
+    fallback_t *f = findFallback(ptr);
+    if (f == nullptr)
+    { // released by reset(), there is nothing left to copy
+      return allocate(size);
+    }
+    unlinkFallback(f);
+    fallback_t *g = static_cast<fallback_t *>(
+                      realloc(f, alignUp(sizeof(fallback_t)) + size));
+    // on failure the old allocation is still valid, relink it
+    linkFallback(g != nullptr ? g : f);
+    if (g == nullptr)
+    {
+      return nullptr;
+    }
+    return reinterpret_cast<uint8_t *>(g) + alignUp(sizeof(fallback_t));
+  }
+
+  uint8_t *block = static_cast<uint8_t *>(ptr) - HEADER;
+  block_t &header = *reinterpret_cast<block_t *>(block);
+  size_t oldSize = header.size;
+  if (static_cast<uint8_t *>(ptr) + oldSize == _base + _top
+      && (block - _base) + HEADER + alignUp(size) <= _capacity)
+  {
+    header.size = alignUp(size);
+    _top = (block - _base) + HEADER + alignUp(size);
+    _peak = std::max(_peak, _top);
+    return ptr;
+  }
+
+  void *newPtr = allocate(size);
+  if (newPtr != nullptr)
+  {
+    memcpy(newPtr, ptr, std::min(oldSize, size));
+    deallocate(ptr);
+  }
+  return newPtr;
+} // end Arena::reallocate
+
+size_t Arena::reset()
+{
+  std::lock_guard<std::recursive_mutex> lock(_mutex);
+  size_t escaped = _live;
+  release();
+  _top = 0;
+  _live = 0;
+  ++_generation;
+  return escaped;
+} // end Arena::reset
@@ -0,0 +1,72 @@
+/* Work run in a task of its own for esp32-weather-epd.
+ * Copyright (C) 2023  Luke Marzen
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "async_task.h"
+
+AsyncTask::AsyncTask(work_t work, void *arg)
+  : _work(work), _arg(arg), _result(0), _pending(false)
+{
+  _done = xSemaphoreCreateBinaryStatic(&_doneBuffer);
+} // end AsyncTask::AsyncTask
+
+AsyncTask::~AsyncTask()
+{
+  if (_pending)
+  { // the task still refers to this one
+    await();
+  }
+  vSemaphoreDelete(_done);
+} // end AsyncTask::~AsyncTask
+
+/* Starts the work in a task of its own, at the priority of the caller.
+ *
+ * Returns false if the task could not be created, await then does the work.
+ */
+bool AsyncTask::start(const char *name, uint32_t stackSize)
+{
+  _pending = xTaskCreate(run, name, stackSize, this, uxTaskPriorityGet(NULL),
+                         NULL) == pdPASS;
+  return _pending;
+} // end AsyncTask::start
+
+/* Blocks until the work is done.
+ *
+ * Returns the result of the work.
+ */
+int AsyncTask::await()
+{
+  if (_pending)
+  {
+    xSemaphoreTake(_done, portMAX_DELAY);
+    _pending = false;
+  }
+  else
+  {
+    _result = _work(_arg);
+  }
+  return _result;
+} // end AsyncTask::await
+
+/* Task body, does the work then signals await.
+ */
+void AsyncTask::run(void *self)
+{
+  AsyncTask &task = *static_cast<AsyncTask *>(self);
+  task._result = task._work(task._arg);
+  xSemaphoreGive(task._done);
+  vTaskDelete(NULL);
+} // end AsyncTask::run
@@ -16,7 +16,9 @@
  */
 
 // built-in C++ libraries
+#include <algorithm>
 #include <cstring>
+#include <mutex>
 #include <vector>
 
 // arduino/esp32 libraries
@@ -25,6 +27,13 @@
 #include <SPI.h>
 #include <time.h>
 #include <WiFi.h>
+#include <esp_heap_caps.h>
+#include <esp_netif.h>
+#include <esp_netif_net_stack.h>
+#include <esp_sntp.h>
+#include <esp_timer.h>
+#include <freertos/event_groups.h>
+#include <lwip/dhcp.h>
 
 // additional libraries
 #include <Adafruit_BusIO_Register.h>
@@ -38,51 +47,312 @@
 #include "client_utils.h"
 #include "config.h"
 #include "display_utils.h"
+#include "fetch_plan.h"
+#include "memo.h"
+#include "quantities.h"
 #include "renderer.h"
+#include "retry.h"
+#include "rtc_clock.h"
+#include "stream_utils.h"
 
-/* Power-on and connect wifi.
- * Takes int parameter to store wifi RSSI, or “Received Signal Strength 
- * Indicator"
+// Delay before the second attempt at a request, doubled for the third, ms.
+#define REQUEST_RETRY_DELAY 500
+
+// Time allowed for the render server to respond, ms. It fetches the weather
+// before it renders, allowing each request 10 s.
+#define RENDER_SERVER_TIMEOUT 25000
+
+// Number of days requested from Open-Meteo, as many as drawForecast draws.
+#define OPEN_METEO_NUM_DAILY 5
+
+// Time allowed for wifi to connect, ms.
+#define WIFI_TIMEOUT 10000
+// Time allowed for a directed connect before falling back to a scan, ms.
+#define WIFI_DIRECTED_TIMEOUT 3000
+// Added to it when the directed connect asks for a new DHCP lease, ms.
+#define WIFI_DHCP_TIMEOUT 2000
+// Wakes the address of a DHCP lease is reused for, however long the lease.
+#define WIFI_LEASE_MAX_WAKES 48
+#define WIFI_GOT_IP_BIT BIT0
+
+static StaticEventGroup_t wifiEventsBuffer;
+static EventGroupHandle_t wifiEvents   = NULL;
+static wifi_event_id_t    wifiEventId  = 0;
+static unsigned long      wifiStart    = 0;
+static unsigned long      wifiDeadline = 0;
+
+#ifdef WIFI_FAST_CONNECT
+/* Connection made by the last wake that connected. The next wake connects to
+ * the same access point, on the same channel, which skips the channel scan,
+ * and with the same address while the lease it came from is fresh, which
+ * skips DHCP.
+ */
+struct wifi_cache_t
+{
+  bool     valid;
+  uint8_t  bssid[6];
+  int32_t  channel;
+  uint32_t ip;
+  uint32_t gateway;
+  uint32_t subnet;
+  uint32_t dns;
+  int64_t  leaseStart; // when the address was leased, s since the epoch
+  uint32_t leaseTime;  // length of the lease, s, 0 if unknown
+  uint16_t leaseWakes; // wakes that have reused the address since
+};
+
+/* Address a host name last resolved to, so that the next wake can connect
+ * without a DNS lookup.
+ */
+struct dns_cache_entry_t
+{
+  uint32_t host; // FNV-1a hash of the host name
+  uint32_t ip;   // 0 if unused
+};
+
+// Number of host names cached, as many as a provider makes requests to.
+#define DNS_CACHE_SIZE 2
+
+RTC_DATA_ATTR static wifi_cache_t      wifiCache                = {};
+RTC_DATA_ATTR static dns_cache_entry_t dnsCache[DNS_CACHE_SIZE] = {};
+RTC_DATA_ATTR static uint8_t           dnsCacheNext             = 0;
+// requests of concurrent sessions look up and store hosts at the same time
+static std::mutex dnsCacheMutex;
+static bool       wifiDirected = false; // connecting with wifiCache
+static bool       wifiLeased   = false; // with the address of wifiCache
+
+/* Whether the address of the cached lease can be reused without asking the
+ * router. It is given up at half the lease time, when a DHCP client would
+ * renew it, or after WIFI_LEASE_MAX_WAKES wakes, whichever comes first. A
+ * clock that went backwards, or was set by NTP since, also gives it up.
+ */
+static bool leaseFresh()
+{
+  if (wifiCache.leaseWakes >= WIFI_LEASE_MAX_WAKES)
+  {
+    return false;
+  }
+  if (wifiCache.leaseTime == 0)
+  {
+    return true;
+  }
+  int64_t elapsed = clockNow() / 1000000LL - wifiCache.leaseStart;
+  return elapsed >= 0 && elapsed < wifiCache.leaseTime / 2;
+} // end leaseFresh
+
+/* Returns the lease time the DHCP server offered for the current address, s,
+ * or 0 if it is not known.
+ */
+static uint32_t dhcpLeaseTime()
+{
+  esp_netif_t *sta = esp_netif_get_handle_from_ifkey("WIFI_STA_DEF");
+  if (sta == NULL)
+  {
+    return 0;
+  }
+  netif *lwip = static_cast<netif *>(esp_netif_get_netif_impl(sta));
+  dhcp *lease = lwip == NULL ? NULL : netif_dhcp_data(lwip);
+  return lease == NULL ? 0 : lease->offered_t0_lease;
+} // end dhcpLeaseTime
+
+/* Returns the cache entry of a host, or NULL if it is not cached.
+ */
+static dns_cache_entry_t *findHost(uint32_t hash)
+{
+  for (dns_cache_entry_t &e : dnsCache)
+  {
+    if (e.ip != 0 && e.host == hash)
+    {
+      return &e;
+    }
+  }
+  return NULL;
+} // end findHost
+
+/* Looks up the address a host was last connected at.
  *
- * Returns wifi status.
+ * Returns true if the host is cached.
  */
-wl_status_t startWiFi(int &wifiRSSI)
+static bool lookupHost(const String &host, IPAddress &ip)
 {
-  WiFi.mode(WIFI_STA);
-  Serial.printf("Connecting to '%s'", WIFI_SSID);
-  WiFi.begin(WIFI_SSID, WIFI_PASSWORD);
+  std::lock_guard<std::mutex> lock(dnsCacheMutex);
+  dns_cache_entry_t *e = findHost(fnv1a(host.c_str(), host.length()));
+  if (e == NULL)
+  {
+    return false;
+  }
+  ip = e->ip;
+  return true;
+} // end lookupHost
 
-  // timeout if wifi does not connect in 10s from now
-  unsigned long timeout = millis() + 10000;
-  wl_status_t connection_status = WiFi.status();
+/* Caches the address of a host, replacing the oldest entry if the host is not
+ * already cached. An address of 0 forgets the host.
+ */
+static void storeHost(const String &host, uint32_t ip)
+{
+  std::lock_guard<std::mutex> lock(dnsCacheMutex);
+  uint32_t hash = fnv1a(host.c_str(), host.length());
+  dns_cache_entry_t *e = findHost(hash);
+  if (e == NULL)
+  {
+    if (ip == 0)
+    {
+      return;
+    }
+    e = &dnsCache[dnsCacheNext];
+    dnsCacheNext = (dnsCacheNext + 1) % DNS_CACHE_SIZE;
+  }
+  *e = {hash, ip};
+  return;
+} // end storeHost
+#endif
 
-  while ((connection_status != WL_CONNECTED) && (millis() < timeout))
+/* Called from the wifi event task once an IP address has been obtained.
+ */
+static void onWiFiGotIP(arduino_event_id_t event)
+{
+  xEventGroupSetBits(wifiEvents, WIFI_GOT_IP_BIT);
+} // end onWiFiGotIP
+
+/* Starts connecting, to the cached access point if directed, otherwise after a
+ * scan. The cached address is reused if its lease is still fresh, otherwise
+ * the address comes from DHCP.
+ */
+static void connectWiFi(bool directed)
+{
+  xEventGroupClearBits(wifiEvents, WIFI_GOT_IP_BIT);
+  unsigned long timeout = WIFI_TIMEOUT;
+#ifdef WIFI_FAST_CONNECT
+  wifiDirected = directed;
+  wifiLeased   = directed && leaseFresh();
+  if (wifiLeased)
   {
-    Serial.print(".");
-    delay(50);
-    connection_status = WiFi.status();
+    WiFi.config(IPAddress(wifiCache.ip), IPAddress(wifiCache.gateway),
+                IPAddress(wifiCache.subnet), IPAddress(wifiCache.dns));
   }
+  else
+  {
+    // back to DHCP
+    WiFi.config(INADDR_NONE, INADDR_NONE, INADDR_NONE);
+  }
+  if (directed)
+  {
+    Serial.printf("Connecting to '%s' on channel %d", WIFI_SSID,
+                  wifiCache.channel);
+    WiFi.begin(WIFI_SSID, WIFI_PASSWORD, wifiCache.channel, wifiCache.bssid);
+    timeout = WIFI_DIRECTED_TIMEOUT + (wifiLeased ? 0 : WIFI_DHCP_TIMEOUT);
+  }
+  else
+  {
+#endif
+    Serial.printf("Connecting to '%s'", WIFI_SSID);
+    WiFi.begin(WIFI_SSID, WIFI_PASSWORD);
+#ifdef WIFI_FAST_CONNECT
+  }
+#endif
   Serial.println();
+  wifiDeadline = millis() + timeout;
+} // end connectWiFi
+
+/* Blocks until the connection is up or has timed out. The task sleeps until
+ * the wifi driver signals that an IP address was obtained, rather than
+ * polling the status.
+ */
+static wl_status_t waitWiFi()
+{
+  long remaining = static_cast<long>(wifiDeadline - millis());
+  TickType_t ticks = remaining > 0 ? pdMS_TO_TICKS(remaining) : 0;
+  xEventGroupWaitBits(wifiEvents, WIFI_GOT_IP_BIT, pdFALSE, pdTRUE, ticks);
+  return WiFi.status();
+} // end waitWiFi
+
+/* Power-on wifi and start connecting, without waiting for the connection.
+ * The caller is free to do other work until it calls awaitWiFi.
+ */
+void beginWiFi()
+{
+  if (wifiEvents == NULL)
+  {
+    wifiEvents = xEventGroupCreateStatic(&wifiEventsBuffer);
+  }
+  wifiEventId = WiFi.onEvent(onWiFiGotIP, ARDUINO_EVENT_WIFI_STA_GOT_IP);
+
+  wifiStart = millis();
+  WiFi.mode(WIFI_STA);
+#ifdef WIFI_FAST_CONNECT
+  connectWiFi(wifiCache.valid);
+#else
+  connectWiFi(false);
+#endif
+} // end beginWiFi
+
+/* Blocks until the connection started by beginWiFi is up or has timed out.
+ * Takes int parameter to store wifi RSSI, or “Received Signal Strength 
+ * Indicator"
+ *
+ * Returns wifi status.
+ */
+wl_status_t awaitWiFi(int &wifiRSSI)
+{
+  wl_status_t connection_status = waitWiFi();
+#ifdef WIFI_FAST_CONNECT
+  if (connection_status != WL_CONNECTED && wifiDirected)
+  { // the access point, channel or address changed
+    Serial.println("Directed connect failed, scanning");
+    wifiCache.valid = false;
+    WiFi.disconnect();
+    connectWiFi(false);
+    connection_status = waitWiFi();
+  }
+#endif
+  WiFi.removeEvent(wifiEventId);
 
   if (connection_status == WL_CONNECTED)
   {
     wifiRSSI = WiFi.RSSI(); // get Wifi signal strength now, because the WiFi
                             // will be turned off to save power!
     Serial.println("IP: " + WiFi.localIP().toString());
+#ifdef WIFI_FAST_CONNECT
+    Serial.printf("WiFi: connected in %lu ms (%s, %s)\n",
+                  millis() - wifiStart, wifiDirected ? "directed" : "scan",
+                  wifiLeased ? "cached lease" : "DHCP");
+    wifiCache.valid   = true;
+    memcpy(wifiCache.bssid, WiFi.BSSID(), sizeof(wifiCache.bssid));
+    wifiCache.channel = WiFi.channel();
+    if (wifiLeased)
+    {
+      ++wifiCache.leaseWakes;
+    }
+    else
+    {
+      wifiCache.ip         = WiFi.localIP();
+      wifiCache.gateway    = WiFi.gatewayIP();
+      wifiCache.subnet     = WiFi.subnetMask();
+      wifiCache.dns        = WiFi.dnsIP();
+      wifiCache.leaseStart = clockNow() / 1000000LL;
+      wifiCache.leaseTime  = dhcpLeaseTime();
+      wifiCache.leaseWakes = 0;
+      Serial.printf("WiFi: leased for %u s\n", wifiCache.leaseTime);
+    }
+#else
+    Serial.printf("WiFi: connected in %lu ms\n", millis() - wifiStart);
+#endif
   }
   else
   {
     Serial.printf("Could not connect to '%s'\n", WIFI_SSID);
   }
   return connection_status;
-} // startWiFi
+} // end awaitWiFi
 
-/* Disconnect and power-off wifi.
+/* Disconnect and power-off wifi. Prints how long the radio was on, which is
+ * most of the energy a wake costs.
  */
 void killWiFi()
 {
   WiFi.disconnect();
   WiFi.mode(WIFI_OFF);
+  Serial.printf("WiFi: radio on for %lu ms\n", millis() - wifiStart);
 }
 
 /* Prints the local time to serial monitor.
@@ -101,8 +371,26 @@ bool printLocalTime(tm *timeInfo)
   return true;
 } // killWiFi
 
+// Time allowed for NTP to sync, ms.
+#define NTP_TIMEOUT 5000
+
+static StaticSemaphore_t ntpSyncedBuffer;
+static SemaphoreHandle_t ntpSynced  = NULL;
+static int64_t           ntpTrueUs  = 0;
+static int64_t           ntpUptimeUs = 0;
+
+/* Called from the lwIP task once SNTP has set the clock to tv.
+ */
+static void onTimeSync(timeval *tv)
+{
+  ntpUptimeUs = esp_timer_get_time();
+  ntpTrueUs   = static_cast<int64_t>(tv->tv_sec) * 1000000LL + tv->tv_usec;
+  xSemaphoreGive(ntpSynced);
+} // end onTimeSync
+
 /* Connects to NTP server and stores time in a tm struct, adjusted for the time
- * zone specified in config.cpp.
+ * zone specified in config.cpp. NTP is skipped while the drift corrected RTC
+ * can be trusted, see rtc_clock.h.
  * 
  * Returns true if success, otherwise false.
  * 
@@ -110,81 +398,574 @@ bool printLocalTime(tm *timeInfo)
  */
 bool setupTime(tm *timeInfo)
 {
-  // passing 0 for gmtOffset_sec and daylightOffset_sec and instead use setenv()
-  // for timezone offsets
-  configTime(0, 0, NTP_SERVER_1, NTP_SERVER_2);
+  if (!clockNeedsSync())
+  {
+    Serial.println("Using the drift corrected RTC");
+  }
+  else
+  {
+    if (ntpSynced == NULL)
+    {
+      ntpSynced = xSemaphoreCreateBinaryStatic(&ntpSyncedBuffer);
+    }
+    sntp_set_time_sync_notification_cb(onTimeSync);
+    // what the clock would read at the sync is what it reads now plus the
+    // time elapsed on the crystal, which does not drift noticeably while awake
+    int64_t clockUs  = clockNow();
+    int64_t uptimeUs = esp_timer_get_time();
+    // passing 0 for gmtOffset_sec and daylightOffset_sec and instead use
+    // setenv() for timezone offsets
+    configTime(0, 0, NTP_SERVER_1, NTP_SERVER_2);
+    if (xSemaphoreTake(ntpSynced, pdMS_TO_TICKS(NTP_TIMEOUT)) == pdTRUE)
+    {
+      clockSynced(clockUs + (ntpUptimeUs - uptimeUs), ntpTrueUs);
+    }
+    else
+    { // the clock is still good if it was set on an earlier wake
+      Serial.println("NTP sync timed out");
+    }
+  }
+  // after configTime(), which sets TZ to its (zero) offsets
   setenv("TZ", TIMEZONE, 1);
   tzset();
   return printLocalTime(timeInfo);
 } // setupTime
 
-/* Perform an HTTP GET request to OpenWeatherMap's "One Call" API
- * If data is recieved, it will be parsed and stored in the global variable
- * owm_onecall.
+/* Prints the deserialization statistics of the last parse to the serial
+ * monitor.
+ */
+static void printJsonStats(const json_stats_t &s)
+{
+  // bytes per microsecond is MB/s
+  float throughput = s.parseTime > 0 ? (float) s.bytesRx / s.parseTime : 0;
+  Serial.printf("  JSON: %u B in %lu us (%.3f MB/s, best %lu us/KiB), "
+                "%u B used (peak %u B, next %u B)\n",
+                s.bytesRx, s.parseTime, throughput, s.bestParseRate,
+                s.memoryUsage, s.peakUsage, s.capacity);
+  Serial.printf("  JSON: %u allocation(s), %ld B taken by the parse\n",
+                s.allocations, s.heapUsed);
+} // end printJsonStats
+
+HttpSession::HttpSession(ApiClient &client)
+  : _client(client), _port(0), _requests(0), _connections(0)
+{
+} // end HttpSession::HttpSession
+
+/* Closes the connection and prints how many requests it took, so that reuse
+ * is seen in the log.
+ */
+HttpSession::~HttpSession()
+{
+  close();
+  if (_requests > 0)
+  {
+    Serial.printf("  HTTP: %u request(s) on %u connection(s)\n", _requests,
+                  _connections);
+  }
+} // end HttpSession::~HttpSession
+
+#ifdef USE_HTTPS
+/* Returns the root certificate that host's chain is verified against, NULL if
+ * none is set for it.
+ */
+static const char *rootCA(const String &host)
+{
+  if (host == OWM_ENDPOINT)
+  {
+    return OWM_ROOT_CA;
+  }
+  if (host == OPEN_METEO_ENDPOINT || host == OPEN_METEO_AQ_ENDPOINT)
+  {
+    return OPEN_METEO_ROOT_CA;
+  }
+  return NULL;
+} // end rootCA
+#endif
+
+/* Starts a request. The open connection is reused if it is to the same host,
+ * otherwise it is closed and a new one is made by the request.
+ */
+HTTPClient &HttpSession::begin(const String &host, const String &uri,
+                               uint16_t port)
+{
+  ++_requests;
+  if (host != _host || port != _port || !_client.connected())
+  {
+    close();
+    ++_connections;
+    _host = host;
+    _port = port;
+#ifdef USE_HTTPS
+    _client.setServerName(host.c_str());
+    _client.setCACert(rootCA(host));
+#endif
+#ifdef WIFI_FAST_CONNECT
+    // connect to the cached address, the request then finds the connection
+    // open and skips the DNS lookup
+    IPAddress ip;
+    if (lookupHost(host, ip))
+    {
+      if (_client.connect(ip, port))
+      {
+        Serial.println("  Connected to " + host + " at " + ip.toString());
+      }
+      else
+      {
+        storeHost(host, 0);
+      }
+    }
+#endif
+  }
+  else
+  {
+    Serial.println("  Reusing connection to " + host);
+  }
+  _http.begin(_client, host, port, uri, port == 443);
+  return _http;
+} // end HttpSession::begin
+
+/* Ends a request. The connection is only kept open for the next request if
+ * the response was read to the end. Otherwise the rest of it would be taken
+ * for the start of the next response. A response without a Content-Length
+ * ends when the server closes the connection, HTTP/1.0 has no chunked
+ * encoding, so there is no connection left to keep.
+ */
+void HttpSession::end(bool keepAlive)
+{
+  if (!keepAlive || _http.getSize() < 0)
+  {
+    _client.stop();
+  }
+  _http.end();
+} // end HttpSession::end
+
+/* Records the outcome of sending a request, call with the result of GET. A
+ * response came from the address the client is connected to, so the next
+ * wake can connect to it without a DNS lookup. A request that got no
+ * response may be down to a stale address, the host is looked up again next
+ * time.
+ */
+void HttpSession::sent(int httpResponse)
+{
+#ifdef WIFI_FAST_CONNECT
+  if (httpResponse <= 0)
+  {
+    storeHost(_host, 0);
+    return;
+  }
+  // still answers once the server has closed its end
+  uint32_t ip = _client.remoteIP();
+  if (ip != 0)
+  {
+    storeHost(_host, ip);
+  }
+#endif
+} // end HttpSession::sent
+
+void HttpSession::close()
+{
+  _client.stop();
+  _http.end();
+  _host = "";
+} // end HttpSession::close
+
+AsyncRequest::AsyncRequest(request_t request, void *arg)
+  : _request(request), _arg(arg), _status(0), _task(run, this)
+{
+} // end AsyncRequest::AsyncRequest
+
+/* Starts the request in a task of its own. If the task cannot be created the
+ * request is made by await instead.
+ */
+void AsyncRequest::start(const char *name)
+{
+  if (!_task.start(name, ASYNC_REQUEST_STACK))
+  {
+    Serial.printf("Failed to start the %s task\n", name);
+  }
+} // end AsyncRequest::start
+
+/* Blocks until the request is done.
  *
  * Returns the HTTP Status Code.
  */
-int getOWMonecall(WiFiClient &client, owm_resp_onecall_t &r)
+int AsyncRequest::await()
+{
+  return _task.await();
+} // end AsyncRequest::await
+
+#ifdef DOWNLOAD_THEN_PARSE
+/* Parses the response that the request downloaded, must be called after
+ * await. Wifi is no longer needed by then and should already be off.
+ *
+ * Returns the HTTP Status Code, or the deserialization error code offset by
+ * -100 if the response could not be parsed.
+ */
+int AsyncRequest::parse()
+{
+  if (_status == HTTP_CODE_OK && !_body.empty())
+  {
+    _status = _body.parse();
+  }
+  return _status;
+} // end AsyncRequest::parse
+#endif
+
+/* Makes the request on a connection of its own, in the task or in await.
+ */
+int AsyncRequest::run(void *self)
+{
+  AsyncRequest &req = *static_cast<AsyncRequest *>(self);
+  ApiClient client;
+  HttpSession session(client);
+  req._status = req._request(session, req._arg);
+#ifdef DOWNLOAD_THEN_PARSE
+  req._body.swap(session.body());
+#endif
+  return req._status;
+} // end AsyncRequest::run
+
+/* Prepares an HTTP request to advertise gzip and deflate (zlib) support to
+ * the server.
+ *
+ * HTTPClient adds its own "Accept-Encoding: identity" header to HTTP/1.1
+ * requests, so HTTP/1.0 is used to let this one take effect. This also rules
+ * out a chunked transfer encoding, which getStream() does not decode.
+ *
+ * Keep-alive still works with HTTP/1.0, but only for responses with a
+ * Content-Length. A compressed body is often sent without one and delimited
+ * by the server closing the connection, which the stream reads to, see
+ * HttpSession::end.
+ */
+static void acceptCompression(HTTPClient &http)
+{
+  // the Date header is collected too, see clockCheckDate
+  static const char *headerKeys[] = {"Content-Encoding", "Date"};
+  http.useHTTP10(true);
+  // useHTTP10 turns reuse off as well (arduino-esp32 2.0), which makes
+  // HTTPClient send "Connection: close" and close the connection in end().
+  // Turned back on after it, "Connection: keep-alive" is sent instead.
+  http.setReuse(true);
+  http.addHeader("Accept-Encoding", "gzip, deflate");
+  http.collectHeaders(headerKeys, 2);
+} // end acceptCompression
+
+/* Deserializes a body with the given Content-Encoding. If it is compressed it
+ * is inflated on the fly as the deserializer consumes it, so the inflated
+ * body is never buffered in full.
+ */
+template<typename F>
+static DeserializationError deserializeEncoded(SegmentedStream &body,
+                                               const String &encoding,
+                                               F deserialize)
+{
+  if (encoding.equalsIgnoreCase("gzip"))
+  {
+    InflateStream inflater(body, InflateStream::GZIP);
+    return deserialize(inflater);
+  }
+  if (encoding.equalsIgnoreCase("deflate"))
+  {
+    InflateStream inflater(body, InflateStream::ZLIB);
+    return deserialize(inflater);
+  }
+  return deserialize(body);
+} // end deserializeEncoded
+
+/* Deserializes the body of a response as it is received, a segment at a time
+ * into the session's buffer. The compressed body is never buffered in full
+ * either. The time spent waiting on the network is taken out of the parse
+ * time recorded in stats.
+ */
+template<typename T>
+static DeserializationError deserializeBody(HttpSession &session,
+                  HTTPClient &http,
+                  DeserializationError (*deserialize)(SegmentedStream &, T &),
+                  json_stats_t &stats, T &r)
+{
+  BufferedClientStream body(http.getStream(), session.rxBuffer(),
+                            RX_BUFFER_SIZE);
+  DeserializationError error = deserializeEncoded(body,
+    http.header("Content-Encoding"),
+    [&](SegmentedStream &s) { return deserialize(s, r); });
+  Serial.printf("  RX: %u read(s) from the client, %lu us waiting\n",
+                body.fills(), body.waitTime());
+  if (!error)
+  {
+    discountRxWait(stats, body.waitTime());
+  }
+  return error;
+} // end deserializeBody
+
+#ifdef DOWNLOAD_THEN_PARSE
+DownloadedBody::DownloadedBody()
+  : _data(nullptr), _len(0), _deserialize(nullptr), _thunk(nullptr),
+    _stats(nullptr), _r(nullptr)
+{
+} // end DownloadedBody::DownloadedBody
+
+DownloadedBody::~DownloadedBody()
+{
+  release();
+} // end DownloadedBody::~DownloadedBody
+
+/* Grows the buffer of a body to size bytes, in PSRAM if there is any, the
+ * body is only read through once.
+ */
+static uint8_t *reallocBody(uint8_t *data, size_t size)
+{
+  void *p = heap_caps_realloc(data, size, MALLOC_CAP_SPIRAM);
+  if (p == nullptr)
+  {
+    p = realloc(data, size);
+  }
+  return static_cast<uint8_t *>(p);
+} // end reallocBody
+
+/* Reads the body as fast as the network delivers it, nothing else is done
+ * with it until parse. The buffer is sized from the Content-Length, or grown
+ * as the body arrives if there is none.
+ */
+bool DownloadedBody::download(HTTPClient &http, uint8_t *rxBuffer)
+{
+  release();
+  _encoding = http.header("Content-Encoding");
+  int size = http.getSize(); // -1 without a Content-Length
+  size_t capacity = size > 0 ? size : 4 * RX_BUFFER_SIZE;
+  _data = reallocBody(nullptr, capacity);
+  if (_data == nullptr)
+  {
+    Serial.printf("  Could not allocate %u B for the body\n", capacity);
+    return false;
+  }
+
+  BufferedClientStream body(http.getStream(), rxBuffer, RX_BUFFER_SIZE);
+  unsigned long start = millis();
+  while (size < 0 || _len < static_cast<size_t>(size))
+  {
+    if (_len == capacity)
+    {
+      uint8_t *grown = size < 0 ? reallocBody(_data, 2 * capacity) : nullptr;
+      if (grown == nullptr)
+      {
+        Serial.printf("  Body does not fit in %u B\n", capacity);
+        return false;
+      }
+      _data = grown;
+      capacity *= 2;
+    }
+    size_t n = body.readBytes(reinterpret_cast<char *>(_data + _len),
+                              capacity - _len);
+    if (n == 0)
+    {
+      break;
+    }
+    _len += n;
+  }
+  Serial.printf("  RX: %u B in %lu ms, %u read(s) from the client, "
+                "parsed once wifi is off\n",
+                _len, millis() - start, body.fills());
+  return size < 0 ? _len > 0 : _len == static_cast<size_t>(size);
+} // end DownloadedBody::download
+
+/* Parses the body from memory. A parse that runs out of memory is attempted
+ * again at once, with the larger document the failure was recorded to need,
+ * as getJson would, but without downloading the body again.
+ */
+int DownloadedBody::parse()
+{
+  DeserializationError error;
+  for (int attempts = 0; attempts < 3; ++attempts)
+  {
+    MemoryStream body(_data, _len);
+    error = deserializeEncoded(body, _encoding,
+      [this](SegmentedStream &s) { return _thunk(_deserialize, s, _r); });
+    if (error != DeserializationError::NoMemory)
+    {
+      break;
+    }
+  }
+  if (!error)
+  {
+    printJsonStats(*_stats);
+  }
+  release();
+  return error ? -100 - static_cast<int>(error.code()) : HTTP_CODE_OK;
+} // end DownloadedBody::parse
+
+void DownloadedBody::swap(DownloadedBody &other)
+{
+  std::swap(_data, other._data);
+  std::swap(_len, other._len);
+  std::swap(_encoding, other._encoding);
+  std::swap(_deserialize, other._deserialize);
+  std::swap(_thunk, other._thunk);
+  std::swap(_stats, other._stats);
+  std::swap(_r, other._r);
+} // end DownloadedBody::swap
+
+void DownloadedBody::release()
+{
+  free(_data);
+  _data = nullptr;
+  _len  = 0;
+} // end DownloadedBody::release
+#endif
+
+/* Performs an HTTP GET request and deserializes the JSON response into r.
+ * The port defaults to that of the APIs, see API_PORT.
+ *
+ * If the JSON document runs out of memory its capacity is increased and the
+ * request is attempted again at once. Other transient failures are attempted
+ * again after a short delay. Up to 3 attempts in total.
+ *
+ * Returns the HTTP Status Code, or the deserialization error code offset by
+ * -100 if the response could not be parsed.
+ */
+template<typename T>
+static int getJson(HttpSession &session, const String &host, const String &uri,
+                   DeserializationError (*deserialize)(SegmentedStream &, T &),
+                   json_stats_t &stats, T &r, uint16_t port = API_PORT)
 {
   int attempts = 0;
   bool rxSuccess = false;
   DeserializationError jsonErr = {};
-  String uri = "/data/" + OWM_ONECALL_VERSION
-               + "/onecall?lat=" + LAT + "&lon=" + LON + "&lang=" + OWM_LANG 
-               + "&units=standard&exclude=minutely&appid=" + OWM_APIKEY;
-  // This string is printed to terminal to help with debugging. The API key is
-  // censored to reduce the risk of users exposing thier key.
-  String sanitizedUri = OWM_ENDPOINT
-               + "/data/" + OWM_ONECALL_VERSION
-               + "/onecall?lat=" + LAT + "&lon=" + LON + "&lang=" + OWM_LANG 
-               + "&units=standard&exclude=minutely&appid={API key}";
-
-  Serial.println("Attempting HTTP Request: " + sanitizedUri);
   int httpResponse = 0;
   while (!rxSuccess && attempts < 3)
   {
-    HTTPClient http;
-    http.begin(client, OWM_ENDPOINT, 80, uri);
+    jsonErr = {};
+    HTTPClient &http = session.begin(host, uri, port);
+    acceptCompression(http);
     httpResponse = http.GET();
+    session.sent(httpResponse);
     if (httpResponse == HTTP_CODE_OK)
     {
-      jsonErr = deserializeOneCall(http.getStream(), r);
+      clockCheckDate(http.header("Date"));
+#ifdef DOWNLOAD_THEN_PARSE
+      rxSuccess = session.body().download(http, session.rxBuffer());
+      if (rxSuccess)
+      {
+        session.body().expect(deserialize, stats, r);
+      }
+      else
+      {
+        session.body().release();
+        httpResponse = HTTPC_ERROR_READ_TIMEOUT;
+      }
+#else
+      jsonErr = deserializeBody(session, http, deserialize, stats, r);
       if (jsonErr)
       {
-        rxSuccess = false;
         // given a -100 offset to distiguish these errors from httpClient errors
         httpResponse = -100 - static_cast<int>(jsonErr.code());
       }
       rxSuccess = !jsonErr;
+#endif
     }
-    client.stop();
-    http.end();
+    session.end(rxSuccess);
     Serial.println("  " + String(httpResponse, DEC) + " "
                    + getHttpResponsePhrase(httpResponse));
+#ifndef DOWNLOAD_THEN_PARSE
+    if (rxSuccess)
+    {
+      printJsonStats(stats);
+    }
+#endif
     ++attempts;
+    if (!rxSuccess && attempts < 3)
+    {
+      if (jsonErr != DeserializationError::NoMemory
+          && !isTransientError(httpResponse))
+      { // retrying would get the same response
+        break;
+      }
+      // out of memory is retried at once with a larger document, anything else
+      // is given a moment to pass
+      if (jsonErr != DeserializationError::NoMemory)
+      {
+        delay(REQUEST_RETRY_DELAY << (attempts - 1));
+      }
+    }
   }
 
   return httpResponse;
-} // getOWMonecall
+} // end getJson
+
+/* Returns the exclude parameter of a One Call request, for the sections of
+ * the forecast (FETCH_HOURLY, FETCH_DAILY) that are due.
+ */
+static String onecallExclude(uint8_t sections)
+{
+  String exclude = "";
+#ifndef ENABLE_MINUTELY_PRECIP
+  exclude += ",minutely";
+#endif
+  if (!(sections & FETCH_HOURLY))
+  {
+    exclude += ",hourly";
+  }
+  if (!(sections & FETCH_DAILY))
+  {
+    exclude += ",daily";
+  }
+#ifdef DISABLE_ALERTS
+  exclude += ",alerts";
+#endif
+  if (exclude.length() > 0)
+  {
+    exclude = exclude.substring(1);
+  }
+  return exclude;
+} // end onecallExclude
 
-/* Perform an HTTP GET request to OpenWeatherMap's "Air Pollution" API
+/* Perform an HTTP GET request to OpenWeatherMap's "One Call" API
  * If data is recieved, it will be parsed and stored in the global variable
- * owm_air_pollution.
+ * owm_onecall. Only the sections of the forecast (FETCH_HOURLY, FETCH_DAILY)
+ * that are due are requested, the rest are excluded from the response.
  *
  * Returns the HTTP Status Code.
  */
-int getOWMairpollution(WiFiClient &client, owm_resp_air_pollution_t &r)
+int getOWMonecall(HttpSession &session, owm_resp_onecall_t &r,
+                  uint8_t sections)
 {
-  int attempts = 0;
-  bool rxSuccess = false;
-  DeserializationError jsonErr = {};
+  String exclude = onecallExclude(sections);
+  String uri = "/data/" + OWM_ONECALL_VERSION
+               + "/onecall?lat=" + LAT + "&lon=" + LON + "&lang=" + OWM_LANG 
+               + "&units=standard&exclude=" + exclude
+               + "&appid=" + OWM_APIKEY;
+  // This string is printed to terminal to help with debugging. The API key is
+  // censored to reduce the risk of users exposing thier key.
+  String sanitizedUri = OWM_ENDPOINT
+               + "/data/" + OWM_ONECALL_VERSION
+               + "/onecall?lat=" + LAT + "&lon=" + LON + "&lang=" + OWM_LANG 
+               + "&units=standard&exclude=" + exclude
+               + "&appid={API key}";
+
+  Serial.println("Attempting HTTP Request: " + sanitizedUri);
+#ifdef JSON_LAZY_INDEX
+  return getJson(session, OWM_ENDPOINT, uri, deserializeOneCallIndexed,
+                 onecallIndexJsonStats, r);
+#else
+  return getJson(session, OWM_ENDPOINT, uri, deserializeOneCall,
+                 onecallJsonStats, r);
+#endif
+} // getOWMonecall
 
-  // set start and end to approriate values so that the last 24 hours of air
-  // pollution history is returned. Unix, UTC.
+/* Perform an HTTP GET request to OpenWeatherMap's "Air Pollution" API for
+ * the last hours of history, at most OWM_NUM_AIR_POLLUTION.
+ * If data is recieved, it will be parsed and stored in r.
+ *
+ * Returns the HTTP Status Code.
+ */
+int getOWMairpollution(HttpSession &session, owm_resp_air_pollution_t &r,
+                       int hours)
+{
+  // set start and end to approriate values so that the last hours of air
+  // pollution history are returned. Unix, UTC.
   time_t now;
   int64_t end = time(&now);
   // minus 1 is important here, otherwise we could get an extra hour of history
-  int64_t start = end - ((3600 * OWM_NUM_AIR_POLLUTION) - 1);
+  int64_t start = end - ((3600LL * hours) - 1);
   char endStr[22];
   char startStr[22];
   sprintf(endStr, "%lld", end);
@@ -200,28 +981,177 @@ int getOWMairpollution(WiFiClient &client, owm_resp_air_pollution_t &r)
                + "&appid={API key}";
 
   Serial.println("Attempting HTTP Request: " + sanitizedUri);
-  int httpResponse = 0;
-  while (!rxSuccess && attempts < 3)
+  return getJson(session, OWM_ENDPOINT, uri, deserializeAirQuality,
+                 airPollutionJsonStats, r);
+} // getOWMairpollution
+
+/* Perform an HTTP GET request to Open-Meteo's Forecast API.
+ *
+ * Only the variables that are drawn are requested, and only for as many hours
+ * as the outlook graph and as many days as the forecast show. Temperatures are
+ * returned in Celsius and wind speeds in m/s, these are converted to the units
+ * of the One Call API while deserializing.
+ *
+ * Returns the HTTP Status Code.
+ */
+int getOpenMeteoForecast(HttpSession &session, owm_resp_onecall_t &r)
+{
+  // one more hour than is graphed labels the end of the x axis
+  int forecastHours = std::min(HOURLY_GRAPH_MAX + 1, OWM_NUM_HOURLY);
+  String uri = "/v1/forecast?latitude=" + LAT + "&longitude=" + LON
+               + "&current=temperature_2m,apparent_temperature,"
+                 "relative_humidity_2m,dew_point_2m,pressure_msl,cloud_cover,"
+                 "uv_index,visibility,wind_speed_10m,wind_gusts_10m,"
+                 "wind_direction_10m,rain,snowfall,weather_code,is_day"
+               + "&hourly=temperature_2m,precipitation_probability,rain,"
+                 "snowfall"
+               + "&daily=weather_code,temperature_2m_max,temperature_2m_min,"
+                 "sunrise,sunset,cloud_cover_mean,uv_index_max,"
+                 "wind_speed_10m_max,wind_gusts_10m_max,"
+                 "precipitation_probability_max,rain_sum,snowfall_sum"
+               + "&forecast_hours=" + String(forecastHours)
+               + "&forecast_days=" + String(OPEN_METEO_NUM_DAILY)
+               + "&wind_speed_unit=ms&timeformat=unixtime&timezone=auto";
+
+  Serial.println("Attempting HTTP Request: " + OPEN_METEO_ENDPOINT + uri);
+  return getJson(session, OPEN_METEO_ENDPOINT, uri,
+                 deserializeOpenMeteoForecast, onecallJsonStats, r);
+} // getOpenMeteoForecast
+
+/* Perform an HTTP GET request to Open-Meteo's Air Quality API for the same
+ * hours of history as getOWMairpollution.
+ *
+ * Returns the HTTP Status Code.
+ */
+int getOpenMeteoAirQuality(HttpSession &session, owm_resp_air_pollution_t &r,
+                           int hours)
+{
+  String uri = "/v1/air-quality?latitude=" + LAT + "&longitude=" + LON
+               + "&hourly=carbon_monoxide,nitrogen_dioxide,ozone,"
+                 "sulphur_dioxide,pm2_5,pm10,ammonia"
+               + "&past_hours=" + String(hours - 1)
+               + "&forecast_hours=1&timeformat=unixtime";
+
+  Serial.println("Attempting HTTP Request: " + OPEN_METEO_AQ_ENDPOINT + uri);
+  return getJson(session, OPEN_METEO_AQ_ENDPOINT, uri,
+                 deserializeOpenMeteoAirQuality, airPollutionJsonStats, r);
+} // getOpenMeteoAirQuality
+
+#ifdef WEATHER_PROVIDER_OWM_PROXY
+/* Perform an HTTP GET request to the API proxy for the One Call response of
+ * this location. The proxy holds the API key and answers in the encoding of
+ * api_codec.h, which is decoded straight into r. Only the sections of the
+ * forecast that are due are requested, as from OpenWeatherMap.
+ *
+ * Returns the HTTP Status Code.
+ */
+int getProxyOneCall(HttpSession &session, owm_resp_onecall_t &r,
+                    uint8_t sections)
+{
+  String uri = "/onecall?lat=" + LAT + "&lon=" + LON + "&lang=" + OWM_LANG
+               + "&exclude=" + onecallExclude(sections);
+
+  Serial.println("Attempting HTTP Request: " + API_PROXY_HOST + ":"
+                 + String(API_PROXY_PORT) + uri + "&token={token}");
+  return getJson(session, API_PROXY_HOST, uri + "&token=" + API_PROXY_TOKEN,
+                 deserializeOneCallProxy, onecallJsonStats, r, API_PROXY_PORT);
+} // getProxyOneCall
+
+/* Perform an HTTP GET request to the API proxy for the last hours of air
+ * pollution history of this location.
+ *
+ * Returns the HTTP Status Code.
+ */
+int getProxyAirPollution(HttpSession &session, owm_resp_air_pollution_t &r,
+                         int hours)
+{
+  String uri = "/air_pollution?lat=" + LAT + "&lon=" + LON
+               + "&hours=" + String(hours);
+
+  Serial.println("Attempting HTTP Request: " + API_PROXY_HOST + ":"
+                 + String(API_PROXY_PORT) + uri + "&token={token}");
+  return getJson(session, API_PROXY_HOST, uri + "&token=" + API_PROXY_TOKEN,
+                 deserializeAirQualityProxy, airPollutionJsonStats, r,
+                 API_PROXY_PORT);
+} // getProxyAirPollution
+#endif
+
+#ifdef RENDER_SERVER
+/* Returns s percent-encoded for a URL query value. Only unreserved characters
+ * are left as they are, UTF-8 is encoded byte by byte.
+ */
+String urlEncode(const String &s)
+{
+  static const char *HEX_DIGITS = "0123456789ABCDEF";
+  String encoded;
+  encoded.reserve(s.length() * 3);
+  for (unsigned int i = 0; i < s.length(); ++i)
   {
-    HTTPClient http;
-    http.begin(client, OWM_ENDPOINT, 80, uri);
-    httpResponse = http.GET();
-    if (httpResponse == HTTP_CODE_OK)
+    uint8_t c = s[i];
+    if (isalnum(c) || c == '-' || c == '.' || c == '_' || c == '~')
     {
-      jsonErr = deserializeAirQuality(http.getStream(), r);
-      if (jsonErr)
-      {
-        // given a -100 offset to distiguish these errors from httpClient errors
-        httpResponse = -100 - static_cast<int>(jsonErr.code());
-      }
-      rxSuccess = !jsonErr;
+      encoded += static_cast<char>(c);
+    }
+    else
+    {
+      encoded += '%';
+      encoded += HEX_DIGITS[c >> 4];
+      encoded += HEX_DIGITS[c & 0x0F];
     }
-    client.stop();
-    http.end();
-    Serial.println("  " + String(httpResponse, DEC) + " "
-                   + getHttpResponsePhrase(httpResponse));
-    ++attempts;
   }
+  return encoded;
+} // end urlEncode
 
+/* Downloads the frame the render server renders for this device and streams
+ * it onto the display, which must have been initialized. status is appended to
+ * the query, it carries the readings of the device that are drawn.
+ *
+ * Returns the HTTP Status Code, or HTTPC_ERROR_READ_TIMEOUT if the frame was
+ * incomplete or invalid.
+ */
+int getRenderedFrame(const String &status)
+{
+#ifdef DISP_3C
+  String uri = "/frame?planes=2";
+#else
+  String uri = "/frame?planes=1";
+#endif
+  uri += "&lat=" + LAT + "&lon=" + LON + "&units=" + UNITS_STRING + status;
+  Serial.println("Attempting HTTP Request: " + RENDER_SERVER_HOST + ":"
+                 + String(RENDER_SERVER_PORT) + uri + "&token={token}");
+  static const char *headerKeys[] = {"Content-Encoding"};
+  WiFiClient client;
+  HTTPClient http;
+  http.begin(client, RENDER_SERVER_HOST, RENDER_SERVER_PORT,
+             uri + "&token=" + RENDER_SERVER_TOKEN);
+  http.setTimeout(RENDER_SERVER_TIMEOUT);
+  http.useHTTP10(true);
+  http.addHeader("Accept-Encoding", "deflate");
+  http.collectHeaders(headerKeys, 1);
+  int httpResponse = http.GET();
+  if (httpResponse == HTTP_CODE_OK)
+  {
+    uint8_t rxBuffer[RX_BUFFER_SIZE];
+    BufferedClientStream body(http.getStream(), rxBuffer, RX_BUFFER_SIZE);
+    bool shown;
+    if (http.header("Content-Encoding").equalsIgnoreCase("deflate"))
+    {
+      InflateStream inflater(body, InflateStream::ZLIB);
+      shown = streamFrame(inflater);
+    }
+    else
+    {
+      shown = streamFrame(body);
+    }
+    Serial.printf("  RX: %u read(s) from the client\n", body.fills());
+    if (!shown)
+    {
+      httpResponse = HTTPC_ERROR_READ_TIMEOUT;
+    }
+  }
+  http.end();
+  Serial.println("  " + String(httpResponse, DEC) + " "
+                 + getHttpResponsePhrase(httpResponse));
   return httpResponse;
-} // getOWMairpollution
+} // getRenderedFrame
+#endif
@@ -42,6 +42,31 @@ const char *WIFI_PASSWORD = "password";
 // OpenWeatherMap API key, https://openweathermap.org/
 const String OWM_APIKEY   = "abcdefghijklmnopqrstuvwxyz012345";
 const String OWM_ENDPOINT = "api.openweathermap.org";
+// Root certificate (PEM) that OpenWeatherMap's certificate chain is verified
+// against when USE_HTTPS is defined. Print the chain with
+//   openssl s_client -showcerts -connect api.openweathermap.org:443
+// and paste the root it is issued by here. Required, HTTPS requests to a host
+// without a root certificate are not made.
+const char *OWM_ROOT_CA = NULL;
+
+// RENDER SERVER
+// Address of the render server on your network, used if RENDER_SERVER is
+// defined in config.h. The token is the one the server was started with (its
+// RENDER_SERVER_TOKEN environment variable), letters and digits only. The
+// server answers nothing without it.
+const String   RENDER_SERVER_HOST  = "192.168.1.2";
+const uint16_t RENDER_SERVER_PORT  = 8080;
+const String   RENDER_SERVER_TOKEN = "";
+
+// API PROXY
+// Address of the API proxy on your network, used if WEATHER_PROVIDER_OWM_PROXY
+// is defined in config.h. The token is the one the proxy was started with (its
+// API_PROXY_TOKEN environment variable), letters and digits only. The proxy
+// answers nothing without it.
+const String   API_PROXY_HOST  = "192.168.1.2";
+const uint16_t API_PROXY_PORT  = 8081;
+const String   API_PROXY_TOKEN = "";
+
 // OpenWeatherMap One Call 2.5 API is deprecated for all new free users 
 // (accounts created after Summer 2022).
 //
@@ -58,9 +83,19 @@ const String OWM_ENDPOINT = "api.openweathermap.org";
 //   calls.
 const String OWM_ONECALL_VERSION = "3.0";
 
+// OPEN-METEO API
+// Open-Meteo, https://open-meteo.com/
+// No API key is needed for non-commercial use. These can be pointed at a
+// self-hosted instance.
+const String OPEN_METEO_ENDPOINT    = "api.open-meteo.com";
+const String OPEN_METEO_AQ_ENDPOINT = "air-quality-api.open-meteo.com";
+// Root certificate (PEM) of both Open-Meteo hosts, when USE_HTTPS is defined,
+// see OWM_ROOT_CA.
+const char *OPEN_METEO_ROOT_CA = NULL;
+
 // LOCATION
 // Set your latitude and longitude.
-// (used to get weather data as part of API requests to OpenWeatherMap)
+// (used to get weather data as part of API requests to the weather provider)
 const String LAT = "40.7128";
 const String LON = "-74.0060";
 // City name that will be shown in the top-right corner of the display.
@@ -94,6 +129,19 @@ const char *REFRESH_TIME_FORMAT = "%x %H:%M";
 // The system will try finding the closest available servers for you.
 const char *NTP_SERVER_1 = "us.pool.ntp.org";
 const char *NTP_SERVER_2 = "time.nist.gov";
+// Hours between NTP syncs. In between, the time is kept by the esp32's RTC,
+// corrected for its drift as measured by the previous syncs. Until the drift
+// has been measured, NTP is synced every wake.
+const int TIME_SYNC_INTERVAL = 6;
+// Hours between fetches of the daily forecast and of the air pollution
+// history, which change slowly. Current conditions are fetched every wake and
+// the hourly forecast once an hour, the daily forecast is also fetched on a new
+// day. In between, they are drawn from RTC memory. 0 fetches them every wake.
+// (Only OpenWeatherMap's One Call API can leave sections out, with the other
+// providers the whole forecast is fetched every wake.) After the first fetch,
+// only the hours of air pollution history since the last fetch are requested.
+const int DAILY_REFRESH_INTERVAL         = 3;
+const int AIR_POLLUTION_REFRESH_INTERVAL = 1;
 // Sleep duration in minutes. (aka how often esp32 will wake for an update)
 // Aligned to the nearest minute boundary, so if 30 will always update at 00 or 
 // 30 past the hour. (range: 0-59)
@@ -102,6 +150,11 @@ const long SLEEP_DURATION = 30;
 // (range: 0-23)
 const int BED_TIME  = 00; // Last update at 00:00 (midnight) until WAKE_TIME.
 const int WAKE_TIME = 06; // Hour of first update after BED_TIME, 06:00.
+// Minutes until a wake that failed for a reason that may pass (WiFi, time,
+// server errors) is retried, rather than waiting for the next update. Doubled
+// with each consecutive failure until it reaches SLEEP_DURATION, from there on
+// updates are attempted on the usual schedule.
+const unsigned long RETRY_INTERVAL = 2;
 
 // HOURLY OUTLOOK GRAPH
 // Number of hours to display on the outlook graph.
@@ -15,7 +15,9 @@
  * along with this program.  If not, see <https://www.gnu.org/licenses/>.
  */
 
+#include <cctype>
 #include <cmath>
+#include <cstring>
 #include <vector>
 #include <Arduino.h>
 
@@ -30,6 +32,7 @@
 #include "api_response.h"
 #include "config.h"
 #include "display_utils.h"
+#include "memo.h"
 
 /* Returns battery percentage, rounded to the nearest integer.
  * Takes a voltage and uses a pre-calculated polynomial to find an approximation
@@ -121,65 +124,106 @@ void getRefreshTimeStr(String &s, bool timeSuccess, tm *timeInfo)
   return;
 } // end getRefreshTimeStr
 
-/* Takes a String and capitalizes the first letter of every word.
+/* Takes a string and capitalizes the first letter of every word, in place.
  *
  * Ex:
  *   input   : "severe thunderstorm warning" or "SEVERE THUNDERSTORM WARNING"
  *   becomes : "Severe Thunderstorm Warning"
  */
-void toTitleCase(String &text)
+void toTitleCase(char *text)
 {
-  text.setCharAt(0, toUpperCase(text.charAt(0)));
+  if (text[0] == '\0')
+  {
+    return;
+  }
+  text[0] = toupper(text[0]);
 
-  for (int i = 1; i < text.length(); ++i)
+  for (int i = 1; text[i] != '\0'; ++i)
   {
-    if (text.charAt(i - 1) == ' ' 
-     || text.charAt(i - 1) == '-' 
-     || text.charAt(i - 1) == '(')
+    if (text[i - 1] == ' ' 
+     || text[i - 1] == '-' 
+     || text[i - 1] == '(')
     {
-      text.setCharAt(i, toUpperCase(text.charAt(i)));
+      text[i] = toupper(text[i]);
     }
     else
     {
-      text.setCharAt(i, toLowerCase(text.charAt(i)));
+      text[i] = tolower(text[i]);
     }
   }
 
   return;
 } // end toTitleCase
 
-/* Takes a String and truncates at any of these characters ,.( and trims any
- * trailing whitespace.
+/* Takes a string and truncates it in place at any of these characters ,.( and
+ * trims any trailing whitespace.
  *
  * Ex:
  *   input   : "Severe Thunderstorm Warning, (Starting At 10 Pm)"
  *   becomes : "Severe Thunderstorm Warning"
  */
-void truncateExtraAlertInfo(String &text)
+void truncateExtraAlertInfo(char *text)
 {
-  if (text.isEmpty())
+  if (text[0] == '\0')
   {
     return;
   }
 
   int i = 1;
   int lastChar = i;
-  while (i < text.length() 
-    && text.charAt(i) != ',' 
-    && text.charAt(i) != '.' 
-    && text.charAt(i) != '(')
+  while (text[i] != '\0'
+    && text[i] != ',' 
+    && text[i] != '.' 
+    && text[i] != '(')
   {
-    if (text.charAt(i) != ' ')
+    if (text[i] != ' ')
     {
       lastChar = i + 1;
     }
     ++i;
   }
 
-  text = text.substring(0, lastChar);
+  text[lastChar] = '\0';
   return;
 } // end truncateExtraAlertInfo
 
+/* Flattens an alert description in place so that it can be drawn as a single
+ * line of text. Line breaks and runs of whitespace become a single space and
+ * the leading punctuation that some agencies use as a headline marker is
+ * removed.
+ *
+ * Ex:
+ *   input   : "...HEAT ADVISORY IN EFFECT...\n* WHAT...Heat index values"
+ *   becomes : "HEAT ADVISORY IN EFFECT... * WHAT...Heat index values"
+ */
+void flattenAlertDescription(char *text)
+{
+  const char *src = text;
+  while (*src == '.' || *src == '*' || isspace(static_cast<unsigned char>(*src)))
+  {
+    ++src;
+  }
+
+  char *dst = text;
+  bool space = false;
+  for (; *src != '\0'; ++src)
+  {
+    if (isspace(static_cast<unsigned char>(*src)))
+    {
+      space = true;
+      continue;
+    }
+    if (space)
+    {
+      *dst++ = ' ';
+      space = false;
+    }
+    *dst++ = *src;
+  }
+  *dst = '\0';
+  return;
+} // end flattenAlertDescription
+
 /* Returns the urgency of an event based by checking if the event String
  * contains any indicator keywords.
  *
@@ -191,12 +235,12 @@ void truncateExtraAlertInfo(String &text)
  * is returned.
  * In the United States example, Watch = 0, Advisory = 1, Warning = 2
  */
-int eventUrgency(String &event)
+int eventUrgency(const char *event)
 {
   int urgency_lvl = -1;
   for (int i = 0; i < ALERT_URGENCY.size(); ++i)
   {
-    if (event.indexOf(ALERT_URGENCY[i]) >= 0)
+    if (strstr(event, ALERT_URGENCY[i].c_str()) != nullptr)
     {
       urgency_lvl = i;
     }
@@ -238,13 +282,20 @@ int eventUrgency(String &event)
  * Truncate Extraneous Info (anything that follows a comma, period, or open
  *   parentheses)
  */
-void filterAlerts(std::vector<owm_alerts_t> &resp, int *ignore_list)
+void filterAlerts(StaticVector<owm_alerts_t, OWM_NUM_ALERTS> &resp,
+                  int *ignore_list)
 {
   // Convert all event text and tags to lowercase.
   for (auto &alert : resp)
   {
-    alert.event.toLowerCase();
-    alert.tags.toLowerCase();
+    for (char *c = alert.event; *c != '\0'; ++c)
+    {
+      *c = tolower(*c);
+    }
+    for (char *c = alert.tags; *c != '\0'; ++c)
+    {
+      *c = tolower(*c);
+    }
   }
 
   // Deduplicate alerts with the same first tag. Keeping only the most urgent
@@ -255,14 +306,14 @@ void filterAlerts(std::vector<owm_alerts_t> &resp, int *ignore_list)
     {
       continue;
     }
-    if (resp[i].tags.isEmpty())
+    if (resp[i].tags[0] == '\0')
     {
       continue; // urgency can not be determined so it remains in the list
     }
 
     for (int j = 0; j < resp.size(); ++j)
     {
-      if (i != j && resp[i].tags == resp[j].tags)
+      if (i != j && strcmp(resp[i].tags, resp[j].tags) == 0)
       {
         // comparing alerts of the same tag, removing the less urgent alert
         if (eventUrgency(resp[i].event) >= eventUrgency(resp[j].event))
@@ -334,128 +385,162 @@ const char *getUVIdesc(unsigned int uvi)
  *   pm2_5 μg/m^3, Fine Particulate Matter (<2.5μm)
  */
 /* Returns the average pollutant concentration over a given number of previous
- * hours.
+ * hours, ending with the current hour. The samples are taken from the hours of
+ * the timeline, hours without a sample are left out of the average.
  *
  * hours must be a positive integer
  */
-float getAvgConc(const float pollutant[], int hours)
+float getAvgConc(const timeline_t &tl, const float pollutant[], int hours)
 {
   float avg = 0;
-  // index (OWM_NUM_AIR_POLLUTION - 1) is most recent hourly concentration
-  for (int h = (OWM_NUM_AIR_POLLUTION - 1) - (hours - 1)
-       ; h < OWM_NUM_AIR_POLLUTION
-       ; ++h)
+  int samples = 0;
+  for (int h = -(hours - 1); h <= 0; ++h)
   {
-    avg += pollutant[h];
+    int s = tl.slot(h);
+    if (s >= 0 && tl.air[s] >= 0)
+    {
+      avg += pollutant[tl.air[s]];
+      ++samples;
+    }
   }
 
-  avg = avg / static_cast<float>(hours);
+  if (samples > 0)
+  {
+    avg = avg / static_cast<float>(samples);
+  }
   return avg;
 }
 
 /* Returns the aqi for the given AQI and the selected AQI scale(defined in 
  * config.h)
  */
-int getAQI(const owm_resp_air_pollution_t &p)
+static int computeAQI(const owm_resp_air_pollution_t &p,
+                      const timeline_t &tl)
 {
 #ifdef AUSTRALIA_AQI
-  float co_8h     = getAvgConc(p.components.co,     8);
-  float no2_1h    = getAvgConc(p.components.no2,    1);
-  float o3_1h     = getAvgConc(p.components.o3,     1);
-  float o3_4h     = getAvgConc(p.components.o3,     4);
-  float so2_1h    = getAvgConc(p.components.so2,    1);
-  float pm10_24h  = getAvgConc(p.components.pm10,  24);
-  float pm2_5_24h = getAvgConc(p.components.pm2_5, 24);
+  float co_8h     = getAvgConc(tl, p.components.co,     8);
+  float no2_1h    = getAvgConc(tl, p.components.no2,    1);
+  float o3_1h     = getAvgConc(tl, p.components.o3,     1);
+  float o3_4h     = getAvgConc(tl, p.components.o3,     4);
+  float so2_1h    = getAvgConc(tl, p.components.so2,    1);
+  float pm10_24h  = getAvgConc(tl, p.components.pm10,  24);
+  float pm2_5_24h = getAvgConc(tl, p.components.pm2_5, 24);
   return australia_aqi(co_8h, no2_1h, o3_1h, o3_4h, so2_1h, pm10_24h,
                        pm2_5_24h);
 #endif // end AUSTRALIA_AQI
 #ifdef CANADA_AQHI
-  float no2_3h    = getAvgConc(p.components.no2,    3);
-  float o3_3h     = getAvgConc(p.components.o3,     3);
-  float pm2_5_3h  = getAvgConc(p.components.pm2_5,  3);
+  float no2_3h    = getAvgConc(tl, p.components.no2,    3);
+  float o3_3h     = getAvgConc(tl, p.components.o3,     3);
+  float pm2_5_3h  = getAvgConc(tl, p.components.pm2_5,  3);
   return canada_aqhi(no2_3h, o3_3h, pm2_5_3h);
 #endif // end CANADA_AQHI
 #ifdef EUROPE_CAQI
-  float no2_1h    = getAvgConc(p.components.no2,    1);
-  float o3_1h     = getAvgConc(p.components.o3,     1);
-  float pm10_1h   = getAvgConc(p.components.pm10,   1);
-  float pm2_5_1h  = getAvgConc(p.components.pm2_5,  1);
+  float no2_1h    = getAvgConc(tl, p.components.no2,    1);
+  float o3_1h     = getAvgConc(tl, p.components.o3,     1);
+  float pm10_1h   = getAvgConc(tl, p.components.pm10,   1);
+  float pm2_5_1h  = getAvgConc(tl, p.components.pm2_5,  1);
   return europe_caqi(no2_1h, o3_1h, pm10_1h, pm2_5_1h);
 #endif // end EUROPE_CAQI
 #ifdef HONG_KONG_AQHI
-  float no2_3h    = getAvgConc(p.components.no2,    3);
-  float o3_3h     = getAvgConc(p.components.o3,     3);
-  float so2_3h    = getAvgConc(p.components.so2,    3);
-  float pm10_3h   = getAvgConc(p.components.pm10,   3);
-  float pm2_5_3h  = getAvgConc(p.components.pm2_5,  3);
+  float no2_3h    = getAvgConc(tl, p.components.no2,    3);
+  float o3_3h     = getAvgConc(tl, p.components.o3,     3);
+  float so2_3h    = getAvgConc(tl, p.components.so2,    3);
+  float pm10_3h   = getAvgConc(tl, p.components.pm10,   3);
+  float pm2_5_3h  = getAvgConc(tl, p.components.pm2_5,  3);
   return hong_kong_aqhi(no2_3h,  o3_3h, so2_3h, pm10_3h, pm2_5_3h);
 #endif // end HONG_KONG_AQHI
 #ifdef INDIA_AQI
-  float co_8h     = getAvgConc(p.components.co,     8);
-  float nh3_24h   = getAvgConc(p.components.nh3,   24);
-  float no2_24h   = getAvgConc(p.components.no2,   24);
-  float o3_8h     = getAvgConc(p.components.o3,     8);
+  float co_8h     = getAvgConc(tl, p.components.co,     8);
+  float nh3_24h   = getAvgConc(tl, p.components.nh3,   24);
+  float no2_24h   = getAvgConc(tl, p.components.no2,   24);
+  float o3_8h     = getAvgConc(tl, p.components.o3,     8);
   float pb_24h    = 0; // OpenWeatherMap does not report pb concentration
-  float so2_24h   = getAvgConc(p.components.so2,   24);
-  float pm10_24h  = getAvgConc(p.components.pm10,  24);
-  float pm2_5_24h = getAvgConc(p.components.pm2_5, 24);
+  float so2_24h   = getAvgConc(tl, p.components.so2,   24);
+  float pm10_24h  = getAvgConc(tl, p.components.pm10,  24);
+  float pm2_5_24h = getAvgConc(tl, p.components.pm2_5, 24);
   return india_aqi(co_8h, nh3_24h, no2_24h, o3_8h, pb_24h, so2_24h, pm10_24h,
                    pm2_5_24h);
 #endif // end INDIA_AQI
 #ifdef MAINLAND_CHINA_AQI
-  float co_1h     = getAvgConc(p.components.co,     1);
-  float co_24h    = getAvgConc(p.components.co,    24);
-  float no2_1h    = getAvgConc(p.components.no2,    1);
-  float no2_24h   = getAvgConc(p.components.no2,   24);
-  float o3_1h     = getAvgConc(p.components.o3,     1);
-  float o3_8h     = getAvgConc(p.components.o3,     8);
-  float so2_1h    = getAvgConc(p.components.so2,    1);
-  float so2_24h   = getAvgConc(p.components.so2,   24);
-  float pm10_24h  = getAvgConc(p.components.pm10,  24);
-  float pm2_5_24h = getAvgConc(p.components.pm2_5, 24);
+  float co_1h     = getAvgConc(tl, p.components.co,     1);
+  float co_24h    = getAvgConc(tl, p.components.co,    24);
+  float no2_1h    = getAvgConc(tl, p.components.no2,    1);
+  float no2_24h   = getAvgConc(tl, p.components.no2,   24);
+  float o3_1h     = getAvgConc(tl, p.components.o3,     1);
+  float o3_8h     = getAvgConc(tl, p.components.o3,     8);
+  float so2_1h    = getAvgConc(tl, p.components.so2,    1);
+  float so2_24h   = getAvgConc(tl, p.components.so2,   24);
+  float pm10_24h  = getAvgConc(tl, p.components.pm10,  24);
+  float pm2_5_24h = getAvgConc(tl, p.components.pm2_5, 24);
   return mainland_china_aqi(co_1h, co_24h, no2_1h, no2_24h, o3_1h, o3_8h,
                             so2_1h, so2_24h, pm10_24h, pm2_5_24h);
 #endif // end MAINLAND_CHINA_AQI
 #ifdef SINGAPORE_PSI
-  float co_8h     = getAvgConc(p.components.co,     8);
-  float no2_1h    = getAvgConc(p.components.no2,    1);
-  float o3_1h     = getAvgConc(p.components.o3,     1);
-  float o3_8h     = getAvgConc(p.components.o3,     8);
-  float so2_24h   = getAvgConc(p.components.so2,   24);
-  float pm10_24h  = getAvgConc(p.components.pm10,  24);
-  float pm2_5_24h = getAvgConc(p.components.pm2_5, 24);
+  float co_8h     = getAvgConc(tl, p.components.co,     8);
+  float no2_1h    = getAvgConc(tl, p.components.no2,    1);
+  float o3_1h     = getAvgConc(tl, p.components.o3,     1);
+  float o3_8h     = getAvgConc(tl, p.components.o3,     8);
+  float so2_24h   = getAvgConc(tl, p.components.so2,   24);
+  float pm10_24h  = getAvgConc(tl, p.components.pm10,  24);
+  float pm2_5_24h = getAvgConc(tl, p.components.pm2_5, 24);
   return singapore_psi(co_8h, no2_1h, o3_1h, o3_8h, so2_24h, pm10_24h,
                        pm2_5_24h);
 #endif // end SINGAPORE_PSI
 #ifdef SOUTH_KOREA_CAI
-  float co_1h     = getAvgConc(p.components.co,     1);
-  float no2_1h    = getAvgConc(p.components.no2,    1);
-  float o3_1h     = getAvgConc(p.components.o3,     1);
-  float so2_1h    = getAvgConc(p.components.so2,    1);
-  float pm10_24h  = getAvgConc(p.components.pm10,  24);
-  float pm2_5_24h = getAvgConc(p.components.pm2_5, 24);
+  float co_1h     = getAvgConc(tl, p.components.co,     1);
+  float no2_1h    = getAvgConc(tl, p.components.no2,    1);
+  float o3_1h     = getAvgConc(tl, p.components.o3,     1);
+  float so2_1h    = getAvgConc(tl, p.components.so2,    1);
+  float pm10_24h  = getAvgConc(tl, p.components.pm10,  24);
+  float pm2_5_24h = getAvgConc(tl, p.components.pm2_5, 24);
   return south_korea_cai(co_1h, no2_1h, o3_1h, so2_1h, pm10_24h, pm2_5_24h);
 #endif // end SOUTH_KOREA_CAI
 #ifdef UNITED_KINGDOM_DAQI
-  float no2_1h    = getAvgConc(p.components.no2,    1);
-  float o3_8h     = getAvgConc(p.components.o3,     8);
-  float so2_15min = getAvgConc(p.components.so2,    1); // OWM only gives hourly
-  float pm10_24h  = getAvgConc(p.components.pm10,  24);
-  float pm2_5_24h = getAvgConc(p.components.pm2_5, 24);
+  float no2_1h    = getAvgConc(tl, p.components.no2,    1);
+  float o3_8h     = getAvgConc(tl, p.components.o3,     8);
+  float so2_15min = getAvgConc(tl, p.components.so2,    1); // OWM only gives hourly
+  float pm10_24h  = getAvgConc(tl, p.components.pm10,  24);
+  float pm2_5_24h = getAvgConc(tl, p.components.pm2_5, 24);
   return united_kingdom_daqi(no2_1h, o3_8h, so2_15min, pm10_24h, pm2_5_24h);
 #endif // end UNITED_KINGDOM_DAQI
 #ifdef UNITED_STATES_AQI
-  float co_8h     = getAvgConc(p.components.co,     8);
-  float no2_1h    = getAvgConc(p.components.no2,    1);
-  float o3_1h     = getAvgConc(p.components.o3,     1);
-  float o3_8h     = getAvgConc(p.components.o3,     8);
-  float so2_1h    = getAvgConc(p.components.so2,    1);
-  float so2_24h   = getAvgConc(p.components.so2,   24);
-  float pm10_24h  = getAvgConc(p.components.pm10,  24);
-  float pm2_5_24h = getAvgConc(p.components.pm2_5, 24);
+  float co_8h     = getAvgConc(tl, p.components.co,     8);
+  float no2_1h    = getAvgConc(tl, p.components.no2,    1);
+  float o3_1h     = getAvgConc(tl, p.components.o3,     1);
+  float o3_8h     = getAvgConc(tl, p.components.o3,     8);
+  float so2_1h    = getAvgConc(tl, p.components.so2,    1);
+  float so2_24h   = getAvgConc(tl, p.components.so2,   24);
+  float pm10_24h  = getAvgConc(tl, p.components.pm10,  24);
+  float pm2_5_24h = getAvgConc(tl, p.components.pm2_5, 24);
   return united_states_aqi(co_8h, no2_1h, o3_1h, o3_8h, so2_1h, so2_24h,
                            pm10_24h, pm2_5_24h);
 #endif // end UNITED_STATES_AQI
+} // end computeAQI
+
+/* Returns the AQI of the air pollution history, memoized across wakes.
+ */
+int getAQI(const owm_resp_air_pollution_t &p, const timeline_t &tl)
+{
+  // the samples of the last OWM_NUM_AIR_POLLUTION hours, where they fall
+  int8_t window[OWM_NUM_AIR_POLLUTION];
+  for (int h = 0; h < OWM_NUM_AIR_POLLUTION; ++h)
+  {
+    int s = tl.slot(h - (OWM_NUM_AIR_POLLUTION - 1));
+    window[h] = (s >= 0) ? tl.air[s] : -1;
+  }
+  // getAvgConc reads the concentrations of the samples in the window, which
+  // the times of the samples decide
+  uint32_t key = fnv1a(&p.components, sizeof(p.components));
+  key = fnv1a(p.dt, sizeof(p.dt), key);
+  key = fnv1a(window, sizeof(window), key);
+  uintptr_t cached;
+  if (memoGet(MEMO_AQI, key, cached))
+  {
+    return static_cast<int>(cached);
+  }
+  int aqi = computeAQI(p, tl);
+  memoPut(MEMO_AQI, key, static_cast<uintptr_t>(aqi));
+  return aqi;
 } // end getAQI
 
 /* Returns the descriptor text for the given AQI and the selected AQI 
@@ -547,8 +632,8 @@ const uint8_t *getWiFiBitmap16(int rssi)
   }
 } // end getWiFiBitmap24
 
-/* Takes the daily weather forecast (from OpenWeatherMap API 
- * response) and returns a pointer to the icon's 64x64 bitmap.
+/* Takes the features of a day of the daily weather forecast and returns a
+ * pointer to the icon's 64x64 bitmap.
  *
  * Uses multiple factors to return more detailed icons than the simple icon 
  * catagories that OpenWeatherMap provides.
@@ -559,15 +644,8 @@ const uint8_t *getWiFiBitmap16(int rssi)
  *   https://openweathermap.org/weather-conditions
  *   https://www.weather.gov/ajk/ForecastTerms
  */
-const uint8_t *getForecastBitmap64(const owm_daily_t &daily)
+static const uint8_t *forecastBitmap64(int id, bool cloudy, bool windy)
 {
-  int id = daily.weather.id;
-  // always using the day icon for weather forecast
-  // bool day = current.weather.icon.endsWith("d");
-  bool cloudy = daily.clouds > 60.25; // partly cloudy / partly sunny
-  bool windy = (daily.wind_speed.in<MetersPerSecond>() >= 8.9 /*m/s*/
-                || daily.wind_gust.in<MetersPerSecond>() >= 11.2 /*m/s*/);
-
   switch (id)
   {
   // Group 2xx: Thunderstorm
@@ -686,37 +764,37 @@ const uint8_t *getForecastBitmap64(const owm_daily_t &daily)
     if (id >= 800 && id < 900) {return wi_cloudy_64x64;}
     return wi_na_64x64;
   }
+} // end forecastBitmap64
+
+/* Returns the 64x64 bitmap for day i of the daily forecast.
+ */
+const uint8_t *getForecastBitmap64(const daily_store_t &daily, int i)
+{
+  int id = daily.weather_id[i];
+  // always using the day icon for weather forecast
+  // bool day = current.weather.icon[2] == 'd';
+  bool cloudy = daily.clouds[i] > 60.25; // partly cloudy / partly sunny
+  bool windy = (daily.windSpeedAt(i).in<MetersPerSecond>() >= 8.9 /*m/s*/
+                || daily.windGustAt(i).in<MetersPerSecond>() >= 11.2 /*m/s*/);
+
+  return forecastBitmap64(id, cloudy, windy);
 } // end getForecastBitmap64
 
-/* Takes the current weather and today's daily weather forcast (from 
- * OpenWeatherMap API response) and returns a pointer to the icon's 196x196 
- * bitmap.
+/* Takes the features of the current weather and returns a pointer to the
+ * icon's 196x196 bitmap.
  *
  * Uses multiple factors to return more detailed icons than the simple icon 
  * catagories that OpenWeatherMap provides.
  * 
- * The daily weather forcast of today is needed for moonrise and moonset times.
- * 
  * Last Updated: June 26, 2022
  * 
  * References: 
  *   https://openweathermap.org/weather-conditions
  *   https://www.weather.gov/ajk/ForecastTerms
  */
-const uint8_t *getCurrentConditionsBitmap196(const owm_current_t &current,
-                                             const owm_daily_t   &today)
+static const uint8_t *conditionsBitmap196(int id, bool day, bool moon,
+                                          bool cloudy, bool windy)
 {
-  int id = current.weather.id;
-  // OpenWeatherMap indicates sun is up with d otherwise n for night
-  bool day = current.weather.icon.endsWith("d");
-  // moon is out if current time is after moonrise but before moonset
-  // OR if moonrises after moonset and the current time is after moonrise
-  bool moon = (current.dt >= today.moonrise && current.dt < today.moonset)
-           || (today.moonrise > today.moonset && current.dt >= today.moonrise);
-  bool cloudy = current.clouds > 60.25; // partly cloudy / partly sunny
-  bool windy = (current.wind_speed.in<MetersPerSecond>() >= 8.9 /*m/s*/
-                || current.wind_gust.in<MetersPerSecond>() >= 11.2 /*m/s*/);
-
   switch (id)
   {
   // Group 2xx: Thunderstorm
@@ -855,6 +933,27 @@ const uint8_t *getCurrentConditionsBitmap196(const owm_current_t &current,
     if (id >= 800 && id < 900) {return wi_cloudy_196x196;}
     return wi_na_196x196;
   }
+} // end conditionsBitmap196
+
+/* Returns the 196x196 bitmap for the current conditions.
+ *
+ * The daily weather forcast of today is needed for moonrise and moonset times.
+ */
+const uint8_t *getCurrentConditionsBitmap196(const owm_current_t &current,
+                                             const owm_daily_t   &today)
+{
+  int id = current.weather.id;
+  // OpenWeatherMap indicates sun is up with d otherwise n for night
+  bool day = current.weather.icon[2] == 'd';
+  // moon is out if current time is after moonrise but before moonset
+  // OR if moonrises after moonset and the current time is after moonrise
+  bool moon = (current.dt >= today.moonrise && current.dt < today.moonset)
+           || (today.moonrise > today.moonset && current.dt >= today.moonrise);
+  bool cloudy = current.clouds > 60.25; // partly cloudy / partly sunny
+  bool windy = (current.wind_speed.in<MetersPerSecond>() >= 8.9 /*m/s*/
+                || current.wind_gust.in<MetersPerSecond>() >= 11.2 /*m/s*/);
+
+  return conditionsBitmap196(id, day, moon, cloudy, windy);
 } // end getCurrentConditionsBitmap196
 
 /* Returns a 32x32 bitmap for a given alert.
@@ -954,11 +1053,11 @@ const uint8_t *getAlertBitmap48(owm_alerts_t &alert)
  *
  * Note: This function is case sensitive.
  */
-bool containsTerminology(const String s, const std::vector<String> &terminology)
+bool containsTerminology(const char *s, const std::vector<String> &terminology)
 {
   for (const String &term : terminology)
   {
-    if (s.indexOf(term) >= 0)
+    if (strstr(s, term.c_str()) != nullptr)
     {
       return true;
     }
@@ -971,105 +1070,112 @@ bool containsTerminology(const String s, const std::vector<String> &terminology)
  *
  * Weather alert terminology is defined in the included locale header.
  */
-enum alert_category getAlertCategory(owm_alerts_t &alert)
+static enum alert_category alertCategory(const char *event)
 {
-  if (containsTerminology(alert.event, TERM_SMOG))
+  if (containsTerminology(event, TERM_SMOG))
   {
     return alert_category::SMOG;
   }
-  if (containsTerminology(alert.event, TERM_SMOKE))
+  if (containsTerminology(event, TERM_SMOKE))
   {
     return alert_category::SMOKE;
   }
-  if (containsTerminology(alert.event, TERM_FOG))
+  if (containsTerminology(event, TERM_FOG))
   {
     return alert_category::FOG;
   }
-  if (containsTerminology(alert.event, TERM_METEOR))
+  if (containsTerminology(event, TERM_METEOR))
   {
     return alert_category::METEOR;
   }
-  if (containsTerminology(alert.event, TERM_NUCLEAR))
+  if (containsTerminology(event, TERM_NUCLEAR))
   {
     return alert_category::NUCLEAR;
   }
-  if (containsTerminology(alert.event, TERM_BIOHAZARD))
+  if (containsTerminology(event, TERM_BIOHAZARD))
   {
     return alert_category::BIOHAZARD;
   }
-  if (containsTerminology(alert.event, TERM_EARTHQUAKE))
+  if (containsTerminology(event, TERM_EARTHQUAKE))
   {
     return alert_category::EARTHQUAKE;
   }
-  if (containsTerminology(alert.event, TERM_TSUNAMI))
+  if (containsTerminology(event, TERM_TSUNAMI))
   {
     return alert_category::TSUNAMI;
   }
-  if (containsTerminology(alert.event, TERM_FIRE))
+  if (containsTerminology(event, TERM_FIRE))
   {
     return alert_category::FIRE;
   }
-  if (containsTerminology(alert.event, TERM_HEAT))
+  if (containsTerminology(event, TERM_HEAT))
   {
     return alert_category::HEAT;
   }
-  if (containsTerminology(alert.event, TERM_WINTER))
+  if (containsTerminology(event, TERM_WINTER))
   {
     return alert_category::WINTER;
   }
-  if (containsTerminology(alert.event, TERM_LIGHTNING))
+  if (containsTerminology(event, TERM_LIGHTNING))
   {
     return alert_category::LIGHTNING;
   }
-  if (containsTerminology(alert.event, TERM_SANDSTORM))
+  if (containsTerminology(event, TERM_SANDSTORM))
   {
     return alert_category::SANDSTORM;
   }
-  if (containsTerminology(alert.event, TERM_FLOOD))
+  if (containsTerminology(event, TERM_FLOOD))
   {
     return alert_category::FLOOD;
   }
-  if (containsTerminology(alert.event, TERM_VOLCANO))
+  if (containsTerminology(event, TERM_VOLCANO))
   {
     return alert_category::VOLCANO;
   }
-  if (containsTerminology(alert.event, TERM_AIR_QUALITY))
+  if (containsTerminology(event, TERM_AIR_QUALITY))
   {
     return alert_category::AIR_QUALITY;
   }
-  if (containsTerminology(alert.event, TERM_TORNADO))
+  if (containsTerminology(event, TERM_TORNADO))
   {
     return alert_category::TORNADO;
   }
-  if (containsTerminology(alert.event, TERM_SMALL_CRAFT_ADVISORY))
+  if (containsTerminology(event, TERM_SMALL_CRAFT_ADVISORY))
   {
     return alert_category::SMALL_CRAFT_ADVISORY;
   }
-  if (containsTerminology(alert.event, TERM_GALE_WARNING))
+  if (containsTerminology(event, TERM_GALE_WARNING))
   {
     return alert_category::GALE_WARNING;
   }
-  if (containsTerminology(alert.event, TERM_STORM_WARNING))
+  if (containsTerminology(event, TERM_STORM_WARNING))
   {
     return alert_category::STORM_WARNING;
   }
-  if (containsTerminology(alert.event, TERM_HURRICANE_WARNING))
+  if (containsTerminology(event, TERM_HURRICANE_WARNING))
   {
     return alert_category::HURRICANE_WARNING;
   }
-  if (containsTerminology(alert.event, TERM_HURRICANE))
+  if (containsTerminology(event, TERM_HURRICANE))
   {
     return alert_category::HURRICANE;
   }
-  if (containsTerminology(alert.event, TERM_DUST))
+  if (containsTerminology(event, TERM_DUST))
   {
     return alert_category::DUST;
   }
-  if (containsTerminology(alert.event, TERM_STRONG_WIND))
+  if (containsTerminology(event, TERM_STRONG_WIND))
   {
     return alert_category::STRONG_WIND;
   }
   return alert_category::NOT_FOUND;
+} // end alertCategory
+
+/* Returns the category of an alert.
+ */
+enum alert_category getAlertCategory(owm_alerts_t &alert)
+{
+  return alertCategory(alert.event);
 } // end getAlertCategory
 
 #ifdef WIND_DIRECTIONS_CARDINAL
@@ -0,0 +1,133 @@
+/* Fetch planner for esp32-weather-epd.
+ * Copyright (C) 2023  Luke Marzen
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <Arduino.h>
+#include <time.h>
+
+#include "config.h"
+#include "fetch_plan.h"
+
+/* The sections of the last successful fetches, as they are drawn. Current
+ * conditions are not kept, they are fetched every wake. About 1.2 KB.
+ */
+struct fetch_model_t
+{
+  int64_t                  hourlyFetched;       // Unix, UTC, 0 if never
+  int64_t                  dailyFetched;
+  int64_t                  airPollutionFetched;
+  hourly_store_t           hourly;
+  daily_store_t            daily;
+  owm_daily_t              today;               // daily[0], drawn in full
+  air_history_t            airHistory;
+};
+
+RTC_DATA_ATTR static fetch_model_t fetchModel = {};
+
+/* Returns true if t and now fall on different local calendar days.
+ */
+static bool otherDay(int64_t t, int64_t now)
+{
+  time_t ts = t;
+  tm a;
+  localtime_r(&ts, &a);
+  ts = now;
+  tm b;
+  localtime_r(&ts, &b);
+  return a.tm_yday != b.tm_yday || a.tm_year != b.tm_year;
+} // end otherDay
+
+uint8_t planFetch(int64_t now, bool partialForecast)
+{
+  const fetch_model_t &m = fetchModel;
+  uint8_t plan = 0;
+  // the first hour of the hourly forecast is the current hour
+  if (!partialForecast || m.hourlyFetched == 0
+      || now >= m.hourly.dt(0) + 3600)
+  {
+    plan |= FETCH_HOURLY;
+  }
+  if (!partialForecast || m.dailyFetched == 0
+      || now - m.dailyFetched >= 3600LL * DAILY_REFRESH_INTERVAL
+      || otherDay(m.today.dt, now))
+  {
+    plan |= FETCH_DAILY;
+  }
+  // the history only gains an hour once an hour
+  if (missingAirHours(m.airHistory, now) > 0
+      && (m.airPollutionFetched == 0
+          || now - m.airPollutionFetched
+             >= 3600LL * AIR_POLLUTION_REFRESH_INTERVAL))
+  {
+    plan |= FETCH_AIR_POLLUTION;
+  }
+
+  Serial.print("Fetch plan: current");
+  Serial.print(plan & FETCH_HOURLY ? ", hourly" : "");
+  Serial.print(plan & FETCH_DAILY ? ", daily" : "");
+  Serial.println(plan & FETCH_AIR_POLLUTION ? ", air pollution" : "");
+  if (plan != FETCH_ALL)
+  {
+    Serial.printf("  From RTC memory:%s%s%s\n",
+                  plan & FETCH_HOURLY ? "" : " hourly",
+                  plan & FETCH_DAILY ? "" : " daily",
+                  plan & FETCH_AIR_POLLUTION ? "" : " air pollution");
+  }
+  return plan;
+} // end planFetch
+
+int airPollutionHours(int64_t now)
+{
+  return missingAirHours(fetchModel.airHistory, now);
+} // end airPollutionHours
+
+void mergeFetched(uint8_t fetched, int64_t now, owm_resp_onecall_t &onecall,
+                  owm_resp_air_pollution_t &air, hourly_store_t &hourly,
+                  daily_store_t &daily)
+{
+  fetch_model_t &m = fetchModel;
+  if (fetched & FETCH_HOURLY)
+  {
+    packHourly(onecall.hourly, OWM_NUM_HOURLY, m.hourly);
+    m.hourlyFetched = now;
+  }
+  if (fetched & FETCH_DAILY)
+  {
+    packDaily(onecall.daily, OWM_NUM_DAILY, m.daily);
+    m.today = onecall.daily[0];
+    m.dailyFetched = now;
+  }
+  else
+  {
+    onecall.daily[0] = m.today;
+  }
+  if (fetched & FETCH_AIR_POLLUTION)
+  {
+    int hours = missingAirHours(m.airHistory, now);
+    if (hours == OWM_NUM_AIR_POLLUTION)
+    { // the whole history was fetched, rebuild it
+      m.airHistory.count = 0;
+    }
+    int pushed = pushAirHistory(air, m.airHistory);
+    m.airPollutionFetched = now;
+    Serial.printf("Air pollution history: %d of %d hour(s) requested were "
+                  "received, %d stored\n",
+                  pushed, hours, m.airHistory.count);
+  }
+  unpackAirHistory(m.airHistory, air);
+  hourly = m.hourly;
+  daily  = m.daily;
+} // end mergeFetched
@@ -0,0 +1,225 @@
+/* Compact forecast store for esp32-weather-epd.
+ * Copyright (C) 2023  Luke Marzen
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <cmath>
+
+#include "forecast_store.h"
+
+/* Rounds v to the nearest integer and clamps it to [lo, hi].
+ */
+static inline long quantize(float v, long lo, long hi)
+{
+  if (std::isnan(v))
+  {
+    return lo;
+  }
+  return std::min(std::max(lroundf(v), lo), hi);
+} // end quantize
+
+static inline int16_t encodeTemp(Quantity<Kelvin> t)
+{
+  return quantize(t.val() * 100 - STORE_TEMP_BIAS, INT16_MIN, INT16_MAX);
+} // end encodeTemp
+
+static inline Quantity<Kelvin> decodeTemp(int16_t t)
+{
+  return (t + STORE_TEMP_BIAS) / 100.f;
+} // end decodeTemp
+
+Quantity<Kelvin> hourly_store_t::tempAt(int i) const
+{
+  return decodeTemp(temp[i]);
+} // end hourly_store_t::tempAt
+
+/* Finds the lowest and highest temperature of the first n hours.
+ *
+ * Runs over the int16_t column only, converting just the two results. This is
+ * valid because every temperature scale is monotonic in Kelvin.
+ */
+void hourly_store_t::tempRange(int n, Quantity<Kelvin> &lo,
+                               Quantity<Kelvin> &hi) const
+{
+  int16_t tMin = temp[0];
+  int16_t tMax = temp[0];
+  for (int i = 1; i < n; ++i)
+  {
+    tMin = std::min(tMin, temp[i]);
+    tMax = std::max(tMax, temp[i]);
+  }
+  lo = decodeTemp(tMin);
+  hi = decodeTemp(tMax);
+  return;
+} // end hourly_store_t::tempRange
+
+Quantity<Kelvin> daily_store_t::tempMinAt(int i) const
+{
+  return decodeTemp(temp_min[i]);
+} // end daily_store_t::tempMinAt
+
+Quantity<Kelvin> daily_store_t::tempMaxAt(int i) const
+{
+  return decodeTemp(temp_max[i]);
+} // end daily_store_t::tempMaxAt
+
+/* Returns the number of leading entries of a forecast whose times increase.
+ * Providers that forecast fewer hours or days than there is room for leave the
+ * remaining entries zeroed.
+ */
+template<typename T>
+static int forecastLength(const T *f, int n)
+{
+  int len = (n > 0) ? 1 : 0;
+  while (len < n && f[len].dt > f[len - 1].dt)
+  {
+    ++len;
+  }
+  return len;
+} // end forecastLength
+
+/* Packs the first n entries of hourly into the store.
+ */
+void packHourly(const owm_hourly_t *hourly, int n, hourly_store_t &s)
+{
+  n = forecastLength(hourly, std::min(n, OWM_NUM_HOURLY));
+  s.base_dt = static_cast<uint32_t>(hourly[0].dt);
+  s.count   = n;
+  for (int i = 0; i < n; ++i)
+  {
+    s.hour[i]    = quantize((hourly[i].dt - hourly[0].dt) / 3600.f, 0, 255);
+    s.temp[i]    = encodeTemp(hourly[i].temp);
+    s.pop[i]     = quantize(hourly[i].pop * 100, 0, 100);
+    s.rain_1h[i] = quantize(hourly[i].rain_1h * 100, 0, UINT16_MAX);
+    s.snow_1h[i] = quantize(hourly[i].snow_1h * 100, 0, UINT16_MAX);
+  }
+  return;
+} // end packHourly
+
+/* Packs the first n entries of daily into the store.
+ */
+void packDaily(const owm_daily_t *daily, int n, daily_store_t &s)
+{
+  n = forecastLength(daily, std::min(n, OWM_NUM_DAILY));
+  s.base_dt = static_cast<uint32_t>(daily[0].dt);
+  s.count   = n;
+  for (int i = 0; i < n; ++i)
+  {
+    s.day[i]        = quantize((daily[i].dt - daily[0].dt) / 86400.f, 0, 255);
+    s.temp_min[i]   = encodeTemp(daily[i].temp.min);
+    s.temp_max[i]   = encodeTemp(daily[i].temp.max);
+    s.weather_id[i] = quantize(daily[i].weather.id, 0, UINT16_MAX);
+    s.clouds[i]     = quantize(daily[i].clouds, 0, 100);
+    s.pop[i]        = quantize(daily[i].pop * 100, 0, 100);
+    s.wind_speed[i] = quantize(
+                daily[i].wind_speed.in<MetersPerSecond>() * 100, 0, UINT16_MAX);
+    s.wind_gust[i]  = quantize(
+                daily[i].wind_gust.in<MetersPerSecond>() * 100, 0, UINT16_MAX);
+  }
+  return;
+} // end packDaily
+
+/* Returns the number of hours of air pollution history to fetch to bring the
+ * history up to date at the time now, ending with the current hour. That is
+ * the hours since its newest one, 0 if no hour has passed since, or every
+ * hour, OWM_NUM_AIR_POLLUTION, if the history is empty or older than that.
+ *
+ * A history that is not full is filled forward rather than fetched again: the
+ * API may lag by an hour and return fewer hours than asked for, every time.
+ */
+int missingAirHours(const air_history_t &s, int64_t now)
+{
+  int64_t elapsed = now - static_cast<int64_t>(s.newest_dt);
+  if (s.count == 0 || elapsed < 0
+      || elapsed >= 3600LL * OWM_NUM_AIR_POLLUTION)
+  {
+    return OWM_NUM_AIR_POLLUTION;
+  }
+  return elapsed / 3600;
+} // end missingAirHours
+
+/* Appends the hours of r that are newer than the newest in the history, in
+ * order, overwriting the oldest. An hour that does not follow the newest, a
+ * gap in the history, clears what came before it. Hours of r with no time,
+ * those a provider left zeroed, are skipped. The newest hour is replaced, its
+ * values may have been revised since.
+ *
+ * Returns the number of hours appended or replaced.
+ */
+int pushAirHistory(const owm_resp_air_pollution_t &r, air_history_t &s)
+{
+  int pushed = 0;
+  for (int i = 0; i < OWM_NUM_AIR_POLLUTION; ++i)
+  {
+    int64_t dt = r.dt[i];
+    if (dt <= 0 || (s.count > 0 && dt < s.newest_dt))
+    {
+      continue;
+    }
+    if (s.count == 0 || dt != s.newest_dt)
+    {
+      if (s.count > 0 && dt != s.newest_dt + 3600LL)
+      {
+        s.count = 0;
+      }
+      s.head = (s.head + 1) % OWM_NUM_AIR_POLLUTION;
+      s.count = std::min(s.count + 1, OWM_NUM_AIR_POLLUTION);
+      s.newest_dt = static_cast<uint32_t>(dt);
+    }
+    const owm_components_t &c = r.components;
+    int h = s.head;
+    s.aqi[h]   = quantize(r.main_aqi[i], 0, UINT8_MAX);
+    s.co[h]    = quantize(c.co[i], 0, UINT16_MAX);
+    s.no[h]    = quantize(c.no[i] * 10, 0, UINT16_MAX);
+    s.no2[h]   = quantize(c.no2[i] * 10, 0, UINT16_MAX);
+    s.o3[h]    = quantize(c.o3[i] * 10, 0, UINT16_MAX);
+    s.so2[h]   = quantize(c.so2[i] * 10, 0, UINT16_MAX);
+    s.pm2_5[h] = quantize(c.pm2_5[i] * 10, 0, UINT16_MAX);
+    s.pm10[h]  = quantize(c.pm10[i] * 10, 0, UINT16_MAX);
+    s.nh3[h]   = quantize(c.nh3[i] * 10, 0, UINT16_MAX);
+    ++pushed;
+  }
+  return pushed;
+} // end pushAirHistory
+
+/* Unpacks the history into r as the Air Pollution API returns it, oldest hour
+ * first and the newest at OWM_NUM_AIR_POLLUTION - 1. Hours the history does
+ * not have are zeroed. r.coord is left as it is.
+ */
+void unpackAirHistory(const air_history_t &s, owm_resp_air_pollution_t &r)
+{
+  owm_coord_t coord = r.coord;
+  r = {};
+  r.coord = coord;
+  owm_components_t &c = r.components;
+  for (int k = 0; k < s.count; ++k)
+  {
+    // k hours before the newest
+    int i = OWM_NUM_AIR_POLLUTION - 1 - k;
+    int h = (s.head + OWM_NUM_AIR_POLLUTION - k) % OWM_NUM_AIR_POLLUTION;
+    r.dt[i]       = s.newest_dt - 3600LL * k;
+    r.main_aqi[i] = s.aqi[h];
+    c.co[i]       = s.co[h];
+    c.no[i]       = s.no[h] / 10.f;
+    c.no2[i]      = s.no2[h] / 10.f;
+    c.o3[i]       = s.o3[h] / 10.f;
+    c.so2[i]      = s.so2[h] / 10.f;
+    c.pm2_5[i]    = s.pm2_5[h] / 10.f;
+    c.pm10[i]     = s.pm10[h] / 10.f;
+    c.nh3[i]      = s.nh3[h] / 10.f;
+  }
+  return;
+} // end unpackAirHistory
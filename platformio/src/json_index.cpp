@@ -0,0 +1,475 @@
+/* Lazy JSON index for esp32-weather-epd.
+ * Copyright (C) 2023  Luke Marzen
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <Arduino.h>
+
+#include "arena.h"
+#include "json_index.h"
+
+// Initial size of the body buffer, bytes. It doubles as needed.
+#define JSON_INDEX_BUFFER_SIZE (8 * 1024)
+// Deepest nesting of objects and arrays that can be indexed.
+#define JSON_INDEX_MAX_DEPTH   32
+
+JsonIndex::JsonIndex()
+  : _buf(nullptr), _len(0), _bufCap(0), _tok(nullptr), _count(0), _tokCap(0)
+{
+} // end JsonIndex::JsonIndex
+
+/* Frees the index, then the buffer, so the wake arena gets both back.
+ */
+JsonIndex::~JsonIndex()
+{
+  wakeArena.deallocate(_tok);
+  wakeArena.deallocate(_buf);
+} // end JsonIndex::~JsonIndex
+
+DeserializationError JsonIndex::read(Stream &json)
+{
+  DeserializationError error = buffer(json);
+  if (error)
+  {
+    return error;
+  }
+  return index();
+} // end JsonIndex::read
+
+/* Reads the stream into the buffer up to the end of the root object or array.
+ *
+ * Only strings and nesting are followed here, which is enough to tell where
+ * the document ends. Stopping there, instead of at the end of the stream,
+ * avoids waiting out the stream's timeout for bytes that will never come.
+ */
+DeserializationError JsonIndex::buffer(Stream &json)
+{
+  int  depth    = 0;
+  bool inString = false;
+  bool escape   = false;
+  while (true)
+  {
+    if (_len + 1 >= _bufCap)
+    {
+      size_t cap = std::max<size_t>(2 * _bufCap, JSON_INDEX_BUFFER_SIZE);
+      char *buf = static_cast<char *>(wakeArena.reallocate(_buf, cap));
+      if (buf == nullptr)
+      {
+        return DeserializationError::NoMemory;
+      }
+      _buf = buf;
+      _bufCap = cap;
+    }
+
+    size_t room = _bufCap - _len - 1;
+    size_t want = std::min(room, static_cast<size_t>(
+                                          std::max(json.available(), 1)));
+    size_t n = json.readBytes(_buf + _len, want);
+    if (n == 0)
+    {
+      return _len == 0 ? DeserializationError::EmptyInput
+                       : DeserializationError::IncompleteInput;
+    }
+
+    for (size_t i = _len; i < _len + n; ++i)
+    {
+      char c = _buf[i];
+      if (inString)
+      {
+        if (escape)
+        {
+          escape = false;
+        }
+        else if (c == '\\')
+        {
+          escape = true;
+        }
+        else if (c == '"')
+        {
+          inString = false;
+        }
+      }
+      else if (c == '"')
+      {
+        inString = true;
+      }
+      else if (c == '{' || c == '[')
+      {
+        ++depth;
+      }
+      else if ((c == '}' || c == ']') && --depth == 0)
+      { // end of the document, anything after it is ignored
+        _len = i + 1;
+        _buf[_len] = '\0';
+        // hand back the unused part of the buffer
+        _buf = static_cast<char *>(wakeArena.reallocate(_buf, _len + 1));
+        _bufCap = _len + 1;
+        return DeserializationError::Ok;
+      }
+    }
+    _len += n;
+  }
+} // end JsonIndex::buffer
+
+/* Appends a token. Returns false if out of memory.
+ */
+bool JsonIndex::push(uint32_t key, uint32_t value)
+{
+  if (_count == _tokCap)
+  {
+    size_t cap = std::max<size_t>(2 * _tokCap, _len / 16 + 16);
+    json_token_t *tok = static_cast<json_token_t *>(
+                   wakeArena.reallocate(_tok, cap * sizeof(json_token_t)));
+    if (tok == nullptr)
+    {
+      return false;
+    }
+    _tok = tok;
+    _tokCap = cap;
+  }
+  _tok[_count++] = {key, value, 1};
+  return true;
+} // end JsonIndex::push
+
+static inline bool isDelimiter(char c)
+{
+  return c == ',' || c == '}' || c == ']' || c == ':' || c == ' '
+      || c == '\t' || c == '\n' || c == '\r' || c == '\0';
+}
+
+/* Indexes the buffer in one pass. Every value gets a token holding its offset
+ * and the offset of its key. Containers get the size of their subtree once
+ * they are closed.
+ */
+DeserializationError JsonIndex::index()
+{
+  uint32_t open[JSON_INDEX_MAX_DEPTH]; // tokens of the open containers
+  bool     isObject[JSON_INDEX_MAX_DEPTH];
+  int      depth     = 0;
+  bool     expectKey = false;
+  uint32_t key       = JSON_NO_KEY;
+
+  for (size_t i = 0; i < _len; ++i)
+  {
+    char c = _buf[i];
+    switch (c)
+    {
+    case ' ': case '\t': case '\n': case '\r': case ':':
+      break;
+    case ',':
+      expectKey = depth > 0 && isObject[depth - 1];
+      break;
+    case '"':
+    {
+      size_t start = i;
+      for (++i; i < _len && _buf[i] != '"'; ++i)
+      {
+        if (_buf[i] == '\\')
+        {
+          ++i;
+        }
+      }
+      if (i >= _len)
+      {
+        return DeserializationError::IncompleteInput;
+      }
+      if (expectKey)
+      {
+        key = start + 1;
+        expectKey = false;
+      }
+      else
+      {
+        if (!push(key, start))
+        {
+          return DeserializationError::NoMemory;
+        }
+        key = JSON_NO_KEY;
+      }
+      break;
+    }
+    case '{': case '[':
+      if (depth == JSON_INDEX_MAX_DEPTH)
+      {
+        return DeserializationError::TooDeep;
+      }
+      if (!push(key, i))
+      {
+        return DeserializationError::NoMemory;
+      }
+      key = JSON_NO_KEY;
+      open[depth] = _count - 1;
+      isObject[depth] = (c == '{');
+      ++depth;
+      expectKey = (c == '{');
+      break;
+    case '}': case ']':
+      if (depth == 0)
+      {
+        return DeserializationError::InvalidInput;
+      }
+      --depth;
+      _tok[open[depth]].next = _count - open[depth];
+      expectKey = false;
+      break;
+    default: // number, true, false or null
+      if (!push(key, i))
+      {
+        return DeserializationError::NoMemory;
+      }
+      key = JSON_NO_KEY;
+      while (!isDelimiter(_buf[i + 1]))
+      {
+        ++i;
+      }
+      break;
+    }
+  }
+
+  if (depth != 0 || _count == 0)
+  {
+    return DeserializationError::IncompleteInput;
+  }
+  return DeserializationError::Ok;
+} // end JsonIndex::index
+
+const char *JsonIndex::Value::text() const
+{
+  return _index->_buf + _index->_tok[_tok].value;
+} // end JsonIndex::Value::text
+
+bool JsonIndex::Value::isNull() const
+{
+  return _tok < 0 || *text() == 'n';
+} // end JsonIndex::Value::isNull
+
+bool JsonIndex::Value::isObject() const
+{
+  return _tok >= 0 && *text() == '{';
+} // end JsonIndex::Value::isObject
+
+bool JsonIndex::Value::isArray() const
+{
+  return _tok >= 0 && *text() == '[';
+} // end JsonIndex::Value::isArray
+
+/* Returns the first member or element, or a null value if there is none.
+ */
+JsonIndex::Value JsonIndex::Value::first() const
+{
+  if (!isObject() && !isArray())
+  {
+    return Value();
+  }
+  int end = _tok + _index->_tok[_tok].next;
+  return Value(_index, (_tok + 1 < end) ? _tok + 1 : -1, end);
+} // end JsonIndex::Value::first
+
+/* Returns the next sibling, or a null value after the last one.
+ */
+JsonIndex::Value JsonIndex::Value::next() const
+{
+  if (_tok < 0)
+  {
+    return Value();
+  }
+  int n = _tok + _index->_tok[_tok].next;
+  return Value(_index, (n < _end) ? n : -1, _end);
+} // end JsonIndex::Value::next
+
+int JsonIndex::Value::size() const
+{
+  int n = 0;
+  for (Value v = first(); v._tok >= 0; v = v.next())
+  {
+    ++n;
+  }
+  return n;
+} // end JsonIndex::Value::size
+
+JsonIndex::Value JsonIndex::Value::operator[](const char *key) const
+{
+  if (!isObject())
+  {
+    return Value();
+  }
+  size_t len = strlen(key);
+  for (Value v = first(); v._tok >= 0; v = v.next())
+  {
+    const char *k = _index->_buf + _index->_tok[v._tok].key;
+    if (strncmp(k, key, len) == 0 && k[len] == '"')
+    {
+      return v;
+    }
+  }
+  return Value();
+} // end JsonIndex::Value::operator[]
+
+JsonIndex::Value JsonIndex::Value::operator[](int i) const
+{
+  if (!isArray())
+  {
+    return Value();
+  }
+  Value v = first();
+  while (i-- > 0 && v._tok >= 0)
+  {
+    v = v.next();
+  }
+  return v;
+} // end JsonIndex::Value::operator[]
+
+float JsonIndex::Value::asFloat() const
+{
+  return isNull() ? 0 : strtof(text(), nullptr);
+} // end JsonIndex::Value::asFloat
+
+int JsonIndex::Value::asInt() const
+{
+  return static_cast<int>(asInt64());
+} // end JsonIndex::Value::asInt
+
+int64_t JsonIndex::Value::asInt64() const
+{
+  return isNull() ? 0 : strtoll(text(), nullptr, 10);
+} // end JsonIndex::Value::asInt64
+
+/* Parses 4 hex digits. Returns -1 if they are not.
+ */
+static long parseHex4(const char *s)
+{
+  long v = 0;
+  for (int i = 0; i < 4; ++i)
+  {
+    char c = s[i];
+    int d = (c >= '0' && c <= '9') ? c - '0'
+          : (c >= 'a' && c <= 'f') ? c - 'a' + 10
+          : (c >= 'A' && c <= 'F') ? c - 'A' + 10
+          : -1;
+    if (d < 0)
+    {
+      return -1;
+    }
+    v = (v << 4) | d;
+  }
+  return v;
+} // end parseHex4
+
+/* Encodes a code point as UTF-8. Returns the number of bytes.
+ */
+static int encodeUtf8(long cp, char *out)
+{
+  if (cp < 0x80)
+  {
+    out[0] = cp;
+    return 1;
+  }
+  if (cp < 0x800)
+  {
+    out[0] = 0xC0 | (cp >> 6);
+    out[1] = 0x80 | (cp & 0x3F);
+    return 2;
+  }
+  if (cp < 0x10000)
+  {
+    out[0] = 0xE0 | (cp >> 12);
+    out[1] = 0x80 | ((cp >> 6) & 0x3F);
+    out[2] = 0x80 | (cp & 0x3F);
+    return 3;
+  }
+  out[0] = 0xF0 | (cp >> 18);
+  out[1] = 0x80 | ((cp >> 12) & 0x3F);
+  out[2] = 0x80 | ((cp >> 6) & 0x3F);
+  out[3] = 0x80 | (cp & 0x3F);
+  return 4;
+} // end encodeUtf8
+
+size_t JsonIndex::Value::copyString(char *dst, size_t size) const
+{
+  if (size == 0)
+  {
+    return 0;
+  }
+  size_t len = 0;
+  if (_tok < 0 || *text() != '"')
+  {
+    dst[0] = '\0';
+    return 0;
+  }
+
+  const char *p = text() + 1;
+  while (*p != '"')
+  {
+    char seq[4];
+    int  n = 1;
+    if (*p != '\\')
+    {
+      seq[0] = *p++;
+    }
+    else
+    {
+      ++p;
+      switch (*p)
+      {
+      case 'b': seq[0] = '\b'; break;
+      case 'f': seq[0] = '\f'; break;
+      case 'n': seq[0] = '\n'; break;
+      case 'r': seq[0] = '\r'; break;
+      case 't': seq[0] = '\t'; break;
+      case 'u':
+      {
+        long cp = parseHex4(p + 1);
+        p += 4;
+        if (cp >= 0xD800 && cp < 0xDC00 && p[1] == '\\' && p[2] == 'u')
+        { // surrogate pair
+          long lo = parseHex4(p + 3);
+          if (lo >= 0xDC00 && lo < 0xE000)
+          {
+            cp = 0x10000 + ((cp - 0xD800) << 10) + (lo - 0xDC00);
+            p += 6;
+          }
+        }
+        n = encodeUtf8(cp < 0 ? '?' : cp, seq);
+        break;
+      }
+      default: seq[0] = *p; break; // \" \\ \/
+      }
+      ++p;
+    }
+
+    if (len + n > size - 1)
+    { // does not fit. If a raw multi-byte character was cut, drop it whole.
+      if ((static_cast<uint8_t>(seq[0]) & 0xC0) == 0x80)
+      {
+        while (len > 0 && (static_cast<uint8_t>(dst[len - 1]) & 0xC0) == 0x80)
+        {
+          --len;
+        }
+        if (len > 0 && (static_cast<uint8_t>(dst[len - 1]) & 0xC0) == 0xC0)
+        {
+          --len;
+        }
+      }
+      break;
+    }
+    memcpy(dst + len, seq, n);
+    len += n;
+  }
+  dst[len] = '\0';
+  return len;
+} // end JsonIndex::Value::copyString
@@ -26,22 +26,73 @@
 #include <owa-icons.h>
 
 #include "api_response.h"
+#include "arena.h"
 #include "client_utils.h"
 #include "config.h"
 #include "display_utils.h"
+#include "fetch_plan.h"
+#include "forecast_store.h"
+#include "memo.h"
 #include "renderer.h"
+#include "retry.h"
+#include "rtc_clock.h"
+#include "timeline.h"
+#include "weather_provider.h"
 #include "widgets.h"
 
 // too large to allocate locally on stack
 static owm_resp_onecall_t       owm_onecall;
 static owm_resp_air_pollution_t owm_air_pollution;
+static hourly_store_t           hourly_store;
+static daily_store_t            daily_store;
+static timeline_t               timeline;
 
 Preferences prefs;
 
+/* Ends a phase of the wake (fetch, parse, render) by releasing all of the
+ * transient allocations made from the wake arena.
+ */
+void endArenaPhase(const char *phase)
+{
+  size_t escaped = wakeArena.reset();
+  Serial.printf("Arena: %s phase done (peak %u B)\n", phase, wakeArena.peak());
+  if (escaped > 0)
+  {
+    Serial.printf("Arena: %u allocation(s) escaped the %s phase!\n",
+                  escaped, phase);
+  }
+} // end endArenaPhase
+
+/* What a wake fetches and from where, the arg of the requests made by
+ * AsyncRequest.
+ */
+struct fetch_t
+{
+  WeatherProvider *provider;
+  uint8_t          plan;     // sections that are due, see planFetch
+  int              airHours; // hours of air pollution history to fetch
+};
+
+int fetchForecast(HttpSession &session, void *arg)
+{
+  fetch_t &fetch = *static_cast<fetch_t *>(arg);
+  return fetch.provider->getForecast(session, owm_onecall, fetch.plan);
+} // end fetchForecast
+
+int fetchAirPollution(HttpSession &session, void *arg)
+{
+  fetch_t &fetch = *static_cast<fetch_t *>(arg);
+  return fetch.provider->getAirPollution(session, owm_air_pollution,
+                                         fetch.airHours);
+} // end fetchAirPollution
+
 /* Put esp32 into ultra low-power deep-sleep (<11μA).
  * Alligns wake time to the minute. Sleep times defined in config.cpp.
+ * If retryAfter is non-zero the wake is brought forward to that many seconds
+ * from now, unless the next wake is sooner or it is bed time.
  */
-void beginDeepSleep(unsigned long &startTime, tm *timeInfo)
+void beginDeepSleep(unsigned long &startTime, tm *timeInfo,
+                    uint64_t retryAfter = 0)
 {
   if (!getLocalTime(timeInfo))
   {
@@ -97,23 +148,91 @@ void beginDeepSleep(unsigned long &startTime, tm *timeInfo)
   {
     sleepDuration += SLEEP_DURATION * 60ULL;
   }
-  
-  // add extra delay to compensate for esp32's with fast RTCs.
-  sleepDuration += 10ULL;
 
-  esp_sleep_enable_timer_wakeup(sleepDuration * 1000000ULL);
+  if (retryAfter > 0 && retryAfter < sleepDuration && extraHoursUntilWake == 0)
+  {
+    sleepDuration = retryAfter;
+    Serial.println("Retrying early");
+  }
+  
+  // scaled by the drift of the RTC, with a margin for what is left of it
+  esp_sleep_enable_timer_wakeup(clockSleepTimer(sleepDuration));
   Serial.println("Awake for " 
                  + String((millis() - startTime) / 1000.0, 3) + "s");
   Serial.println("Deep-sleep for " + String(sleepDuration) + "s");
   esp_deep_sleep_start();
 } // end beginDeepSleep
 
+/* Ends a wake that failed at the given step. The error is drawn, unless the
+ * previous wake failed the same way and it is still on the display, then the
+ * esp32 deep-sleeps, for a short time only if the failure may pass.
+ */
+void failWake(unsigned long &startTime, tm *timeInfo,
+              wake_step_t step, int code, bool transient,
+              const uint8_t *bitmap_196x196,
+              const String &errMsgLn1, const String &errMsgLn2)
+{
+  killWiFi();
+  if (retryFailed(step, code))
+  {
+    initDisplay();
+    do
+    {
+      drawError(bitmap_196x196, errMsgLn1, errMsgLn2);
+    } while (display.nextPage());
+    display.powerOff();
+  }
+  else
+  {
+    Serial.println("Error already on display");
+  }
+  beginDeepSleep(startTime, timeInfo, retryDelay(transient));
+} // end failWake
+
+/* Reads the indoor temperature and humidity from the BME280. A reading that
+ * failed is left NAN, and statusStr says why. Read with the radio off, the
+ * radio warms the board and the sensor with it.
+ */
+void readBME280(float &inTemp, float &inHumidity, String &statusStr)
+{
+  Serial.print("Reading from BME280... ");
+  TwoWire I2C_bme = TwoWire(0);
+  Adafruit_BME280 bme;
+
+  I2C_bme.begin(PIN_BME_SDA, PIN_BME_SCL, 100000); // 100kHz
+  if(bme.begin(BME_ADDRESS, &I2C_bme))
+  { 
+    inTemp     = bme.readTemperature(); // Celsius
+    inHumidity = bme.readHumidity();    // %
+
+    // check if BME readings are valid
+    // note: readings are checked again before drawing to screen. If a reading
+    //       is not a number (NAN) then an error occured, a dash '-' will be
+    //       displayed.
+    if (isnan(inTemp) || isnan(inHumidity)) {
+      statusStr = "BME Lesefehler";
+      Serial.println(statusStr);
+    }
+    else
+    {
+      Serial.println("Success");
+    }
+  }
+  else
+  {
+    statusStr = "BME nicht gefunden"; // check wiring
+    Serial.println(statusStr);
+  }
+  return;
+} // end readBME280
+
 /* Program entry point.
  */
 void setup()
 {
   unsigned long startTime = millis();
   Serial.begin(115200);
+  clockWake();
 
   // GET BATTERY VOLTAGE
   // DFRobot FireBeetle Esp32-E V1.0 has voltage divider (1M+1M), so readings 
@@ -144,6 +263,7 @@ void setup()
         drawError(battery_alert_0deg_196x196, "Low Battery", "");
       } while (display.nextPage());
       display.powerOff();
+      retryScreenReplaced();
     }
 
     if (batteryVoltage <= CRIT_LOW_BATTERY_VOLTAGE)
@@ -155,16 +275,16 @@ void setup()
     }
     else if (batteryVoltage <= VERY_LOW_BATTERY_VOLTAGE)
     { // very low battery
-      esp_sleep_enable_timer_wakeup(VERY_LOW_BATTERY_SLEEP_INTERVAL 
-                                    * 60ULL * 1000000ULL);
+      esp_sleep_enable_timer_wakeup(
+        clockSleepTimer(VERY_LOW_BATTERY_SLEEP_INTERVAL * 60ULL));
       Serial.println("Very low battery voltage!");
       Serial.println("Deep-sleep for " 
                      + String(VERY_LOW_BATTERY_SLEEP_INTERVAL) + "min");
     }
     else
     { // low battery
-      esp_sleep_enable_timer_wakeup(LOW_BATTERY_SLEEP_INTERVAL
-                                    * 60ULL * 1000000ULL);
+      esp_sleep_enable_timer_wakeup(
+        clockSleepTimer(LOW_BATTERY_SLEEP_INTERVAL * 60ULL));
       Serial.println("Low battery voltage!");
       Serial.println("Deep-sleep for " 
                     + String(LOW_BATTERY_SLEEP_INTERVAL) + "min");
@@ -181,31 +301,34 @@ void setup()
   String tmpStr = {};
   tm timeInfo = {};
 
+  float inTemp     = NAN;
+  float inHumidity = NAN;
+#ifdef RENDER_SERVER
+  // the readings are sent with the request, they are taken before the radio
+  // is on
+  readBME280(inTemp, inHumidity, statusStr);
+#endif
+
   // START WIFI
+  // the connection is made in the background while the wake goes on
+  beginWiFi();
+
   int wifiRSSI = 0; // “Received Signal Strength Indicator"
-  wl_status_t wifiStatus = startWiFi(wifiRSSI);
+  wl_status_t wifiStatus = awaitWiFi(wifiRSSI);
   if (wifiStatus != WL_CONNECTED)
   { // WiFi Connection Failed
-    killWiFi();
-    initDisplay();
     if (wifiStatus == WL_NO_SSID_AVAIL)
     {
       Serial.println("SSID Not Available");
-      do
-      {
-        drawError(wifi_x_196x196, "SSID Not Available", "");
-      } while (display.nextPage());
+      failWake(startTime, &timeInfo, WAKE_STEP_WIFI, wifiStatus, true,
+               wifi_x_196x196, "SSID Not Available", "");
     }
     else
     {
       Serial.println("WiFi Connection Failed");
-      do
-      {
-        drawError(wifi_x_196x196, "WiFi Connection", "Failed");
-      } while (display.nextPage());
+      failWake(startTime, &timeInfo, WAKE_STEP_WIFI, wifiStatus, true,
+               wifi_x_196x196, "WiFi Connection", "Failed");
     }
-    display.powerOff();
-    beginDeepSleep(startTime, &timeInfo);
   }
   
   // FETCH TIME
@@ -214,102 +337,138 @@ void setup()
   if (!timeConfigured)
   { // Failed To Fetch The Time
     Serial.println("Failed To Fetch The Time");
-    killWiFi();
-    initDisplay();
-    do
-    {
-      drawError(wi_time_4_196x196, "Failed To Fetch", "The Time");
-    } while (display.nextPage());
-    display.powerOff();
-    beginDeepSleep(startTime, &timeInfo);
+    failWake(startTime, &timeInfo, WAKE_STEP_TIME, 0, true,
+             wi_time_4_196x196, "Failed To Fetch", "The Time");
   }
   String refreshTimeStr;
   getRefreshTimeStr(refreshTimeStr, timeConfigured, &timeInfo);
 
-  // MAKE API REQUESTS
-  int rxOWM[2] = {};
-  WiFiClient client;
-  rxOWM[0] = getOWMonecall(client, owm_onecall);
-  if (rxOWM[0] != HTTP_CODE_OK)
+#ifdef RENDER_SERVER
+  // DOWNLOAD THE FRAME
+  // the server fetches the weather and renders it, this device only sends its
+  // own readings and shows the result
+  tmpStr = "&bat=" + String(batteryVoltage, 2) + "&rssi=" + String(wifiRSSI);
+  if (!isnan(inTemp))
   {
-    statusStr = "One Call " + OWM_ONECALL_VERSION + " API";
-    tmpStr = String(rxOWM[0], DEC) + ": " + getHttpResponsePhrase(rxOWM[0]);
-    killWiFi();
-    initDisplay();
-    do
-    {
-      drawError(wi_cloud_down_196x196, statusStr, tmpStr);
-    } while (display.nextPage());
-    display.powerOff();
-    beginDeepSleep(startTime, &timeInfo);
+    tmpStr += "&temp=" + String(inTemp, 1);
   }
-  rxOWM[1] = getOWMairpollution(client, owm_air_pollution);
-  killWiFi(); // wifi no longer needed
-  if (rxOWM[1] != HTTP_CODE_OK)
+  if (!isnan(inHumidity))
   {
-    statusStr = "Air Pollution API";
-    tmpStr = String(rxOWM[1], DEC) + ": " + getHttpResponsePhrase(rxOWM[1]);
-    initDisplay();
-    do
-    {
-      drawError(wi_cloud_down_196x196, statusStr, tmpStr);
-    } while (display.nextPage());
-    display.powerOff();
-    beginDeepSleep(startTime, &timeInfo);
+    tmpStr += "&hum=" + String(inHumidity, 0);
   }
+  if (statusStr.length() > 0)
+  {
+    tmpStr += "&status=" + urlEncode(statusStr);
+  }
+  initDisplay();
+  int rxFrame = getRenderedFrame(tmpStr);
+  killWiFi();
+  display.powerOff();
+  if (rxFrame != HTTP_CODE_OK)
+  {
+    tmpStr = String(rxFrame, DEC) + ": " + getHttpResponsePhrase(rxFrame);
+    failWake(startTime, &timeInfo, WAKE_STEP_FORECAST, rxFrame,
+             isTransientError(rxFrame), wi_cloud_down_196x196,
+             "Render Server", tmpStr);
+  }
+  retrySucceeded();
+  beginDeepSleep(startTime, &timeInfo);
+#endif
 
-  // GET INDOOR TEMPERATURE AND HUMIDITY, start BME280...
-  float inTemp     = NAN;
-  float inHumidity = NAN;
-  Serial.print("Reading from BME280... ");
-  TwoWire I2C_bme = TwoWire(0);
-  Adafruit_BME280 bme;
-
-  I2C_bme.begin(PIN_BME_SDA, PIN_BME_SCL, 100000); // 100kHz
-  if(bme.begin(BME_ADDRESS, &I2C_bme))
-  { 
-    inTemp     = bme.readTemperature(); // Celsius
-    inHumidity = bme.readHumidity();    // %
-
-    // check if BME readings are valid
-    // note: readings are checked again before drawing to screen. If a reading
-    //       is not a number (NAN) then an error occured, a dash '-' will be
-    //       displayed.
-    if (isnan(inTemp) || isnan(inHumidity)) {
-      statusStr = "BME Lesefehler";
-      Serial.println(statusStr);
-    }
-    else
-    {
-      Serial.println("Success");
-    }
+  // MAKE API REQUESTS
+  // only the sections that are due are fetched, the rest are kept from earlier
+  // wakes. Both requests are made concurrently, each by a task of its own,
+  // while this one prepares what it can for the render
+  WeatherProvider &provider = weatherProvider();
+  int64_t now = time(nullptr);
+  fetch_t fetch = {&provider, planFetch(now, provider.partialForecast()),
+                   airPollutionHours(now)};
+  bool fetchAir = fetch.plan & FETCH_AIR_POLLUTION;
+  AsyncRequest forecast(fetchForecast, &fetch);
+  AsyncRequest airPollution(fetchAirPollution, &fetch);
+  forecast.start("forecast");
+  if (fetchAir)
+  {
+    airPollution.start("airPollution");
   }
-  else
+
   {
-    statusStr = "BME nicht gefunden"; // check wiring
-    Serial.println(statusStr);
+    W::Window w(800, 480);
+    W::Text t;
+    w << t.text("Hallo");
+
+    W::DisplayPainter painter(display);
+    w.paint(painter);
   }
 
+  // the display is set up, and the parts of the frame that do not depend on the
+  // responses drawn, while the requests are under way. Only a display that
+  // buffers the whole frame keeps them, a paged one clears its buffer between
+  // pages, so those are drawn with the rest.
+  initDisplay();
   String dateStr;
   getDateStr(dateStr, &timeInfo);
+  bool drawnAhead = display.pages() == 1;
+  if (drawnAhead)
+  {
+    drawLocationDate(CITY_STRING, dateStr);
+  }
 
-  W::Window w(800, 480);
-  w << W::Text().text("Hallo");
+  int rxOWM[2] = {};
+  rxOWM[0] = forecast.await();
+  rxOWM[1] = fetchAir ? airPollution.await() : HTTP_CODE_OK;
+  killWiFi(); // wifi no longer needed
 
-  W::DisplayPainter painter(display);
-  w.paint(painter);
+  // GET INDOOR TEMPERATURE AND HUMIDITY
+  readBME280(inTemp, inHumidity, statusStr);
+#ifdef DOWNLOAD_THEN_PARSE
+  // the responses were only downloaded, parse them now that the radio is off
+  if (rxOWM[0] == HTTP_CODE_OK)
+  {
+    rxOWM[0] = forecast.parse();
+  }
+  if (rxOWM[1] == HTTP_CODE_OK && fetchAir)
+  {
+    rxOWM[1] = airPollution.parse();
+  }
+#endif
+  if (rxOWM[0] != HTTP_CODE_OK)
+  {
+    statusStr = provider.forecastApi();
+    tmpStr = String(rxOWM[0], DEC) + ": " + getHttpResponsePhrase(rxOWM[0]);
+    failWake(startTime, &timeInfo, WAKE_STEP_FORECAST, rxOWM[0],
+             isTransientError(rxOWM[0]), wi_cloud_down_196x196, statusStr,
+             tmpStr);
+  }
+  if (rxOWM[1] != HTTP_CODE_OK)
+  {
+    statusStr = provider.airPollutionApi();
+    tmpStr = String(rxOWM[1], DEC) + ": " + getHttpResponsePhrase(rxOWM[1]);
+    failWake(startTime, &timeInfo, WAKE_STEP_AIR_POLLUTION, rxOWM[1],
+             isTransientError(rxOWM[1]), wi_cloud_down_196x196, statusStr,
+             tmpStr);
+  }
+  // responses are parsed as they are received, or just above
+  endArenaPhase("fetch/parse");
+  mergeFetched(fetch.plan, now, owm_onecall, owm_air_pollution, hourly_store,
+               daily_store);
+  buildTimeline(timeline, hourly_store, daily_store, owm_onecall.current,
+                owm_air_pollution);
 
   // RENDER FULL REFRESH
-  initDisplay();
   do
   {
     drawCurrentConditions(owm_onecall.current, owm_onecall.daily[0],
-                          owm_air_pollution, 
+                          owm_air_pollution, timeline,
                           isnan(inTemp) ? std::nullopt : std::optional{inTemp}, 
                           isnan(inHumidity) ? std::nullopt : std::optional{inHumidity});
-    drawForecast(owm_onecall.daily, timeInfo);
-    drawLocationDate(CITY_STRING, dateStr);
-    drawOutlookGraph(owm_onecall.hourly, timeInfo);
+    drawForecast(daily_store, timeline);
+    if (!drawnAhead)
+    {
+      drawLocationDate(CITY_STRING, dateStr);
+    }
+    drawOutlookGraph(timeline);
+    drawPrecipNextHour(owm_onecall.precip_next_hour);
 #ifndef DISABLE_ALERTS
     drawAlerts(owm_onecall.alerts, CITY_STRING, dateStr);
 #endif
@@ -317,6 +476,9 @@ void setup()
     Serial.println("page printed");
   } while (display.nextPage());
   display.powerOff();
+  retrySucceeded();
+  endArenaPhase("render");
+  Serial.printf("Memo: %u hits, %u misses\n", memoHits(), memoMisses());
 
   // DEEP-SLEEP
   beginDeepSleep(startTime, &timeInfo);
@@ -0,0 +1,93 @@
+/* Cross-wake memoization for esp32-weather-epd.
+ * Copyright (C) 2023  Luke Marzen
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <Arduino.h>
+
+#include "memo.h"
+
+struct memo_entry_t
+{
+  uint32_t  key;
+  uintptr_t value;
+  bool      valid;
+};
+
+// Number of entries of each kind. A lookup checks every entry of its kind, a
+// store replaces the oldest one.
+static const uint8_t MEMO_WAYS[MEMO_NUM_KINDS] = {
+  1, // MEMO_AQI
+  4, // MEMO_TEXT_WIDTH, city and date
+};
+static const int MEMO_NUM_ENTRIES = 1 + 4;
+
+RTC_DATA_ATTR static memo_entry_t memoEntries[MEMO_NUM_ENTRIES] = {};
+RTC_DATA_ATTR static uint8_t      memoNext[MEMO_NUM_KINDS]      = {};
+static uint32_t hits   = 0;
+static uint32_t misses = 0;
+
+/* Returns the first entry of the given kind.
+ */
+static memo_entry_t *memoBegin(memo_kind_t kind)
+{
+  int offset = 0;
+  for (int k = 0; k < kind; ++k)
+  {
+    offset += MEMO_WAYS[k];
+  }
+  return memoEntries + offset;
+} // end memoBegin
+
+/* Looks up the value memoized for key.
+ *
+ * Returns true on a hit, in which case the computation can be skipped.
+ */
+bool memoGet(memo_kind_t kind, uint32_t key, uintptr_t &value)
+{
+  memo_entry_t *e = memoBegin(kind);
+  for (int i = 0; i < MEMO_WAYS[kind]; ++i)
+  {
+    if (e[i].valid && e[i].key == key)
+    {
+      value = e[i].value;
+      ++hits;
+      return true;
+    }
+  }
+  ++misses;
+  return false;
+} // end memoGet
+
+/* Memoizes the value computed for key.
+ */
+void memoPut(memo_kind_t kind, uint32_t key, uintptr_t value)
+{
+  memo_entry_t *e = memoBegin(kind);
+  uint8_t &next = memoNext[kind];
+  e[next] = {key, value, true};
+  next = (next + 1) % MEMO_WAYS[kind];
+  return;
+} // end memoPut
+
+uint32_t memoHits()
+{
+  return hits;
+} // end memoHits
+
+uint32_t memoMisses()
+{
+  return misses;
+} // end memoMisses
@@ -15,6 +15,8 @@
  * along with this program.  If not, see <https://www.gnu.org/licenses/>.
  */
 
+#include <algorithm>
+#include <cmath>
 #include <owa-icons.h>
 
 #include "_locale.h"
@@ -24,6 +26,8 @@
 #include "config.h"
 #include "conversions.h"
 #include "display_utils.h"
+#include "frame.h"
+#include "memo.h"
 
 #ifdef SIMULATION
 #include <QDebug>
@@ -75,6 +79,25 @@ uint16_t getStringHeight(String text)
   return h;
 }
 
+/* Selects font and returns the width in pixels of text set in it. The width is
+ * memoized across wakes, for strings that rarely change like the city and
+ * date.
+ */
+uint16_t getStringWidthMemo(const GFXfont *font, const String &text)
+{
+  display.setFont(font);
+  const char *str = text.c_str();
+  uint32_t key = fnv1a(str, strlen(str), memoKey(font));
+  uintptr_t cached;
+  if (memoGet(MEMO_TEXT_WIDTH, key, cached))
+  {
+    return static_cast<uint16_t>(cached);
+  }
+  uint16_t w = getStringWidth(text);
+  memoPut(MEMO_TEXT_WIDTH, key, w);
+  return w;
+}
+
 /* Draws a string with alignment
  */
 void drawString(int16_t x, int16_t y, String text, alignment_t alignment,
@@ -217,12 +240,10 @@ void initDisplay()
 #endif
 } // end initDisplay
 
-void drawSunrise(int x, int y, const owm_current_t &current)
+void drawSunrise(int x, int y, const timeline_t &tl)
 {
-  time_t ts = current.sunrise;
-  tm *timeInfo = localtime(&ts);
   char timeBuffer[12] = {}; // big enough to accommodate "hh:mm:ss am"
-  _strftime(timeBuffer, sizeof(timeBuffer), TIME_FORMAT, timeInfo);
+  _strftime(timeBuffer, sizeof(timeBuffer), TIME_FORMAT, &tl.sunrise);
   display.drawInvertedBitmap(x, y, wi_sunrise_48x48, 48, 48, GxEPD_BLACK);
   display.setFont(&FONT_7pt8b);
   drawString(x + 48, y + 10, TXT_SUNRISE, LEFT);
@@ -277,13 +298,14 @@ void drawUVIndex(int x, int y, const owm_current_t &current, int sp)
   }
 }
 
-void drawAQI(int x, int y, const owm_resp_air_pollution_t &owm_air_pollution, int sp)
+void drawAQI(int x, int y, const owm_resp_air_pollution_t &owm_air_pollution,
+             const timeline_t &tl, int sp)
 {
   display.drawInvertedBitmap(x, y, air_filter_48x48, 48, 48, GxEPD_BLACK);
   display.setFont(&FONT_7pt8b);
   drawString(x + 48, y + 10, TXT_AIR_QUALITY_INDEX, LEFT);
   display.setFont(&FONT_12pt8b);
-  int aqi = getAQI(owm_air_pollution);
+  int aqi = getAQI(owm_air_pollution, tl);
   drawString(x + 48, y + 17 / 2 + 48 / 2, String(aqi), LEFT);
   display.setFont(&FONT_7pt8b);
   auto dataStr = String(getAQIdesc(aqi));
@@ -318,12 +340,10 @@ void drawIndoorTemperature(int x, int y, const std::optional<Quantity<Temperatur
   drawString(x + 48, y + 17 / 2 + 48 / 2, dataStr, LEFT);
 }
 
-void drawSunset(int x, int y, const owm_current_t &current)
+void drawSunset(int x, int y, const timeline_t &tl)
 {
-  time_t ts = current.sunset;
-  tm *timeInfo = localtime(&ts);
   char timeBuffer[12] = {}; // big enough to accommodate "hh:mm:ss am"
-  _strftime(timeBuffer, sizeof(timeBuffer), TIME_FORMAT, timeInfo);
+  _strftime(timeBuffer, sizeof(timeBuffer), TIME_FORMAT, &tl.sunset);
   display.drawInvertedBitmap(x, y, wi_sunset_48x48, 48, 48, GxEPD_BLACK);
   display.setFont(&FONT_7pt8b);
   drawString(x + 48, y + 10, TXT_SUNSET, LEFT);
@@ -456,22 +476,23 @@ void drawDataGrid(int x,
                   int y,
                   const owm_current_t &current,
                   const owm_resp_air_pollution_t &owm_air_pollution,
+                  const timeline_t &tl,
                   const std::optional<Quantity<TemperatureUnit>> &inTemp,
                   const std::optional<float> &inHumidity)
 {
   int row = 0;
   int col = 0;
 
-  drawSunrise(x + dx * col, y + dy * row++, current);
+  drawSunrise(x + dx * col, y + dy * row++, tl);
   drawWind(x + dx * col, y + dy * row++, current);
   drawUVIndex(x + dx * col, y + dy * row++, current, 8);
-  drawAQI(x + dx * col, y + dy * row++, owm_air_pollution, 8);
+  drawAQI(x + dx * col, y + dy * row++, owm_air_pollution, tl, 8);
   drawIndoorTemperature(x + col, y + dy * row++, inTemp);
 
   col++;
   row = 0;
 
-  drawSunset(x + dx * col, y + dy * row++, current);
+  drawSunset(x + dx * col, y + dy * row++, tl);
   drawHumidity(x + dx * col, y + dy * row++, current);
   drawPressure(x + dx * col, y + dy * row++, current);
   drawVisibility(x + dx * col, y + dy * row++, current);
@@ -484,6 +505,7 @@ void drawDataGrid(int x,
 void drawCurrentConditions(const owm_current_t &current,
                            const owm_daily_t &today,
                            const owm_resp_air_pollution_t &owm_air_pollution,
+                           const timeline_t &tl,
                            const std::optional<Quantity<TemperatureUnit>> &inTemp,
                            const std::optional<float> &inHumidity)
 {
@@ -515,46 +537,52 @@ void drawCurrentConditions(const owm_current_t &current,
   // line dividing top and bottom display areas
   // display.drawLine(0, 196, DISP_WIDTH - 1, 196, GxEPD_BLACK);
 
-  drawDataGrid<170, 48 + 8>(0, 204, current, owm_air_pollution, inTemp, inHumidity);
+  drawDataGrid<170, 48 + 8>(0, 204, current, owm_air_pollution, tl, inTemp,
+                            inHumidity);
 }
 
-void drawForecastForDay(const owm_daily_t& day, tm timeInfo, int x)
+void drawForecastForDay(const daily_store_t &daily, const timeline_t &tl,
+                        int i, int x)
 {
   // icons
   display.drawInvertedBitmap(x, 98 + 69 / 2 - 32 - 6,
-                             getForecastBitmap64(day),
+                             getForecastBitmap64(daily, i),
                              64, 64, GxEPD_BLACK);
   // day of week label
   display.setFont(&FONT_11pt8b);
   char dayBuffer[8] = {};
+  tm timeInfo = {};
+  timeInfo.tm_wday = tl.day_wday[i];
   _strftime(dayBuffer, sizeof(dayBuffer), "%a", &timeInfo); // abbrv'd day
   drawString(x + 31 - 2, 98 + 69 / 2 - 32 - 26 - 6 + 16, dayBuffer, CENTER);
 
   // high | low
 
-  auto hiStr = String(static_cast<int>(round(day.temp.max.in<TemperatureUnit>()))) + TemperatureUnit::shortSym;
-  auto loStr = String(static_cast<int>(round(day.temp.min.in<TemperatureUnit>()))) + TemperatureUnit::shortSym;
+  auto hiStr = String(static_cast<int>(round(tl.day_temp_max[i]))) + TemperatureUnit::shortSym;
+  auto loStr = String(static_cast<int>(round(tl.day_temp_min[i]))) + TemperatureUnit::shortSym;
   display.setFont(&FONT_8pt8b);
   drawString(x + 31 - 4, 98 + 69 / 2 + 38 - 6 + 12, hiStr, RIGHT);
   drawString(x + 31 + 8, 98 + 69 / 2 + 38 - 6 + 12, loStr, LEFT);
   drawString(x + 31, 98 + 69 / 2 + 38 - 6 + 12, "|", CENTER);
 }
 
-/* This function is responsible for drawing the five day forecast.
+/* This function is responsible for drawing the five day forecast, starting
+ * with today. A daily forecast kept from an earlier wake may begin before
+ * today, its past days are skipped.
  */
-void drawForecast(owm_daily_t *const daily, tm timeInfo)
+void drawForecast(const daily_store_t &daily, const timeline_t &tl)
 {
-  for (int i = 0; i < 5; ++i) {
+  int today = std::max<int>(tl.day[tl.now], 0);
+  for (int i = 0; i < 5 && today + i < daily.count; ++i) {
     int x = 398 + (i * 82);
-    drawForecastForDay(daily[i], timeInfo, x);
-    timeInfo.tm_wday = (timeInfo.tm_wday + 1) % 7; // increment to next day
+    drawForecastForDay(daily, tl, today + i, x);
   }
 }
 
 /* This function is responsible for drawing the current alerts if any.
  * Up to 2 alerts can be drawn.
  */
-void drawAlerts(std::vector<owm_alerts_t> &alerts,
+void drawAlerts(StaticVector<owm_alerts_t, OWM_NUM_ALERTS> &alerts,
                 const String &city, const String &date)
 {
   if (alerts.size() == 0)
@@ -574,10 +602,8 @@ void drawAlerts(std::vector<owm_alerts_t> &alerts,
 
   // limit alert text width so that is does not run into the location or date
   // strings
-  display.setFont(&FONT_16pt8b);
-  int city_w = getStringWidth(city);
-  display.setFont(&FONT_12pt8b);
-  int date_w = getStringWidth(date);
+  int city_w = getStringWidthMemo(&FONT_16pt8b, city);
+  int date_w = getStringWidthMemo(&FONT_12pt8b, date);
   int max_w = DISP_WIDTH - 2 - max(city_w, date_w) - (196 + 4) - 8;
 
   // find indicies of valid alerts
@@ -608,6 +634,9 @@ void drawAlerts(std::vector<owm_alerts_t> &alerts,
     // must be called after getAlertBitmap
     toTitleCase(cur_alert.event);
 
+    flattenAlertDescription(cur_alert.description);
+    bool has_detail = cur_alert.description[0] != '\0';
+
     display.setFont(&FONT_14pt8b);
     if (getStringWidth(cur_alert.event) <= max_w)
     { // Fits on a single line, draw along bottom
@@ -624,8 +653,17 @@ void drawAlerts(std::vector<owm_alerts_t> &alerts,
       { // Does not fit on a single line, draw higher to allow room for 2nd line
         drawMultiLnString(196 + 48 + 4, 24 + 8 - 12 + 17 - 11,
                           cur_alert.event, LEFT, max_w, 2, 23);
+        // no room left for the description
+        has_detail = false;
       }
     }
+
+    if (has_detail)
+    { // detail line under the event, level with the bottom of the icon
+      display.setFont(&FONT_8pt8b);
+      drawMultiLnString(196 + 48 + 4, 8 + 48 - 1, cur_alert.description, LEFT,
+                        max_w, 1, 0);
+    }
   } // end 1 alert
   else
   { // 2 alerts
@@ -677,7 +715,7 @@ inline int modulo(int a, int b)
 /* This function is responsible for drawing the outlook graph for the specified
  * number of hours(up to 47).
  */
-void drawOutlookGraph(owm_hourly_t *const hourly, tm timeInfo)
+void drawOutlookGraph(const timeline_t &tl)
 {
 
   const int xPos0 = 350;
@@ -689,19 +727,18 @@ void drawOutlookGraph(owm_hourly_t *const hourly, tm timeInfo)
   display.drawLine(xPos0, yPos1    , xPos1, yPos1    , GxEPD_BLACK);
   display.drawLine(xPos0, yPos1 - 1, xPos1, yPos1 - 1, GxEPD_BLACK);
 
+  // the hourly forecast may not reach as far as the graph
+  const int hours = std::min(tl.count - tl.now, HOURLY_GRAPH_MAX);
+
   // calculate y max/min and intervals
   int yMajorTicks = 5;
-  float tempMin = hourly[0].temp.in<TemperatureUnit>();
-  float tempMax = tempMin;
-  int yTempMajorTicks = 5;
-  float newTemp = 0;
-
-  for (int i = 1; i < HOURLY_GRAPH_MAX; ++i)
-  {
-    newTemp = hourly[i].temp.in<TemperatureUnit>();
-    tempMin = std::min(tempMin, newTemp);
-    tempMax = std::max(tempMax, newTemp);
+  float tempMin = tl.graph_temp_min;
+  float tempMax = tl.graph_temp_max;
+  if (std::isnan(tempMin))
+  { // no temperature forecast at all
+    tempMin = tempMax = 0;
   }
+  int yTempMajorTicks = 5;
 
   int tempBoundMin = static_cast<int>(tempMin - 1) - modulo(static_cast<int>(tempMin - 1), yTempMajorTicks);
   int tempBoundMax = static_cast<int>(tempMax + 1) + (yTempMajorTicks - modulo(static_cast<int>(tempMax + 1), yTempMajorTicks));
@@ -768,19 +805,24 @@ void drawOutlookGraph(owm_hourly_t *const hourly, tm timeInfo)
   const float yPxPerUnit_t = (yPos1 - yPos0) / static_cast<float>(tempBoundMax - tempBoundMin);
   const float yPxPerUnit_p = (yPos1 - yPos0) / 100.0;
 
-  for (int i = 0; i < HOURLY_GRAPH_MAX; ++i)
+  for (int i = 0; i < hours; ++i)
   {
+    int s = tl.slot(i);
+    if (s < 0)
+    {
+      continue;
+    }
     int xTick = static_cast<int>(xPos0 + (i * xInterval));
     int x0_t, x1_t, y0_t, y1_t;
 
-    if (i > 0)
+    // temperature, gaps in the forecast are left out of the line
+    if (i > 0 && !std::isnan(tl.temp[s - 1]) && !std::isnan(tl.temp[s]))
     {
-      // temperature
       x0_t = static_cast<int>(round(xPos0 + ((i - 1) * xInterval) + (0.5 * xInterval)));
       x1_t = static_cast<int>(round(xPos0 + (i * xInterval) + (0.5 * xInterval)));
 
-      auto prevTemp = hourly[i - 1].temp.in<TemperatureUnit>();
-      auto currTemp = hourly[i].temp.in<TemperatureUnit>();
+      auto prevTemp = tl.temp[s - 1];
+      auto currTemp = tl.temp[s];
       y0_t = static_cast<int>(round(yPos1 - yPxPerUnit_t * (prevTemp - tempBoundMin)));
       y1_t = static_cast<int>(round(yPos1 - yPxPerUnit_t * (currTemp - tempBoundMin)));
 
@@ -794,7 +836,7 @@ void drawOutlookGraph(owm_hourly_t *const hourly, tm timeInfo)
     x0_t = static_cast<int>(round( xPos0 + 1 + (i * xInterval)));
     x1_t = static_cast<int>(round( xPos0 + 1 + ((i + 1) * xInterval) ));
     y0_t = static_cast<int>(round(
-                            yPos1 - (yPxPerUnit_p * (hourly[i].pop * 100)) ));
+                            yPos1 - (yPxPerUnit_p * tl.pop[s]) ));
     y1_t = yPos1;
 
     // graph PoP
@@ -813,16 +855,17 @@ void drawOutlookGraph(owm_hourly_t *const hourly, tm timeInfo)
       display.drawLine(xTick + 1, yPos1 + 1, xTick + 1, yPos1 + 4, GxEPD_BLACK);
       // draw x axis labels
       char timeBuffer[12] = {}; // big enough to accommodate "hh:mm:ss am"
-      time_t ts = hourly[i].dt;
-      tm *timeInfo = localtime(&ts);
-      _strftime(timeBuffer, sizeof(timeBuffer), HOUR_FORMAT, timeInfo);
+      tm timeInfo = {};
+      timeInfo.tm_hour = tl.hour[s];
+      _strftime(timeBuffer, sizeof(timeBuffer), HOUR_FORMAT, &timeInfo);
       drawString(xTick, yPos1 + 1 + 12 + 4 + 3, timeBuffer, CENTER);
     }
 
   }
 
-  // draw the last tick mark
-  if ((HOURLY_GRAPH_MAX % hourInterval) == 0)
+  // draw the last tick mark, if the forecast reaches the end of the graph
+  int last = tl.slot(HOURLY_GRAPH_MAX - 1);
+  if ((HOURLY_GRAPH_MAX % hourInterval) == 0 && last >= 0)
   {
     int xTick = static_cast<int>(round(xPos0 + (HOURLY_GRAPH_MAX * xInterval)));
     // draw x tick marks
@@ -830,15 +873,57 @@ void drawOutlookGraph(owm_hourly_t *const hourly, tm timeInfo)
     display.drawLine(xTick + 1, yPos1 + 1, xTick + 1, yPos1 + 4, GxEPD_BLACK);
     // draw x axis labels
     char timeBuffer[12] = {}; // big enough to accommodate "hh:mm:ss am"
-    time_t ts = hourly[HOURLY_GRAPH_MAX - 1].dt + 3600;
-    tm *timeInfo = localtime(&ts);
-    _strftime(timeBuffer, sizeof(timeBuffer), HOUR_FORMAT, timeInfo);
+    int s = tl.slot(HOURLY_GRAPH_MAX);
+    tm timeInfo = {};
+    timeInfo.tm_hour = (s >= 0) ? tl.hour[s] : (tl.hour[last] + 1) % 24;
+    _strftime(timeBuffer, sizeof(timeBuffer), HOUR_FORMAT, &timeInfo);
     drawString(xTick, yPos1 + 1 + 12 + 4 + 3, timeBuffer, CENTER);
   }
 
   return;
 } // end drawOutlookGraph
 
+/* This function is responsible for drawing the precipitation forecast for the
+ * next hour, one bar per 5 minutes, in the strip above the outlook graph.
+ * Nothing is drawn unless the minute forecast is available
+ * (ENABLE_MINUTELY_PRECIP) and has precipitation in it.
+ */
+void drawPrecipNextHour(const owm_precip_next_hour_t &precip)
+{
+  if (precip.samples == 0 || precip.first_rain < 0)
+  {
+    return;
+  }
+
+  const int xPos0 = 350;
+  const int xPos1 = DISP_WIDTH - 46;
+  const int yPos0 = 184;
+  const int yPos1 = 204;
+  // heavy rain, 10 mm/h (0.1 mm/h units), fills a bar
+  const int bucketMax = 100;
+
+  display.setFont(&FONT_6pt8b);
+  drawString(xPos0 - 8, yPos1, TXT_PRECIP_NEXT_HOUR, RIGHT);
+  display.drawLine(xPos0, yPos1, xPos1, yPos1, GxEPD_BLACK);
+
+  float xInterval = (xPos1 - xPos0) / static_cast<float>(OWM_PRECIP_BUCKETS);
+  for (int i = 0; i < OWM_PRECIP_BUCKETS; ++i)
+  {
+    if (precip.bucket[i] == 0)
+    {
+      continue;
+    }
+    int x0 = static_cast<int>(round(xPos0 + (i * xInterval))) + 1;
+    int x1 = static_cast<int>(round(xPos0 + ((i + 1) * xInterval))) - 1;
+    // the lightest drizzle still shows
+    int h = std::max(2, (yPos1 - yPos0)
+                        * std::min<int>(precip.bucket[i], bucketMax)
+                        / bucketMax);
+    display.fillRect(x0, yPos1 - h, x1 - x0, h, ACCENT_COLOR);
+  }
+  return;
+} // end drawPrecipNextHour
+
 /* This function is responsible for drawing the status bar along the bottom of
  * the display.
  */
@@ -916,3 +1001,66 @@ void drawError(const uint8_t *bitmap_196x196,
                              bitmap_196x196, 196, 196, ACCENT_COLOR);
   return;
 } // end drawError
+
+#ifdef ARDUINO
+// Rows of a frame written to the panel at a time.
+#define FRAME_BAND_ROWS 16
+
+/* Streams a frame rendered by the render server (see frame.h) onto the panel,
+ * a band of rows at a time, then refreshes it. The frame goes straight to the
+ * panel's memory, the page buffer of display is not used, and nothing is
+ * drawn. The display must have been initialized.
+ *
+ * Returns true if the whole frame was received and shown.
+ */
+bool streamFrame(Stream &frame)
+{
+#ifdef DISP_3C
+  const uint8_t planes = 2;
+  static uint8_t color[FRAME_BAND_ROWS * FRAME_ROW_BYTES];
+#else
+  const uint8_t planes = 1;
+#endif
+  static uint8_t black[FRAME_BAND_ROWS * FRAME_ROW_BYTES];
+
+  frame_header_t header;
+  if (frame.readBytes(reinterpret_cast<char *>(&header), sizeof(header))
+        != sizeof(header)
+      || header.magic != FRAME_MAGIC
+      || header.width != DISP_WIDTH || header.height != DISP_HEIGHT
+      || header.planes != planes)
+  {
+    Serial.println("Invalid frame header");
+    return false;
+  }
+
+  for (int y = 0; y < DISP_HEIGHT; y += FRAME_BAND_ROWS)
+  {
+    int rows = std::min(FRAME_BAND_ROWS, DISP_HEIGHT - y);
+    for (int r = 0; r < rows; ++r)
+    {
+      char *row = reinterpret_cast<char *>(black + r * FRAME_ROW_BYTES);
+      if (frame.readBytes(row, FRAME_ROW_BYTES) != FRAME_ROW_BYTES)
+      {
+        Serial.printf("Frame truncated at row %d\n", y + r);
+        return false;
+      }
+#ifdef DISP_3C
+      row = reinterpret_cast<char *>(color + r * FRAME_ROW_BYTES);
+      if (frame.readBytes(row, FRAME_ROW_BYTES) != FRAME_ROW_BYTES)
+      {
+        Serial.printf("Frame truncated at row %d\n", y + r);
+        return false;
+      }
+#endif
+    }
+#ifdef DISP_3C
+    display.epd2.writeImage(black, color, 0, y, DISP_WIDTH, rows);
+#else
+    display.epd2.writeImage(black, 0, y, DISP_WIDTH, rows);
+#endif
+  }
+  display.epd2.refresh(false);
+  return true;
+} // end streamFrame
+#endif
@@ -0,0 +1,95 @@
+/* Failure-aware retry scheduling for esp32-weather-epd.
+ * Copyright (C) 2023  Luke Marzen
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include <HTTPClient.h>
+
+#include "config.h"
+#include "retry.h"
+
+// Jitter applied to a retry delay, percent either way.
+#define RETRY_JITTER 20
+
+struct retry_state_t
+{
+  uint8_t  failures; // consecutive failed wakes
+  uint32_t shown;    // error on the display, 0 if none
+};
+
+RTC_DATA_ATTR static retry_state_t retryState = {};
+
+bool isTransientError(int httpCode)
+{
+  if (httpCode <= -100)
+  { // a deserialization error. Only a body cut short, by a dropped connection,
+    // may parse next time, anything else is in what the server sent.
+    int code = -100 - httpCode;
+    return code == DeserializationError::Code::EmptyInput
+           || code == DeserializationError::Code::IncompleteInput;
+  }
+  // connection errors are negative
+  return httpCode < 0
+         || httpCode == HTTP_CODE_REQUEST_TIMEOUT
+         || httpCode == HTTP_CODE_TOO_MANY_REQUESTS
+         || httpCode >= HTTP_CODE_INTERNAL_SERVER_ERROR;
+} // end isTransientError
+
+bool retryFailed(wake_step_t step, int code)
+{
+  if (retryState.failures < UINT8_MAX)
+  {
+    ++retryState.failures;
+  }
+  uint32_t error = static_cast<uint32_t>(step) << 16
+                   | (static_cast<uint32_t>(code) & 0xFFFF);
+  if (error == retryState.shown)
+  {
+    return false;
+  }
+  retryState.shown = error;
+  return true;
+} // end retryFailed
+
+void retrySucceeded()
+{
+  retryState = {};
+  return;
+} // end retrySucceeded
+
+void retryScreenReplaced()
+{
+  retryState.shown = 0;
+  return;
+} // end retryScreenReplaced
+
+uint64_t retryDelay(bool transient)
+{
+  if (!transient || retryState.failures == 0)
+  {
+    return 0;
+  }
+  int shift = min(retryState.failures - 1, 16);
+  uint64_t minutes = static_cast<uint64_t>(RETRY_INTERVAL) << shift;
+  if (minutes >= static_cast<uint64_t>(SLEEP_DURATION))
+  {
+    return 0;
+  }
+  int64_t jitter = static_cast<int64_t>(esp_random() % (2 * RETRY_JITTER + 1))
+                   - RETRY_JITTER;
+  return minutes * 60ULL * (100 + jitter) / 100;
+} // end retryDelay
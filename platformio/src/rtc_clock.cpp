@@ -0,0 +1,197 @@
+/* Drift calibrated RTC clock for esp32-weather-epd.
+ * Copyright (C) 2023  Luke Marzen
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <sys/time.h>
+
+#include "config.h"
+#include "rtc_clock.h"
+
+// Largest drift believed, ppm. The RC slow clock is within a few percent.
+#define MAX_DRIFT_PPM 50000
+// Shortest sleep a drift is measured over, us. Shorter sleeps are swamped by
+// the error of the NTP time itself.
+#define MIN_CALIBRATION_SLEEP (10 * 60 * 1000000LL)
+// Difference from an HTTP Date header that is taken as the clock being wrong,
+// us. The header has a resolution of 1s.
+#define DATE_TOLERANCE (2 * 1000000LL)
+// Wake this long after the boundary, us, so the time drawn has reached it.
+// Uncalibrated the RTC may run fast by several seconds per sleep.
+#define SLEEP_MARGIN_CALIBRATED   (1 * 1000000LL)
+#define SLEEP_MARGIN_UNCALIBRATED (10 * 1000000LL)
+
+struct rtc_clock_t
+{
+  int64_t syncUs;   // time of the last NTP sync, 0 if there is no baseline
+  int64_t sleepUs;  // clock when deep sleep began, 0 if not recorded
+  int64_t sleptUs;  // time spent asleep since the last NTP sync
+  int32_t driftPpm; // how much faster than real time the clock runs asleep
+  uint8_t samples;  // number of sleeps the drift was measured over
+};
+
+RTC_DATA_ATTR static rtc_clock_t rtcClock = {};
+static bool       syncedThisWake = false;
+static std::mutex dateMutex;
+static bool       dateChecked = false;
+
+int64_t clockNow()
+{
+  timeval tv;
+  gettimeofday(&tv, NULL);
+  return static_cast<int64_t>(tv.tv_sec) * 1000000LL + tv.tv_usec;
+} // end clockNow
+
+static void setClock(int64_t us)
+{
+  timeval tv = {static_cast<time_t>(us / 1000000LL),
+                static_cast<suseconds_t>(us % 1000000LL)};
+  settimeofday(&tv, NULL);
+  return;
+} // end setClock
+
+void clockWake()
+{
+  if (rtcClock.sleepUs == 0)
+  { // not a timed wake
+    return;
+  }
+  int64_t now = clockNow();
+  int64_t slept = now - rtcClock.sleepUs;
+  int64_t drift = slept * rtcClock.driftPpm / 1000000LL;
+  rtcClock.sleepUs = 0;
+  rtcClock.sleptUs += slept - drift;
+  if (drift != 0)
+  {
+    setClock(now - drift);
+    Serial.printf("Clock: corrected by %lld ms (%d ppm)\n",
+                  drift / 1000LL, rtcClock.driftPpm);
+  }
+  return;
+} // end clockWake
+
+bool clockNeedsSync()
+{
+  if (rtcClock.syncUs == 0 || rtcClock.samples == 0)
+  {
+    return true;
+  }
+  return clockNow() - rtcClock.syncUs
+         >= TIME_SYNC_INTERVAL * 3600LL * 1000000LL;
+} // end clockNeedsSync
+
+void clockSynced(int64_t clockUs, int64_t trueUs)
+{
+  syncedThisWake = true;
+  int64_t error = clockUs - trueUs;
+  Serial.printf("Clock: was off by %lld ms\n", error / 1000LL);
+  if (rtcClock.syncUs != 0 && rtcClock.sleptUs >= MIN_CALIBRATION_SLEEP)
+  { // the error accrued asleep, with the drift estimate at the time
+    int32_t residual = static_cast<int32_t>(error * 1000000LL
+                                            / rtcClock.sleptUs);
+    int32_t measured = rtcClock.driftPpm + residual;
+    // averaged with the previous estimate once there is one, the drift
+    // varies with temperature
+    rtcClock.driftPpm = rtcClock.samples == 0
+                        ? measured
+                        : (rtcClock.driftPpm + measured) / 2;
+    rtcClock.driftPpm = constrain(rtcClock.driftPpm,
+                                  -MAX_DRIFT_PPM, MAX_DRIFT_PPM);
+    if (rtcClock.samples < UINT8_MAX)
+    {
+      ++rtcClock.samples;
+    }
+    Serial.printf("Clock: drift %d ppm over %u sample(s)\n",
+                  rtcClock.driftPpm, rtcClock.samples);
+  }
+  rtcClock.syncUs  = trueUs;
+  rtcClock.sleptUs = 0;
+  return;
+} // end clockSynced
+
+/* Returns the seconds since the epoch of an IMF-fixdate, as sent in the HTTP
+ * Date header ("Sun, 06 Nov 1994 08:49:37 GMT"), or -1 if malformed.
+ */
+static int64_t parseHttpDate(const char *date)
+{
+  static const char *MONTHS = "JanFebMarAprMayJunJulAugSepOctNovDec";
+  char mon[4] = {};
+  int d, y, hh, mm, ss;
+  if (sscanf(date, "%*3s, %d %3s %d %d:%d:%d", &d, mon, &y, &hh, &mm, &ss)
+      != 6)
+  {
+    return -1;
+  }
+  const char *m = strstr(MONTHS, mon);
+  if (strlen(mon) != 3 || m == NULL || (m - MONTHS) % 3 != 0)
+  {
+    return -1;
+  }
+  // days since the epoch of the civil date (Howard Hinnant's algorithm)
+  int month = (m - MONTHS) / 3 + 1;
+  y -= month <= 2;
+  int era = (y >= 0 ? y : y - 399) / 400;
+  int yoe = y - era * 400;
+  int doy = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+  int doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+  int64_t days = static_cast<int64_t>(era) * 146097 + doe - 719468;
+  return days * 86400 + hh * 3600 + mm * 60 + ss;
+} // end parseHttpDate
+
+/* The clock is set from the Date header if it is off by more than the
+ * header's resolution, then the next wake syncs with NTP for a new baseline.
+ * Only the first response of a wake is checked.
+ */
+void clockCheckDate(const String &date)
+{
+  std::lock_guard<std::mutex> lock(dateMutex);
+  if (syncedThisWake || dateChecked || date.length() == 0)
+  {
+    return;
+  }
+  dateChecked = true;
+  int64_t sec = parseHttpDate(date.c_str());
+  if (sec < 0)
+  {
+    return;
+  }
+  // the header is truncated to the second
+  int64_t dateUs = sec * 1000000LL + 500000LL;
+  int64_t error = clockNow() - dateUs;
+  if (error > DATE_TOLERANCE || error < -DATE_TOLERANCE)
+  {
+    Serial.printf("Clock: off by %lld ms from the Date header\n",
+                  error / 1000LL);
+    setClock(dateUs);
+    rtcClock.syncUs  = 0;
+    rtcClock.sleptUs = 0;
+  }
+  return;
+} // end clockCheckDate
+
+uint64_t clockSleepTimer(uint64_t sleepDuration)
+{
+  int64_t now = clockNow();
+  // wake on the second rather than anywhere within it
+  int64_t sleepUs = sleepDuration * 1000000LL - now % 1000000LL;
+  sleepUs += rtcClock.samples > 0 ? SLEEP_MARGIN_CALIBRATED
+                                  : SLEEP_MARGIN_UNCALIBRATED;
+  rtcClock.sleepUs = now;
+  // the timer counts the RTC slow clock, which runs by the drift
+  return sleepUs + sleepUs * rtcClock.driftPpm / 1000000LL;
+} // end clockSleepTimer
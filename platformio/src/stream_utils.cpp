@@ -0,0 +1,612 @@
+/* Stream adapters for esp32-weather-epd.
+ * Copyright (C) 2023  Luke Marzen
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+#include <Arduino.h>
+
+#include "stream_utils.h"
+
+int CountingStream::read()
+{
+  int c = _src.read();
+  if (c >= 0)
+  {
+    ++_count;
+  }
+  return c;
+} // end CountingStream::read
+
+size_t CountingStream::readBytes(char *buffer, size_t length)
+{
+  size_t n = _src.readBytes(buffer, length);
+  _count += n;
+  return n;
+} // end CountingStream::readBytes
+
+size_t MemoryStream::readBytes(char *buffer, size_t length)
+{
+  size_t n = std::min(length, _len - _pos);
+  memcpy(buffer, _data + _pos, n);
+  _pos += n;
+  return n;
+} // end MemoryStream::readBytes
+
+size_t MemoryStream::readSegment(const uint8_t *&data)
+{
+  data = _data + _pos;
+  size_t n = _len - _pos;
+  _pos = _len;
+  return n;
+} // end MemoryStream::readSegment
+
+BufferedClientStream::BufferedClientStream(Client &src, uint8_t *buffer,
+                                           size_t size)
+  : _src(src), _buf(buffer), _size(size), _pos(0), _len(0), _fills(0),
+    _waitTime(0)
+{
+} // end BufferedClientStream::BufferedClientStream
+
+/* Refills the buffer with whatever the client has received, waiting up to the
+ * client's timeout for the first byte.
+ *
+ * Returns true if unread bytes are available.
+ */
+bool BufferedClientStream::fill()
+{
+  if (_pos < _len)
+  {
+    return true;
+  }
+  unsigned long start = millis();
+  unsigned long waitStart = micros();
+  while (_src.available() <= 0)
+  {
+    if (!_src.connected() || millis() - start >= _src.getTimeout())
+    {
+      _waitTime += micros() - waitStart;
+      return false;
+    }
+    delay(1);
+  }
+  _waitTime += micros() - waitStart;
+  int n = _src.read(_buf, _size);
+  _pos = 0;
+  _len = (n > 0) ? n : 0;
+  ++_fills;
+  return _len > 0;
+} // end BufferedClientStream::fill
+
+int BufferedClientStream::available()
+{
+  return (_len - _pos) + std::max(_src.available(), 0);
+} // end BufferedClientStream::available
+
+int BufferedClientStream::peek()
+{
+  return fill() ? _buf[_pos] : -1;
+} // end BufferedClientStream::peek
+
+int BufferedClientStream::read()
+{
+  return fill() ? _buf[_pos++] : -1;
+} // end BufferedClientStream::read
+
+size_t BufferedClientStream::readBytes(char *buffer, size_t length)
+{
+  size_t n = 0;
+  while (n < length && (n == 0 || _pos < _len || _src.available() > 0)
+         && fill())
+  {
+    size_t chunk = std::min(length - n, _len - _pos);
+    memcpy(buffer + n, _buf + _pos, chunk);
+    _pos += chunk;
+    n += chunk;
+  }
+  return n;
+} // end BufferedClientStream::readBytes
+
+size_t BufferedClientStream::readSegment(const uint8_t *&data)
+{
+  if (!fill())
+  {
+    return 0;
+  }
+  data = _buf + _pos;
+  size_t n = _len - _pos;
+  _pos = _len;
+  return n;
+} // end BufferedClientStream::readSegment
+
+#ifdef ARDUINO
+InflateStream::InflateStream(Stream &src, Format format)
+  : _src(src), _format(format), _decomp(nullptr), _window(nullptr),
+    _winOfs(0), _outPos(0), _outEnd(0), _inPos(0), _inLen(0), _srcEnd(false),
+    _started(false), _done(false), _failed(false)
+{
+} // end InflateStream::InflateStream
+
+InflateStream::~InflateStream()
+{
+  free(_decomp);
+  free(_window);
+} // end InflateStream::~InflateStream
+
+/* Allocates the decompressor and its window and consumes the gzip header, if
+ * any.
+ *
+ * Returns true if the stream is ready to be inflated.
+ */
+bool InflateStream::begin()
+{
+  _started = true;
+  _decomp = static_cast<tinfl_decompressor *>(
+                                          malloc(sizeof(tinfl_decompressor)));
+  _window = static_cast<uint8_t *>(malloc(TINFL_LZ_DICT_SIZE));
+  if (_decomp == nullptr || _window == nullptr)
+  {
+    Serial.println("  Failed to allocate inflate window");
+    _failed = _done = true;
+    return false;
+  }
+  tinfl_init(_decomp);
+  if (_format == GZIP && !skipGzipHeader())
+  {
+    Serial.println("  Invalid gzip header");
+    _failed = _done = true;
+    return false;
+  }
+  return true;
+} // end InflateStream::begin
+
+/* Returns the next compressed byte from the source stream, or -1 once the
+ * source stream has ended.
+ */
+int InflateStream::srcRead()
+{
+  if (_inPos == _inLen)
+  {
+    if (_srcEnd)
+    {
+      return -1;
+    }
+    _inLen = _src.readBytes(reinterpret_cast<char *>(_in), sizeof(_in));
+    _inPos = 0;
+    if (_inLen == 0)
+    {
+      _srcEnd = true;
+      return -1;
+    }
+  }
+  return _in[_inPos++];
+} // end InflateStream::srcRead
+
+/* Consumes the gzip member header (RFC 1952) so that the raw deflate data
+ * follows. The trailing CRC-32 and size are not verified, the JSON
+ * deserializer catches corrupted documents.
+ *
+ * Returns true if the header is valid.
+ */
+bool InflateStream::skipGzipHeader()
+{
+  const uint8_t FHCRC    = 0x02;
+  const uint8_t FEXTRA   = 0x04;
+  const uint8_t FNAME    = 0x08;
+  const uint8_t FCOMMENT = 0x10;
+
+  uint8_t hdr[10];
+  for (int i = 0; i < 10; ++i)
+  {
+    int c = srcRead();
+    if (c < 0)
+    {
+      return false;
+    }
+    hdr[i] = static_cast<uint8_t>(c);
+  }
+  // magic number and compression method (8 = deflate)
+  if (hdr[0] != 0x1f || hdr[1] != 0x8b || hdr[2] != 8)
+  {
+    return false;
+  }
+
+  uint8_t flags = hdr[3];
+  if (flags & FEXTRA)
+  {
+    int lo = srcRead();
+    int hi = srcRead();
+    if (lo < 0 || hi < 0)
+    {
+      return false;
+    }
+    for (int n = lo | (hi << 8); n > 0; --n)
+    {
+      if (srcRead() < 0)
+      {
+        return false;
+      }
+    }
+  }
+  // zero-terminated file name and comment
+  for (uint8_t field : {FNAME, FCOMMENT})
+  {
+    if (flags & field)
+    {
+      int c;
+      do
+      {
+        c = srcRead();
+      } while (c > 0);
+      if (c < 0)
+      {
+        return false;
+      }
+    }
+  }
+  if (flags & FHCRC)
+  {
+    if (srcRead() < 0 || srcRead() < 0)
+    {
+      return false;
+    }
+  }
+  return true;
+} // end InflateStream::skipGzipHeader
+
+/* Inflates the next block of output into the window.
+ *
+ * Returns true if unread output is available.
+ */
+bool InflateStream::fill()
+{
+  if (!_started && !begin())
+  {
+    return false;
+  }
+
+  while (_outPos == _outEnd && !_done)
+  {
+    if (_inPos == _inLen && !_srcEnd)
+    {
+      _inLen = _src.readBytes(reinterpret_cast<char *>(_in), sizeof(_in));
+      _inPos = 0;
+      _srcEnd = (_inLen == 0);
+    }
+
+    mz_uint32 flags = 0;
+    if (!_srcEnd)
+    {
+      flags |= TINFL_FLAG_HAS_MORE_INPUT;
+    }
+    if (_format == ZLIB)
+    {
+      flags |= TINFL_FLAG_PARSE_ZLIB_HEADER;
+    }
+
+    size_t inBytes  = _inLen - _inPos;
+    size_t outBytes = TINFL_LZ_DICT_SIZE - _winOfs;
+    tinfl_status status = tinfl_decompress(_decomp, _in + _inPos, &inBytes,
+                                           _window, _window + _winOfs,
+                                           &outBytes, flags);
+    _inPos += inBytes;
+    _outPos = _winOfs;
+    _outEnd = _winOfs + outBytes;
+    _winOfs = (_winOfs + outBytes) & (TINFL_LZ_DICT_SIZE - 1);
+
+    if (status == TINFL_STATUS_DONE)
+    {
+      _done = true;
+    }
+    else if (status < TINFL_STATUS_DONE
+          || (status == TINFL_STATUS_NEEDS_MORE_INPUT && _srcEnd))
+    { // corrupt or truncated input
+      _done = _failed = true;
+    }
+  }
+  return _outPos < _outEnd;
+} // end InflateStream::fill
+
+int InflateStream::available()
+{
+  if (_outPos < _outEnd)
+  {
+    return _outEnd - _outPos;
+  }
+  return _done ? 0 : (_inLen - _inPos) + _src.available();
+} // end InflateStream::available
+
+int InflateStream::peek()
+{
+  if (!fill())
+  {
+    return -1;
+  }
+  return _window[_outPos];
+} // end InflateStream::peek
+
+int InflateStream::read()
+{
+  if (!fill())
+  {
+    return -1;
+  }
+  return _window[_outPos++];
+} // end InflateStream::read
+
+size_t InflateStream::readBytes(char *buffer, size_t length)
+{
+  size_t n = 0;
+  while (n < length && fill())
+  {
+    size_t chunk = std::min(length - n, _outEnd - _outPos);
+    memcpy(buffer + n, _window + _outPos, chunk);
+    _outPos += chunk;
+    n += chunk;
+  }
+  return n;
+} // end InflateStream::readBytes
+
+size_t InflateStream::readSegment(const uint8_t *&data)
+{
+  if (!fill())
+  {
+    return 0;
+  }
+  data = _window + _outPos;
+  size_t n = _outEnd - _outPos;
+  _outPos = _outEnd;
+  return n;
+} // end InflateStream::readSegment
+#endif
+
+JsonScanner::JsonScanner()
+  : _objects(0), _depth(0), _expectKey(false), _afterColon(false),
+    _inString(false), _isKey(false), _memberString(false), _escape(0),
+    _highSurrogate(false), _codeUnit(0), _scalarMember(false), _strLen(0),
+    _keyLen(0), _scalarLen(0)
+{
+  _key[0]     = '\0';
+  _rootKey[0] = '\0';
+  _scalar[0]  = '\0';
+} // end JsonScanner::JsonScanner
+
+bool JsonScanner::feed(char c)
+{
+  if (_inString)
+  {
+    if (_escape > 0)
+    {
+      if (_escape == 5)
+      { // the byte after the backslash, only u is followed by more
+        _escape = (c == 'u') ? 4 : 0;
+        _codeUnit = 0;
+        _highSurrogate = false;
+      }
+      else
+      {
+        _codeUnit = (_codeUnit << 4) | (isdigit(static_cast<unsigned char>(c))
+                                        ? c - '0' : (c | 0x20) - 'a' + 10);
+        if (--_escape == 0)
+        {
+          _highSurrogate = _codeUnit >= 0xD800 && _codeUnit < 0xDC00;
+        }
+      }
+      if (_isKey && _keyLen < sizeof(_key) - 1)
+      {
+        _key[_keyLen++] = c;
+      }
+      ++_strLen;
+      return false;
+    }
+    if (c == '"')
+    {
+      _inString = false;
+      if (_isKey)
+      {
+        _key[_keyLen] = '\0';
+        if (_depth == 1)
+        {
+          memcpy(_rootKey, _key, _keyLen + 1);
+        }
+      }
+      return false;
+    }
+    if (c == '\\')
+    { // \uXXXX is the longest escape sequence, 5 more bytes
+      _escape = 5;
+    }
+    else
+    {
+      _highSurrogate = false;
+    }
+    if (_isKey && _keyLen < sizeof(_key) - 1)
+    {
+      _key[_keyLen++] = c;
+    }
+    ++_strLen;
+    return false;
+  }
+
+  // numbers and the literals true, false and null
+  if (isalnum(static_cast<unsigned char>(c))
+   || c == '-' || c == '+' || c == '.')
+  {
+    if (_scalarLen == 0)
+    {
+      _scalarMember = _afterColon;
+      _afterColon = false;
+    }
+    if (_scalarLen < sizeof(_scalar) - 1)
+    {
+      _scalar[_scalarLen++] = c;
+    }
+    return false;
+  }
+  bool terminated = _scalarLen > 0;
+  if (terminated)
+  {
+    _scalar[_scalarLen] = '\0';
+    _scalarLen = 0;
+  }
+
+  bool inObject = _depth > 0 && _depth <= 32
+                  && (_objects & (1UL << (_depth - 1)));
+  switch (c)
+  {
+  case '"':
+    _inString      = true;
+    _escape        = 0;
+    _highSurrogate = false;
+    _strLen        = 0;
+    _isKey         = _expectKey;
+    _memberString  = !_isKey && _afterColon;
+    _afterColon    = false;
+    _keyLen        = 0;
+    break;
+  case '{':
+  case '[':
+    if (_depth < 32)
+    {
+      if (c == '{')
+      {
+        _objects |= (1UL << _depth);
+      }
+      else
+      {
+        _objects &= ~(1UL << _depth);
+      }
+    }
+    ++_depth;
+    _expectKey  = (c == '{');
+    _afterColon = false;
+    break;
+  case '}':
+  case ']':
+    --_depth;
+    _expectKey  = false;
+    _afterColon = false;
+    break;
+  case ',':
+    _expectKey  = inObject;
+    _afterColon = false;
+    break;
+  case ':':
+    _expectKey  = false;
+    _afterColon = true;
+    break;
+  default: // whitespace
+    break;
+  }
+  return terminated;
+} // end JsonScanner::feed
+
+JsonBodyReader::JsonBodyReader(SegmentedStream &src)
+  : _src(src), _seg(nullptr), _pos(0), _len(0), _count(0), _scanning(false),
+    _truncKey(nullptr), _maxLen(0), _skipping(false), _tapRoot(nullptr),
+    _tapKey(nullptr), _tapFn(nullptr), _tapCtx(nullptr)
+{
+} // end JsonBodyReader::JsonBodyReader
+
+void JsonBodyReader::truncate(const char *key, size_t maxLen)
+{
+  _truncKey = key;
+  _maxLen   = maxLen;
+  _scanning = true;
+  return;
+} // end JsonBodyReader::truncate
+
+void JsonBodyReader::tap(const char *rootKey, const char *key, tap_t fn,
+                         void *ctx)
+{
+  _tapRoot  = rootKey;
+  _tapKey   = key;
+  _tapFn    = fn;
+  _tapCtx   = ctx;
+  _scanning = true;
+  return;
+} // end JsonBodyReader::tap
+
+/* Takes the next segment out of the stream, one virtual call for all of its
+ * bytes.
+ *
+ * Returns true if unread bytes are available.
+ */
+bool JsonBodyReader::fill()
+{
+  _count += _len;
+  _pos = 0;
+  _len = _src.readSegment(_seg);
+  return _len > 0;
+} // end JsonBodyReader::fill
+
+/* Advances the scanner by one byte, truncating and tapping as configured.
+ *
+ * Returns true if the byte should be passed through.
+ */
+bool JsonBodyReader::keep(char c)
+{
+  bool drop = false;
+  if (_truncKey != nullptr && _scanner.inString())
+  {
+    if (!_scanner.inEscape() && c == '"')
+    { // end of string, the closing quote is always passed through
+      _skipping = false;
+    }
+    else if (_skipping)
+    {
+      drop = true;
+    }
+    // only cut at the start of a character, never inside an escape sequence
+    // or between the two escapes of a surrogate pair
+    else if (_scanner.stringLength() >= _maxLen && _scanner.atCharBoundary()
+          && (static_cast<uint8_t>(c) & 0xC0) != 0x80
+          && _scanner.inMemberString()
+          && strcmp(_scanner.key(), _truncKey) == 0)
+    {
+      drop = _skipping = true;
+    }
+  }
+  if (_scanner.feed(c) && _tapKey != nullptr && _scanner.scalarIsMember()
+   && strcmp(_scanner.key(), _tapKey) == 0
+   && strcmp(_scanner.rootKey(), _tapRoot) == 0)
+  {
+    char *end;
+    float value = strtof(_scanner.scalar(), &end);
+    if (end != _scanner.scalar())
+    {
+      _tapFn(value, _tapCtx);
+    }
+  }
+  return !drop;
+} // end JsonBodyReader::keep
+
+size_t JsonBodyReader::readBytes(char *buffer, size_t length)
+{
+  size_t n = 0;
+  while (n < length)
+  {
+    int c = read();
+    if (c < 0)
+    {
+      break;
+    }
+    buffer[n++] = static_cast<char>(c);
+  }
+  return n;
+} // end JsonBodyReader::readBytes
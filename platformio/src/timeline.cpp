@@ -0,0 +1,122 @@
+/* Forecast timeline for esp32-weather-epd.
+ * Copyright (C) 2023  Luke Marzen
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <cmath>
+
+#include "timeline.h"
+
+/* Builds the timeline from the packed forecast stores, the current conditions
+ * and the air pollution history. The first hourly forecast is taken to be the
+ * current hour. Every sample goes into the slot of its hour, so a forecast
+ * with gaps, or a history whose newest hour lags behind, lines up with the
+ * rest.
+ */
+void buildTimeline(timeline_t &tl,
+                   const hourly_store_t &hourly,
+                   const daily_store_t &daily,
+                   const owm_current_t &current,
+                   const owm_resp_air_pollution_t &air)
+{
+  // as far as the last hour forecast, which is further than the number of
+  // hours forecast if there are gaps
+  int ahead = (hourly.count > 0) ? hourly.hour[hourly.count - 1] + 1 : 1;
+  tl.now   = TIMELINE_PAST;
+  tl.start = hourly.dt(0) - 3600LL * TIMELINE_PAST;
+  tl.count = TIMELINE_PAST + std::min(ahead, OWM_NUM_HOURLY);
+
+  // local calendar day of each daily forecast
+  int dayYear[OWM_NUM_DAILY];
+  for (int i = 0; i < daily.count; ++i)
+  {
+    time_t ts = daily.dt(i);
+    tm t;
+    localtime_r(&ts, &t);
+    dayYear[i]          = t.tm_year * 366 + t.tm_yday;
+    tl.day_wday[i]      = t.tm_wday;
+    tl.day_temp_min[i]  = daily.tempMinAt(i).in<TemperatureUnit>();
+    tl.day_temp_max[i]  = daily.tempMaxAt(i).in<TemperatureUnit>();
+  }
+
+  // local time of every slot, and the daily forecast of its day
+  for (int s = 0; s < tl.count; ++s)
+  {
+    time_t ts = tl.start + 3600 * s;
+    tm t;
+    localtime_r(&ts, &t);
+    tl.hour[s] = t.tm_hour;
+    tl.temp[s] = NAN;
+    tl.pop[s]  = 0;
+    tl.air[s]  = -1;
+    tl.day[s]  = -1;
+    for (int i = 0; i < daily.count; ++i)
+    {
+      if (dayYear[i] == t.tm_year * 366 + t.tm_yday)
+      {
+        tl.day[s] = i;
+        break;
+      }
+    }
+  }
+
+  for (int i = 0; i < hourly.count; ++i)
+  {
+    int s = tl.now + hourly.hour[i];
+    if (s < tl.count)
+    {
+      tl.temp[s] = hourly.tempAt(i).in<TemperatureUnit>();
+      tl.pop[s]  = hourly.pop[i];
+    }
+  }
+
+  for (int i = 0; i < OWM_NUM_AIR_POLLUTION; ++i)
+  {
+    if (air.dt[i] < tl.start)
+    { // sample missing or too old
+      continue;
+    }
+    int s = (air.dt[i] - tl.start) / 3600;
+    if (s < tl.count)
+    {
+      tl.air[s] = i;
+    }
+  }
+
+  // the temperature range of the outlook graph, over the packed column, from
+  // the hours that fall within it
+  int graphHours = 0;
+  while (graphHours < hourly.count
+         && hourly.hour[graphHours] < HOURLY_GRAPH_MAX)
+  {
+    ++graphHours;
+  }
+  tl.graph_temp_min = NAN;
+  tl.graph_temp_max = NAN;
+  if (graphHours > 0)
+  {
+    Quantity<Kelvin> lo, hi;
+    hourly.tempRange(graphHours, lo, hi);
+    tl.graph_temp_min = lo.in<TemperatureUnit>();
+    tl.graph_temp_max = hi.in<TemperatureUnit>();
+  }
+
+  time_t ts = current.sunrise;
+  localtime_r(&ts, &tl.sunrise);
+  ts = current.sunset;
+  localtime_r(&ts, &tl.sunset);
+  return;
+} // end buildTimeline
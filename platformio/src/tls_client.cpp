@@ -0,0 +1,376 @@
+/* TLS client with session resumption for esp32-weather-epd.
+ * Copyright (C) 2023  Luke Marzen
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <cstring>
+#include <fcntl.h>
+#include <mutex>
+#include <WiFi.h>
+#include <mbedtls/error.h>
+#include <mbedtls/platform.h>
+
+#include "config.h"
+#include "memo.h"
+#include "tls_client.h"
+
+#ifdef USE_HTTPS
+
+// Time allowed for a handshake or a write to complete, ms.
+#define TLS_TIMEOUT 5000
+// Largest serialized session kept, bytes. The server's certificate is not
+// kept with it (see storeSession), this is mostly the session ticket.
+#define TLS_SESSION_SIZE 1024
+
+/* Session of the last full handshake. Only one is kept, RTC memory is scarce
+ * and a provider makes most or all of its requests to one host.
+ */
+struct tls_session_cache_t
+{
+  uint32_t host;   // FNV-1a hash of the host name
+  uint16_t length; // 0 if empty
+  uint8_t  data[TLS_SESSION_SIZE];
+};
+
+RTC_DATA_ATTR static tls_session_cache_t tlsSession = {};
+// concurrent requests handshake at the same time
+static std::mutex tlsSessionMutex;
+
+/* Offers the cached session, if it is for this host.
+ */
+static void loadSession(mbedtls_ssl_context &ssl, uint32_t host)
+{
+  std::lock_guard<std::mutex> lock(tlsSessionMutex);
+  if (tlsSession.length == 0 || tlsSession.host != host)
+  {
+    return;
+  }
+  mbedtls_ssl_session session;
+  mbedtls_ssl_session_init(&session);
+  if (mbedtls_ssl_session_load(&session, tlsSession.data,
+                               tlsSession.length) == 0)
+  {
+    mbedtls_ssl_set_session(&ssl, &session);
+  }
+  mbedtls_ssl_session_free(&session);
+  return;
+} // end loadSession
+
+/* Caches the session just negotiated, which for a resumed session may carry a
+ * new ticket.
+ *
+ * The server's certificate is dropped from the copy first. It would be most of
+ * the serialized session, and a resumed handshake does not verify it again.
+ */
+static void storeSession(mbedtls_ssl_context &ssl, uint32_t host)
+{
+  std::lock_guard<std::mutex> lock(tlsSessionMutex);
+  tlsSession.length = 0;
+  mbedtls_ssl_session session;
+  mbedtls_ssl_session_init(&session);
+  if (mbedtls_ssl_get_session(&ssl, &session) != 0)
+  {
+    Serial.println("  TLS: session not cached");
+    mbedtls_ssl_session_free(&session);
+    return;
+  }
+#if defined(MBEDTLS_SSL_KEEP_PEER_CERTIFICATE)
+  if (session.peer_cert != NULL)
+  {
+    mbedtls_x509_crt_free(session.peer_cert);
+    mbedtls_free(session.peer_cert);
+    session.peer_cert = NULL;
+  }
+#endif
+  // the first call only measures the session
+  size_t length = 0;
+  mbedtls_ssl_session_save(&session, NULL, 0, &length);
+  if (length > TLS_SESSION_SIZE)
+  {
+    Serial.printf("  TLS: session of %u B not cached, increase "
+                  "TLS_SESSION_SIZE\n", length);
+  }
+  else if (mbedtls_ssl_session_save(&session, tlsSession.data,
+                                    TLS_SESSION_SIZE, &length) == 0)
+  {
+    tlsSession.host   = host;
+    tlsSession.length = length;
+  }
+  mbedtls_ssl_session_free(&session);
+  return;
+} // end storeSession
+
+TlsClient::TlsClient()
+  : _tls(false), _peek(-1), _rootCA(NULL), _handshakeTime(0),
+    _resumed(false)
+{
+} // end TlsClient::TlsClient
+
+TlsClient::~TlsClient()
+{
+  stop();
+} // end TlsClient::~TlsClient
+
+int TlsClient::connect(IPAddress ip, uint16_t port)
+{
+  return connect(ip, port, WIFI_CLIENT_DEF_CONN_TIMEOUT_MS);
+} // end TlsClient::connect
+
+int TlsClient::connect(IPAddress ip, uint16_t port, int32_t timeout)
+{
+  stop();
+  if (!WiFiClient::connect(ip, port, timeout))
+  {
+    return 0;
+  }
+  return handshake();
+} // end TlsClient::connect
+
+int TlsClient::connect(const char *host, uint16_t port)
+{
+  return connect(host, port, WIFI_CLIENT_DEF_CONN_TIMEOUT_MS);
+} // end TlsClient::connect
+
+int TlsClient::connect(const char *host, uint16_t port, int32_t timeout)
+{
+  IPAddress ip;
+  if (!WiFi.hostByName(host, ip))
+  {
+    return 0;
+  }
+  _serverName = host;
+  return connect(ip, port, timeout);
+} // end TlsClient::connect
+
+/* Performs the TLS handshake over the open TCP connection, resuming the cached
+ * session if the server still accepts it. The server must be verified, with no
+ * root certificate set the handshake is not attempted.
+ *
+ * Returns 1 on success, otherwise 0 and the connection is closed.
+ */
+int TlsClient::handshake()
+{
+  if (_rootCA == NULL)
+  {
+    Serial.printf("  TLS: no root certificate for %s, see config.cpp\n",
+                  _serverName.c_str());
+    stop();
+    return 0;
+  }
+  unsigned long start = millis();
+  _resumed = false;
+  _tls = true;
+  mbedtls_ssl_init(&_ssl);
+  mbedtls_ssl_config_init(&_conf);
+  mbedtls_ctr_drbg_init(&_drbg);
+  mbedtls_entropy_init(&_entropy);
+  mbedtls_x509_crt_init(&_ca);
+  mbedtls_net_init(&_net);
+  _net.fd = fd();
+  fcntl(_net.fd, F_SETFL, fcntl(_net.fd, F_GETFL, 0) | O_NONBLOCK);
+
+  const char *host = _serverName.c_str();
+  int ret = mbedtls_ctr_drbg_seed(&_drbg, mbedtls_entropy_func, &_entropy,
+                                  NULL, 0);
+  if (ret == 0)
+  {
+    ret = mbedtls_ssl_config_defaults(&_conf, MBEDTLS_SSL_IS_CLIENT,
+                                      MBEDTLS_SSL_TRANSPORT_STREAM,
+                                      MBEDTLS_SSL_PRESET_DEFAULT);
+  }
+  if (ret == 0)
+  {
+    ret = mbedtls_x509_crt_parse(&_ca,
+                                 reinterpret_cast<const uint8_t *>(_rootCA),
+                                 strlen(_rootCA) + 1);
+    mbedtls_ssl_conf_ca_chain(&_conf, &_ca, NULL);
+    mbedtls_ssl_conf_authmode(&_conf, MBEDTLS_SSL_VERIFY_REQUIRED);
+  }
+  if (ret == 0)
+  {
+    mbedtls_ssl_conf_rng(&_conf, mbedtls_ctr_drbg_random, &_drbg);
+    mbedtls_ssl_conf_session_tickets(&_conf,
+                                     MBEDTLS_SSL_SESSION_TICKETS_ENABLED);
+    ret = mbedtls_ssl_setup(&_ssl, &_conf);
+  }
+  if (ret == 0)
+  {
+    ret = mbedtls_ssl_set_hostname(&_ssl, host);
+  }
+  uint32_t hostHash = fnv1a(host, strlen(host));
+  if (ret == 0)
+  {
+    mbedtls_ssl_set_bio(&_ssl, &_net, mbedtls_net_send, mbedtls_net_recv,
+                        NULL);
+    loadSession(_ssl, hostHash);
+  }
+
+  // stepped through, rather than mbedtls_ssl_handshake, to see where the
+  // server hello leads: straight to ChangeCipherSpec if the server resumed
+  while (ret == 0 && _ssl.state != MBEDTLS_SSL_HANDSHAKE_OVER)
+  {
+    int state = _ssl.state;
+    ret = mbedtls_ssl_handshake_step(&_ssl);
+    if (state == MBEDTLS_SSL_SERVER_HELLO && _ssl.state != state)
+    {
+      _resumed = _ssl.state == MBEDTLS_SSL_SERVER_CHANGE_CIPHER_SPEC;
+    }
+    if (ret == MBEDTLS_ERR_SSL_WANT_READ || ret == MBEDTLS_ERR_SSL_WANT_WRITE)
+    {
+      if (millis() - start > TLS_TIMEOUT)
+      {
+        break;
+      }
+      delay(1);
+      ret = 0;
+    }
+  }
+  _handshakeTime = millis() - start;
+
+  if (ret != 0 || _ssl.state != MBEDTLS_SSL_HANDSHAKE_OVER)
+  {
+    char err[100];
+    mbedtls_strerror(ret, err, sizeof(err));
+    Serial.printf("  TLS: handshake with %s failed: %s\n", host, err);
+    stop();
+    return 0;
+  }
+  Serial.printf("  TLS: %s handshake with %s in %lu ms\n",
+                _resumed ? "resumed" : "full", host, _handshakeTime);
+  storeSession(_ssl, hostHash);
+  return 1;
+} // end TlsClient::handshake
+
+size_t TlsClient::write(uint8_t data)
+{
+  return write(&data, 1);
+} // end TlsClient::write
+
+size_t TlsClient::write(const uint8_t *buf, size_t size)
+{
+  if (!_tls)
+  {
+    return 0;
+  }
+  unsigned long start = millis();
+  size_t sent = 0;
+  while (sent < size)
+  {
+    int ret = mbedtls_ssl_write(&_ssl, buf + sent, size - sent);
+    if (ret > 0)
+    {
+      sent += ret;
+    }
+    else if ((ret != MBEDTLS_ERR_SSL_WANT_READ
+              && ret != MBEDTLS_ERR_SSL_WANT_WRITE)
+             || millis() - start > TLS_TIMEOUT)
+    {
+      break;
+    }
+    else
+    {
+      delay(1);
+    }
+  }
+  return sent;
+} // end TlsClient::write
+
+/* Returns the number of decrypted bytes ready to be read. Whatever has been
+ * received is decrypted first, without waiting for more.
+ */
+int TlsClient::available()
+{
+  if (!_tls)
+  {
+    return 0;
+  }
+  if (mbedtls_ssl_get_bytes_avail(&_ssl) == 0)
+  {
+    mbedtls_ssl_read(&_ssl, NULL, 0);
+  }
+  return mbedtls_ssl_get_bytes_avail(&_ssl) + (_peek >= 0 ? 1 : 0);
+} // end TlsClient::available
+
+int TlsClient::read()
+{
+  uint8_t c;
+  return read(&c, 1) == 1 ? c : -1;
+} // end TlsClient::read
+
+int TlsClient::read(uint8_t *buf, size_t size)
+{
+  if (!_tls || size == 0)
+  {
+    return -1;
+  }
+  int n = 0;
+  if (_peek >= 0)
+  {
+    buf[n++] = _peek;
+    _peek = -1;
+  }
+  if (n < static_cast<int>(size))
+  {
+    int ret = mbedtls_ssl_read(&_ssl, buf + n, size - n);
+    if (ret > 0)
+    {
+      n += ret;
+    }
+  }
+  return n > 0 ? n : -1;
+} // end TlsClient::read
+
+int TlsClient::peek()
+{
+  if (_peek < 0)
+  {
+    _peek = read();
+  }
+  return _peek;
+} // end TlsClient::peek
+
+void TlsClient::flush()
+{
+  return;
+} // end TlsClient::flush
+
+void TlsClient::stop()
+{
+  if (_tls)
+  {
+    mbedtls_ssl_close_notify(&_ssl);
+    mbedtls_ssl_free(&_ssl);
+    mbedtls_ssl_config_free(&_conf);
+    mbedtls_ctr_drbg_free(&_drbg);
+    mbedtls_entropy_free(&_entropy);
+    mbedtls_x509_crt_free(&_ca);
+    _tls = false;
+  }
+  _peek = -1;
+  WiFiClient::stop();
+  return;
+} // end TlsClient::stop
+
+uint8_t TlsClient::connected()
+{
+  if (!_tls)
+  {
+    return 0;
+  }
+  return mbedtls_ssl_get_bytes_avail(&_ssl) > 0 || _peek >= 0
+         || WiFiClient::connected();
+} // end TlsClient::connected
+
+#endif
@@ -0,0 +1,119 @@
+/* Weather providers for esp32-weather-epd.
+ * Copyright (C) 2023  Luke Marzen
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <Arduino.h>
+#include <WiFi.h>
+
+#include "api_response.h"
+#include "client_utils.h"
+#include "config.h"
+#include "weather_provider.h"
+
+/* OpenWeatherMap's One Call and Air Pollution APIs.
+ */
+class OWMProvider : public WeatherProvider
+{
+public:
+  String forecastApi() const override
+  {
+    return "One Call " + OWM_ONECALL_VERSION + " API";
+  }
+  String airPollutionApi() const override
+  {
+    return "Air Pollution API";
+  }
+  bool partialForecast() const override
+  {
+    return true;
+  }
+  int getForecast(HttpSession &session, owm_resp_onecall_t &r,
+                  uint8_t sections) override
+  {
+    return getOWMonecall(session, r, sections);
+  }
+  int getAirPollution(HttpSession &session,
+                      owm_resp_air_pollution_t &r, int hours) override
+  {
+    return getOWMairpollution(session, r, hours);
+  }
+};
+
+/* Open-Meteo's Forecast and Air Quality APIs.
+ */
+class OpenMeteoProvider : public WeatherProvider
+{
+public:
+  String forecastApi() const override
+  {
+    return "Open-Meteo Forecast API";
+  }
+  String airPollutionApi() const override
+  {
+    return "Open-Meteo Air Quality API";
+  }
+  int getForecast(HttpSession &session, owm_resp_onecall_t &r,
+                  uint8_t) override
+  {
+    return getOpenMeteoForecast(session, r);
+  }
+  int getAirPollution(HttpSession &session,
+                      owm_resp_air_pollution_t &r, int hours) override
+  {
+    return getOpenMeteoAirQuality(session, r, hours);
+  }
+};
+
+#ifdef WEATHER_PROVIDER_OWM_PROXY
+/* OpenWeatherMap's One Call and Air Pollution APIs, through the API proxy.
+ */
+class OWMProxyProvider : public WeatherProvider
+{
+public:
+  String forecastApi() const override
+  {
+    return "One Call API (proxy)";
+  }
+  String airPollutionApi() const override
+  {
+    return "Air Pollution API (proxy)";
+  }
+  int getForecast(HttpSession &session, owm_resp_onecall_t &r,
+                  uint8_t sections) override
+  {
+    return getProxyOneCall(session, r, sections);
+  }
+  int getAirPollution(HttpSession &session,
+                      owm_resp_air_pollution_t &r, int hours) override
+  {
+    return getProxyAirPollution(session, r, hours);
+  }
+};
+#endif
+
+/* Returns the provider selected in config.h.
+ */
+WeatherProvider &weatherProvider()
+{
+#if defined(WEATHER_PROVIDER_OPEN_METEO)
+  static OpenMeteoProvider provider;
+#elif defined(WEATHER_PROVIDER_OWM_PROXY)
+  static OWMProxyProvider provider;
+#else
+  static OWMProvider provider;
+#endif
+  return provider;
+} // end weatherProvider
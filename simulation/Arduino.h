@@ -2,7 +2,12 @@
 #define ARDUINO_H
 
 #include <QString>
+#include <chrono>
 #include <cmath>
+#include <cstdarg>
+#include <cstdint>
+#include <cstdio>
+#include <thread>
 
 using std::max, std::round;
 
@@ -148,6 +153,114 @@ inline int toLowerCase(int c)
 }
 
 #define PROGMEM
+#define RTC_DATA_ATTR
+
+inline unsigned long millis()
+{
+    using namespace std::chrono;
+    return duration_cast<milliseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+inline unsigned long micros()
+{
+    using namespace std::chrono;
+    return duration_cast<microseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+inline void delay(unsigned long ms)
+{
+    std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+class Print
+{
+public:
+    virtual ~Print() {}
+
+    virtual size_t write(uint8_t c) = 0;
+
+    virtual size_t write(const uint8_t *buffer, size_t size)
+    {
+        size_t n = 0;
+        while (n < size && write(buffer[n]))
+            ++n;
+        return n;
+    }
+
+    virtual void flush() {}
+};
+
+// The subset of the Arduino Stream used by the stream adapters, with the
+// same blocking readBytes().
+class Stream : public Print
+{
+public:
+    virtual int available() = 0;
+    virtual int read() = 0;
+    virtual int peek() = 0;
+
+    virtual size_t readBytes(char *buffer, size_t length)
+    {
+        size_t n = 0;
+        while (n < length) {
+            int c = timedRead();
+            if (c < 0)
+                break;
+            buffer[n++] = static_cast<char>(c);
+        }
+        return n;
+    }
+
+    void setTimeout(unsigned long timeout) { _timeout = timeout; }
+    unsigned long getTimeout() const { return _timeout; }
+
+protected:
+    int timedRead()
+    {
+        unsigned long start = millis();
+        do {
+            int c = read();
+            if (c >= 0)
+                return c;
+        } while (millis() - start < _timeout);
+        return -1;
+    }
+
+    unsigned long _timeout = 1000;
+};
+
+class Client : public Stream
+{
+public:
+    using Stream::read;
+    virtual int read(uint8_t *buffer, size_t size) = 0;
+    virtual uint8_t connected() = 0;
+    virtual void stop() = 0;
+};
+
+// Serial output goes to stderr.
+class HardwareSerial
+{
+public:
+    void print(const String &s) { fputs(s.c_str(), stderr); }
+
+    void println(const String &s = {})
+    {
+        print(s);
+        fputc('\n', stderr);
+    }
+
+    int printf(const char *format, ...) __attribute__((format(printf, 2, 3)))
+    {
+        va_list args;
+        va_start(args, format);
+        int n = vfprintf(stderr, format, args);
+        va_end(args);
+        return n;
+    }
+};
+
+inline HardwareSerial Serial;
 
 enum {
     A0,
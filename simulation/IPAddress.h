@@ -0,0 +1,25 @@
+#pragma once
+
+#include <Arduino.h>
+#include <arpa/inet.h>
+
+// An IPv4 address, held in network byte order like the Arduino one.
+class IPAddress
+{
+public:
+    IPAddress(uint32_t address = 0)
+        : _address(address)
+    {}
+
+    operator uint32_t() const { return _address; }
+
+    String toString() const
+    {
+        char buf[INET_ADDRSTRLEN];
+        inet_ntop(AF_INET, &_address, buf, sizeof(buf));
+        return String(buf);
+    }
+
+private:
+    uint32_t _address;
+};
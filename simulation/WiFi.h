@@ -0,0 +1,25 @@
+#pragma once
+
+#include <IPAddress.h>
+#include <WiFiClient.h>
+#include <WiFiType.h>
+#include <netdb.h>
+
+// Name lookup of the ESP32 WiFi class, through the host's resolver.
+class WiFiClass
+{
+public:
+    int hostByName(const char *host, IPAddress &ip)
+    {
+        addrinfo hints = {};
+        hints.ai_family = AF_INET;
+        addrinfo *result = nullptr;
+        if (getaddrinfo(host, nullptr, &hints, &result) != 0)
+            return 0;
+        ip = reinterpret_cast<sockaddr_in *>(result->ai_addr)->sin_addr.s_addr;
+        freeaddrinfo(result);
+        return 1;
+    }
+};
+
+inline WiFiClass WiFi;
@@ -0,0 +1,107 @@
+#pragma once
+
+#include <Arduino.h>
+#include <IPAddress.h>
+#include <cerrno>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#define WIFI_CLIENT_DEF_CONN_TIMEOUT_MS 3000
+
+// A TCP connection over a POSIX socket, the subset of the ESP32 WiFiClient
+// that the device code uses.
+class WiFiClient : public Client
+{
+public:
+    ~WiFiClient() override { stop(); }
+
+    virtual int connect(IPAddress ip, uint16_t port)
+    {
+        return connect(ip, port, WIFI_CLIENT_DEF_CONN_TIMEOUT_MS);
+    }
+
+    virtual int connect(IPAddress ip, uint16_t port, int32_t timeout)
+    {
+        stop();
+        _fd = socket(AF_INET, SOCK_STREAM, 0);
+        if (_fd < 0)
+            return 0;
+        sockaddr_in addr = {};
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(port);
+        addr.sin_addr.s_addr = ip;
+        // connect with a timeout, then block as the ESP32 one does
+        fcntl(_fd, F_SETFL, fcntl(_fd, F_GETFL, 0) | O_NONBLOCK);
+        if (::connect(_fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) < 0) {
+            pollfd pfd = {_fd, POLLOUT, 0};
+            int error = 0;
+            socklen_t len = sizeof(error);
+            if (errno != EINPROGRESS || poll(&pfd, 1, timeout) != 1
+                || getsockopt(_fd, SOL_SOCKET, SO_ERROR, &error, &len) < 0 || error != 0) {
+                stop();
+                return 0;
+            }
+        }
+        fcntl(_fd, F_SETFL, fcntl(_fd, F_GETFL, 0) & ~O_NONBLOCK);
+        int one = 1;
+        setsockopt(_fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        return 1;
+    }
+
+    size_t write(uint8_t c) override { return write(&c, 1); }
+
+    size_t write(const uint8_t *buf, size_t size) override
+    {
+        ssize_t n = _fd < 0 ? -1 : send(_fd, buf, size, MSG_NOSIGNAL);
+        return n > 0 ? n : 0;
+    }
+
+    int available() override
+    {
+        uint8_t c;
+        return _fd >= 0 && recv(_fd, &c, 1, MSG_PEEK | MSG_DONTWAIT) > 0 ? 1 : 0;
+    }
+
+    int read() override
+    {
+        uint8_t c;
+        return read(&c, 1) == 1 ? c : -1;
+    }
+
+    int read(uint8_t *buf, size_t size) override
+    {
+        ssize_t n = _fd < 0 ? -1 : recv(_fd, buf, size, MSG_DONTWAIT);
+        return n > 0 ? n : -1;
+    }
+
+    int peek() override
+    {
+        uint8_t c;
+        return _fd >= 0 && recv(_fd, &c, 1, MSG_PEEK | MSG_DONTWAIT) == 1 ? c : -1;
+    }
+
+    void stop() override
+    {
+        if (_fd >= 0)
+            close(_fd);
+        _fd = -1;
+    }
+
+    uint8_t connected() override
+    {
+        if (_fd < 0)
+            return 0;
+        uint8_t c;
+        ssize_t n = recv(_fd, &c, 1, MSG_PEEK | MSG_DONTWAIT);
+        return n > 0 || (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK));
+    }
+
+    int fd() const { return _fd; }
+
+private:
+    int _fd = -1;
+};
@@ -0,0 +1,279 @@
+// API proxy: makes OpenWeatherMap's requests on behalf of devices configured
+// with WEATHER_PROVIDER_OWM_PROXY and serves the responses in the binary
+// encoding of api_codec.h, so that many displays in the same few locations
+// share the requests, and the API key, of the proxy.
+//
+//   API_PROXY_TOKEN=<token> apiProxy [address] [port] [freshness in minutes]
+//
+// GET /onecall?lat=&lon=&lang=&exclude=&token=
+// GET /air_pollution?lat=&lon=&hours=&token=
+//
+// The proxy makes requests with its API key for anyone who can reach it, so it
+// listens on one address only, localhost unless another is given, and answers
+// only requests with the token of its API_PROXY_TOKEN environment variable
+// (API_PROXY_TOKEN in config.cpp). It does not start without one.
+//
+// Responses are cached by location for the freshness window (10 minutes by
+// default, how often OpenWeatherMap updates). Requests for a location that
+// arrive while its response is being fetched wait for that fetch instead of
+// making one of their own.
+
+#include "api_codec.h"
+#include "weatherdata.h"
+
+#include <QCoreApplication>
+#include <QDateTime>
+#include <QHash>
+#include <QJsonDocument>
+#include <QNetworkAccessManager>
+#include <QNetworkReply>
+#include <QPointer>
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QUrlQuery>
+
+#include <algorithm>
+#include <functional>
+
+static constexpr int FETCH_TIMEOUT_MS = 10000;
+
+struct Waiter
+{
+    QPointer<QTcpSocket> socket;
+    bool deflate; // accepts Content-Encoding: deflate
+};
+
+struct CacheEntry
+{
+    QByteArray body;        // encoded response, empty until fetched
+    QByteArray deflated;    // body as a zlib stream
+    qint64 fetched = 0;     // when body was fetched, ms since epoch
+    bool pending = false;   // a fetch is under way
+    QList<Waiter> waiting;  // requests waiting for the fetch
+};
+
+static QNetworkAccessManager *network;
+static QHash<QString, CacheEntry> cache;
+static qint64 freshnessMs = 10 * 60 * 1000;
+static QByteArray token;
+static int hits = 0;
+static int coalesced = 0;
+static int fetches = 0;
+
+template<typename T>
+static QByteArray encode(uint32_t magic, T &r)
+{
+    ApiEncoder encoder;
+    api_codec_header_t header{magic, API_CODEC_VERSION, 0};
+    encoder.raw(&header, sizeof(header));
+    transcode(encoder, r);
+    return QByteArray(reinterpret_cast<const char *>(encoder.bytes.data()), encoder.bytes.size());
+}
+
+static void respond(QTcpSocket *socket, const QByteArray &status, const QByteArray &body,
+                    const QByteArray &headers = {})
+{
+    socket->write("HTTP/1.0 " + status + "\r\n" + headers + "Content-Length: "
+                  + QByteArray::number(body.size()) + "\r\nConnection: close\r\n\r\n" + body);
+    socket->disconnectFromHost();
+}
+
+static void respondWithEntry(QTcpSocket *socket, const CacheEntry &entry, bool deflate)
+{
+    QByteArray age = QByteArray::number(
+        (QDateTime::currentMSecsSinceEpoch() - entry.fetched) / 1000);
+    QByteArray headers = "Content-Type: application/octet-stream\r\nAge: " + age + "\r\n";
+    if (deflate) {
+        respond(socket, "200 OK", entry.deflated, headers + "Content-Encoding: deflate\r\n");
+    } else {
+        respond(socket, "200 OK", entry.body, headers);
+    }
+}
+
+// Fetches url and encodes the response with parse, then answers every request
+// waiting for the entry of key.
+static void fetchEntry(const QString &key, const QUrl &url,
+                       std::function<QByteArray(const QJsonDocument &)> parse)
+{
+    ++fetches;
+    QNetworkRequest request(url);
+    request.setTransferTimeout(FETCH_TIMEOUT_MS);
+    // uncompressed, the body is read as it is: Qt only decodes the encodings
+    // it offers itself, and the device's Accept-Encoding is not passed on
+    request.setRawHeader("Accept-Encoding", "identity");
+    QNetworkReply *reply = network->get(request);
+    QObject::connect(reply, &QNetworkReply::finished, reply, [key, reply, parse] {
+        reply->deleteLater();
+        CacheEntry &entry = cache[key];
+        entry.pending = false;
+        bool ok = reply->error() == QNetworkReply::NoError;
+        if (ok) {
+            QJsonParseError error;
+            QJsonDocument doc = QJsonDocument::fromJson(reply->readAll(), &error);
+            ok = error.error == QJsonParseError::NoError;
+            if (ok) {
+                entry.body = parse(doc);
+                // a zlib stream, without the length qCompress prefixes
+                entry.deflated = qCompress(entry.body, 9).mid(4);
+                entry.fetched = QDateTime::currentMSecsSinceEpoch();
+            }
+        }
+        if (ok)
+            qDebug() << "Fetched" << key << entry.body.size() << "B encoded,"
+                     << entry.deflated.size() << "B deflated";
+        else
+            qWarning() << "Fetching" << key << "failed" << reply->errorString();
+        for (const Waiter &waiter : std::as_const(entry.waiting)) {
+            if (!waiter.socket)
+                continue;
+            if (ok)
+                respondWithEntry(waiter.socket, entry, waiter.deflate);
+            else
+                respond(waiter.socket, "502 Bad Gateway", {});
+        }
+        entry.waiting.clear();
+        qDebug() << "Cache:" << hits << "hit(s)," << coalesced << "coalesced," << fetches
+                 << "fetch(es)";
+    });
+}
+
+// Compares in constant time, not to give the token away a byte at a time.
+static bool tokenMatches(const QByteArray &given)
+{
+    if (given.size() != token.size())
+        return false;
+    char diff = 0;
+    for (qsizetype i = 0; i < token.size(); ++i)
+        diff |= given[i] ^ token[i];
+    return diff == 0;
+}
+
+// Returns the sections of a One Call response the device excluded, those
+// OpenWeatherMap knows, sorted so that one cache entry serves each set.
+// Minutely precipitation is fetched only for devices that do not exclude it
+// (ENABLE_MINUTELY_PRECIP), it is encoded folded into precip_next_hour.
+static QString normalizedExclude(const QString &exclude)
+{
+    static const QStringList sections = {"alerts", "current", "daily", "hourly", "minutely"};
+    QStringList excluded;
+    for (const QString &section : exclude.split(',', Qt::SkipEmptyParts)) {
+        QString name = section.trimmed().toLower();
+        if (sections.contains(name) && !excluded.contains(name))
+            excluded.append(name);
+    }
+    std::sort(excluded.begin(), excluded.end());
+    return excluded.join(',');
+}
+
+static void handleRequest(QTcpSocket *socket)
+{
+    // wait for the whole request head
+    if (!socket->peek(socket->bytesAvailable()).contains("\r\n\r\n"))
+        return;
+    QList<QByteArray> requestLine = socket->readLine().trimmed().split(' ');
+    bool deflate = false;
+    for (const QByteArray &line : socket->readAll().split('\n')) {
+        int colon = line.indexOf(':');
+        if (colon > 0 && line.left(colon).trimmed().toLower() == "accept-encoding")
+            deflate = line.mid(colon + 1).toLower().contains("deflate");
+    }
+    if (requestLine.size() < 2 || requestLine[0] != "GET") {
+        respond(socket, "405 Method Not Allowed", {});
+        return;
+    }
+
+    QUrl url("http://localhost" + QString::fromLatin1(requestLine[1]));
+    QUrlQuery query(url);
+    if (!tokenMatches(query.queryItemValue("token", QUrl::FullyDecoded).toUtf8())) {
+        respond(socket, "403 Forbidden", {});
+        return;
+    }
+    bool latOk = false;
+    bool lonOk = false;
+    double lat = query.queryItemValue("lat").toDouble(&latOk);
+    double lon = query.queryItemValue("lon").toDouble(&lonOk);
+    if (!latOk || !lonOk) {
+        respond(socket, "400 Bad Request", {});
+        return;
+    }
+    // about 10 m, the same place however the device spelled it
+    QString latStr = QString::number(lat, 'f', 4);
+    QString lonStr = QString::number(lon, 'f', 4);
+
+    QString key;
+    QUrl upstream;
+    std::function<QByteArray(const QJsonDocument &)> parse;
+    if (url.path() == "/onecall") {
+        QString lang = query.queryItemValue("lang");
+        QString exclude = normalizedExclude(query.queryItemValue("exclude"));
+        key = "onecall " + latStr + "," + lonStr + " " + lang + " " + exclude;
+        upstream = oneCallUrl(latStr, lonStr, lang, exclude);
+        parse = [](const QJsonDocument &doc) {
+            owm_resp_onecall_t r = parseOneCallResponse(doc);
+            return encode(API_CODEC_MAGIC_ONECALL, r);
+        };
+    } else if (url.path() == "/air_pollution") {
+        int hours = qBound(1, query.queryItemValue("hours").toInt(), 255);
+        key = "air_pollution " + latStr + "," + lonStr + " " + QString::number(hours);
+        upstream = airPollutionUrl(latStr, lonStr, QDateTime::currentSecsSinceEpoch(), hours);
+        parse = [](const QJsonDocument &doc) {
+            owm_resp_air_pollution_t r = parseAirPollutionResponse(doc);
+            return encode(API_CODEC_MAGIC_AIR_POLLUTION, r);
+        };
+    } else {
+        respond(socket, "404 Not Found", {});
+        return;
+    }
+
+    CacheEntry &entry = cache[key];
+    qint64 age = QDateTime::currentMSecsSinceEpoch() - entry.fetched;
+    if (!entry.body.isEmpty() && age < freshnessMs) {
+        ++hits;
+        respondWithEntry(socket, entry, deflate);
+        return;
+    }
+    entry.waiting.append({socket, deflate});
+    if (entry.pending) {
+        ++coalesced;
+        return;
+    }
+    entry.pending = true;
+    fetchEntry(key, upstream, parse);
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QHostAddress address = argc > 1 ? QHostAddress(QString(argv[1])) : QHostAddress::LocalHost;
+    quint16 port = argc > 2 ? QString(argv[2]).toUShort() : 8081;
+    if (argc > 3)
+        freshnessMs = QString(argv[3]).toLongLong() * 60 * 1000;
+    token = qgetenv("API_PROXY_TOKEN");
+    if (address.isNull()) {
+        qCritical() << "Not an address" << argv[1];
+        return 1;
+    }
+    if (token.isEmpty()) {
+        qCritical() << "Set API_PROXY_TOKEN, the token devices must send";
+        return 1;
+    }
+
+    QNetworkAccessManager nam;
+    network = &nam;
+
+    QTcpServer server;
+    QObject::connect(&server, &QTcpServer::newConnection, &server, [&server] {
+        while (QTcpSocket *socket = server.nextPendingConnection()) {
+            QObject::connect(socket, &QTcpSocket::disconnected, socket, &QObject::deleteLater);
+            QObject::connect(socket, &QTcpSocket::readyRead, socket,
+                             [socket] { handleRequest(socket); });
+        }
+    });
+    if (!server.listen(address, port)) {
+        qCritical() << "Cannot listen on" << address << "port" << port << server.errorString();
+        return 1;
+    }
+    qDebug() << "Proxying OpenWeatherMap on" << address << "port" << port << "for"
+             << freshnessMs / 60000 << "minute(s)";
+    return app.exec();
+}
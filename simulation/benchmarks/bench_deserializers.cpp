@@ -0,0 +1,451 @@
+// Host benchmark of the JSON deserializers of the device
+// (platformio/src/api_deserializer.cpp) on the synthetic responses in
+// simulation/fixtures: the filtered document, the lazy index
+// (JSON_LAZY_INDEX), an unfiltered ArduinoJson document and the Qt parser of
+// the simulation. Configure with -DBUILD_BENCHMARKS=ON and run
+// benchDeserializers.
+//
+// Receiving is compared too: the filtered document reads the response from a
+// client a byte per call, as it did before BufferedClientStream, and a segment
+// per call through one.
+//
+// Each parse reads a response already in memory, so what is timed is the
+// parser alone. Allocations and the peak of the heap are counted by replacing
+// malloc (glibc only). The wake arena's block is reserved before each parse,
+// as it is on the device by the time a response arrives, so only what the
+// parse itself takes is counted. Pointers are twice the size they are on the
+// esp32, documents are larger here than on the device.
+
+#include "api_codec.h"
+#include "api_deserializer.h"
+#include "api_response.h"
+#include "arena.h"
+#include "stream_utils.h"
+#include "weatherdata.h"
+
+#include <ArduinoJson.h>
+
+#include <QDir>
+#include <QFile>
+#include <QStringList>
+
+#include <malloc.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+extern "C" {
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t n, size_t size);
+void *__libc_realloc(void *ptr, size_t size);
+void *__libc_memalign(size_t alignment, size_t size);
+void __libc_free(void *ptr);
+}
+
+static std::atomic<size_t> heapAllocations = 0;
+static std::atomic<long> heapLive = 0;
+static std::atomic<long> heapPeak = 0;
+
+static void counted(void *p)
+{
+    if (p == nullptr)
+        return;
+    ++heapAllocations;
+    long size = malloc_usable_size(p);
+    long live = heapLive.fetch_add(size) + size;
+    long peak = heapPeak.load();
+    while (live > peak && !heapPeak.compare_exchange_weak(peak, live)) {
+    }
+}
+
+static void uncounted(void *p)
+{
+    if (p != nullptr)
+        heapLive -= malloc_usable_size(p);
+}
+
+extern "C" {
+void *malloc(size_t size)
+{
+    void *p = __libc_malloc(size);
+    counted(p);
+    return p;
+}
+
+void *calloc(size_t n, size_t size)
+{
+    void *p = __libc_calloc(n, size);
+    counted(p);
+    return p;
+}
+
+void *realloc(void *ptr, size_t size)
+{
+    long old = ptr != nullptr ? malloc_usable_size(ptr) : 0;
+    void *p = __libc_realloc(ptr, size);
+    // on failure ptr is left as it was, unless it was freed for size 0
+    if (p != nullptr || size == 0)
+        heapLive -= old;
+    counted(p);
+    return p;
+}
+
+void *aligned_alloc(size_t alignment, size_t size)
+{
+    void *p = __libc_memalign(alignment, size);
+    counted(p);
+    return p;
+}
+
+int posix_memalign(void **ptr, size_t alignment, size_t size)
+{
+    void *p = __libc_memalign(alignment, size);
+    if (p == nullptr)
+        return ENOMEM;
+    counted(p);
+    *ptr = p;
+    return 0;
+}
+
+void free(void *ptr)
+{
+    uncounted(ptr);
+    __libc_free(ptr);
+}
+}
+
+// What a parse took, the median of a number of runs.
+struct Measurement
+{
+    double us = 0;           // time per parse
+    size_t allocations = 0;  // heap allocations made by the parse
+    long heapPeak = 0;       // heap taken at most by the parse, bytes
+    long document = 0;       // bytes of the document, or the arena used
+    bool ok = true;
+};
+
+static constexpr int RUNS = 200;
+
+// Runs parse, which returns the bytes of its document or -1 on failure, RUNS
+// times after a few runs to warm up the caches and, for the deserializers of
+// the device, to size their documents from the stats as a first wake does.
+template<typename Parse>
+static Measurement measure(Parse &&parse)
+{
+    for (int i = 0; i < 3; ++i) {
+        parse();
+        wakeArena.reset();
+    }
+
+    std::vector<double> times;
+    std::vector<size_t> allocations;
+    std::vector<long> peaks;
+    Measurement m;
+    for (int i = 0; i < RUNS; ++i) {
+        wakeArena.deallocate(wakeArena.allocate(1));
+        size_t allocationsBefore = heapAllocations;
+        long liveBefore = heapLive;
+        heapPeak = liveBefore;
+
+        auto start = std::chrono::steady_clock::now();
+        long document = parse();
+        auto end = std::chrono::steady_clock::now();
+
+        allocations.push_back(heapAllocations - allocationsBefore);
+        peaks.push_back(heapPeak - liveBefore);
+        times.push_back(std::chrono::duration<double, std::micro>(end - start).count());
+        m.document = document;
+        m.ok = m.ok && document >= 0;
+        wakeArena.reset();
+    }
+
+    auto median = [](auto v) {
+        std::nth_element(v.begin(), v.begin() + v.size() / 2, v.end());
+        return v[v.size() / 2];
+    };
+    m.us = median(times);
+    m.allocations = median(allocations);
+    m.heapPeak = median(peaks);
+    return m;
+}
+
+static void report(const char *strategy, const QByteArray &json, const Measurement &m)
+{
+    // bytes per microsecond is MB/s
+    printf("  %-28s %9.1f us %8.2f MB/s %6zu allocs %8ld B heap %8ld B doc%s\n", strategy,
+           m.us, json.size() / m.us, m.allocations, m.heapPeak, m.document,
+           m.ok ? "" : "  FAILED");
+}
+
+// Lists the fields of a response in the order transcode() visits them, floats
+// to 6 significant digits, so that responses parsed differently compare equal.
+class FieldLister
+{
+public:
+    QStringList fields;
+
+    bool ok() const { return true; }
+
+    template<typename T>
+    void value(T &v)
+    {
+        fields << QString::number(v);
+    }
+
+    template<typename U>
+    void value(Quantity<U> &q)
+    {
+        fields << QString::number(q.val());
+    }
+
+    template<size_t N>
+    void text(char (&s)[N])
+    {
+        fields << QString::fromUtf8(s, strnlen(s, N));
+    }
+
+    size_t count(size_t size)
+    {
+        fields << QString::number(size);
+        return size;
+    }
+};
+
+static QStringList fields(owm_resp_onecall_t &r)
+{
+    FieldLister lister;
+    transcode(lister, r);
+    return lister.fields;
+}
+
+// The lazy index must fill a response as the document does.
+static void compareIndexed(const QByteArray &json)
+{
+    const auto *data = reinterpret_cast<const uint8_t *>(json.constData());
+    static owm_resp_onecall_t document, indexed;
+    memset(&document, 0, sizeof(document));
+    MemoryStream documentStream(data, json.size());
+    MemoryStream indexedStream(data, json.size());
+    if (deserializeOneCall(documentStream, document)
+        || deserializeOneCallIndexed(indexedStream, indexed)) {
+        printf("  could not compare deserializeOneCallIndexed\n");
+        wakeArena.reset();
+        return;
+    }
+    wakeArena.reset();
+
+    QStringList expected = fields(document);
+    QStringList actual = fields(indexed);
+    for (qsizetype i = 0; i < expected.size(); ++i) {
+        if (actual.value(i) != expected[i]) {
+            printf("  deserializeOneCallIndexed differs in field %lld: %s, not %s\n",
+                   static_cast<long long>(i), qPrintable(actual.value(i)),
+                   qPrintable(expected[i]));
+            return;
+        }
+    }
+}
+
+// One TCP segment, RX_BUFFER_SIZE of client_utils.h
+static constexpr size_t SEGMENT = 1436;
+
+// A client that has received a whole response, as lwIP holds it: in segments,
+// a read returns no more than what is left of the current one. Counts the
+// calls made to it, each of which takes a lock and a socket call on the
+// device, where they cost far more than the parse of the bytes they return.
+class ReceivedClient : public Client
+{
+public:
+    explicit ReceivedClient(const QByteArray &data)
+        : _data(data)
+    {
+    }
+
+    size_t calls = 0;
+
+    int available() override
+    {
+        ++calls;
+        return _data.size() - _pos;
+    }
+
+    int peek() override
+    {
+        ++calls;
+        return _pos < _data.size() ? static_cast<uint8_t>(_data[_pos]) : -1;
+    }
+
+    int read() override
+    {
+        ++calls;
+        return _pos < _data.size() ? static_cast<uint8_t>(_data[_pos++]) : -1;
+    }
+
+    int read(uint8_t *buffer, size_t size) override
+    {
+        ++calls;
+        size_t n = std::min({size, SEGMENT - _pos % SEGMENT,
+                             static_cast<size_t>(_data.size() - _pos)});
+        memcpy(buffer, _data.constData() + _pos, n);
+        _pos += n;
+        return n;
+    }
+
+    uint8_t connected() override
+    {
+        ++calls;
+        return _pos < _data.size();
+    }
+
+    size_t write(uint8_t) override { return 0; }
+    void stop() override {}
+
+private:
+    const QByteArray &_data;
+    qsizetype _pos = 0;
+};
+
+// Hands the deserializer one byte per call to the client, as reading the
+// client straight did.
+class UnbufferedClientStream : public SegmentedStream
+{
+public:
+    explicit UnbufferedClientStream(Client &src)
+        : _src(src)
+    {
+    }
+
+    int available() override { return _src.available(); }
+    int peek() override { return _src.peek(); }
+    int read() override { return _src.read(); }
+    size_t write(uint8_t) override { return 0; }
+
+    size_t readSegment(const uint8_t *&data) override
+    {
+        int c = _src.read();
+        if (c < 0)
+            return 0;
+        _byte = c;
+        data = &_byte;
+        return 1;
+    }
+
+private:
+    Client &_src;
+    uint8_t _byte = 0;
+};
+
+static QByteArray readFixture(const QString &name)
+{
+    QFile file(QDir(FIXTURES_DIR).filePath(name));
+    if (!file.open(QIODevice::ReadOnly))
+        qFatal("cannot read %s", qPrintable(file.fileName()));
+    return file.readAll();
+}
+
+static void benchOneCall(const QString &name)
+{
+    const QByteArray json = readFixture(name);
+    const auto *data = reinterpret_cast<const uint8_t *>(json.constData());
+    printf("%s (%lld B)\n", qPrintable(name), static_cast<long long>(json.size()));
+
+    // far too large for the stack of the device, and large here too
+    static owm_resp_onecall_t r;
+
+    report("deserializeOneCall", json, measure([&] {
+               MemoryStream stream(data, json.size());
+               if (deserializeOneCall(stream, r))
+                   return -1L;
+               return onecallJsonStats.heapUsed;
+           }));
+
+    size_t calls = 0;
+    report("  from a client", json, measure([&] {
+               ReceivedClient client(json);
+               UnbufferedClientStream body(client);
+               DeserializationError error = deserializeOneCall(body, r);
+               calls = client.calls;
+               if (error)
+                   return -1L;
+               return onecallJsonStats.heapUsed;
+           }));
+    printf("    %zu client calls\n", calls);
+
+    report("  through BufferedClientStream", json, measure([&] {
+               static uint8_t buffer[SEGMENT];
+               ReceivedClient client(json);
+               BufferedClientStream body(client, buffer, sizeof(buffer));
+               DeserializationError error = deserializeOneCall(body, r);
+               calls = client.calls;
+               if (error)
+                   return -1L;
+               return onecallJsonStats.heapUsed;
+           }));
+    printf("    %zu client calls\n", calls);
+
+    report("deserializeOneCallIndexed", json, measure([&] {
+               MemoryStream stream(data, json.size());
+               if (deserializeOneCallIndexed(stream, r))
+                   return -1L;
+               return onecallIndexJsonStats.heapUsed;
+           }));
+    compareIndexed(json);
+
+    report("ArduinoJson, unfiltered", json, measure([&] {
+               MemoryStream stream(data, json.size());
+               // roomy enough for any response, on the heap
+               DynamicJsonDocument doc(8 * json.size());
+               if (deserializeJson(doc, stream))
+                   return -1L;
+               return static_cast<long>(doc.memoryUsage());
+           }));
+
+    report("Qt (simulation)", json, measure([&] {
+               QJsonParseError err;
+               QJsonDocument doc = QJsonDocument::fromJson(json, &err);
+               if (err.error != QJsonParseError::NoError)
+                   return -1L;
+               r = parseOneCallResponse(doc);
+               return 0L;
+           }));
+}
+
+static void benchAirPollution(const QString &name)
+{
+    const QByteArray json = readFixture(name);
+    const auto *data = reinterpret_cast<const uint8_t *>(json.constData());
+    printf("%s (%lld B)\n", qPrintable(name), static_cast<long long>(json.size()));
+
+    static owm_resp_air_pollution_t r;
+
+    report("deserializeAirQuality", json, measure([&] {
+               MemoryStream stream(data, json.size());
+               if (deserializeAirQuality(stream, r))
+                   return -1L;
+               return airPollutionJsonStats.heapUsed;
+           }));
+
+    report("Qt (simulation)", json, measure([&] {
+               QJsonParseError err;
+               QJsonDocument doc = QJsonDocument::fromJson(json, &err);
+               if (err.error != QJsonParseError::NoError)
+                   return -1L;
+               r = parseAirPollutionResponse(doc);
+               return 0L;
+           }));
+}
+
+int main()
+{
+    QDir fixtures(FIXTURES_DIR);
+    for (const QString &name : fixtures.entryList({"onecall_*.json"}, QDir::Files))
+        benchOneCall(name);
+    for (const QString &name : fixtures.entryList({"air_pollution_*.json"}, QDir::Files))
+        benchAirPollution(name);
+    return 0;
+}
@@ -0,0 +1,297 @@
+# Synthetic API responses for the host benchmarks of esp32-weather-epd.
+# Copyright (C) 2023  Luke Marzen
+#
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+# The responses have the shape, field order, number formatting and size of
+# OpenWeatherMap's One Call 3.0 and Air Pollution APIs, and of Open-Meteo's
+# Forecast and Air Quality APIs as the device requests them, but the values are
+# made up (from a fixed seed, so the files are reproducible). They are not
+# recordings of the real APIs.
+#
+# Usage:
+#   python3 generate_fixtures.py
+
+import json
+import os.path
+import random
+
+WEATHER = [
+    (800, 'Clear', 'clear sky', '01'),
+    (801, 'Clouds', 'few clouds', '02'),
+    (802, 'Clouds', 'scattered clouds', '03'),
+    (804, 'Clouds', 'overcast clouds', '04'),
+    (500, 'Rain', 'light rain', '10'),
+    (501, 'Rain', 'moderate rain', '10'),
+    (211, 'Thunderstorm', 'thunderstorm', '11'),
+    (600, 'Snow', 'light snow', '13'),
+    (701, 'Mist', 'mist', '50'),
+]
+
+ALERT_TEXT = (
+    '...WINTER STORM WARNING IN EFFECT FROM 6 PM THIS EVENING TO 6 PM '
+    'MST TUESDAY... * WHAT...Heavy snow expected. Total snow accumulations '
+    'of 8 to 14 inches, with localized amounts up to 20 inches possible. '
+    'Winds gusting as high as 45 mph. * WHERE...Portions of the foothills '
+    'and adjacent plains. * WHEN...From 6 PM this evening to 6 PM MST '
+    'Tuesday. * IMPACTS...Travel could be very difficult to impossible. '
+    'Areas of blowing snow could significantly reduce visibility. The '
+    'hazardous conditions could impact the Tuesday morning commute. '
+    'PRECAUTIONARY/PREPAREDNESS ACTIONS... If you must travel, keep an '
+    'extra flashlight, food, and water in your vehicle in case of an '
+    'emergency. The latest road conditions can be obtained by calling 511.'
+)
+
+
+def weather(rng, night):
+    id, main, description, icon = rng.choice(WEATHER)
+    return [{'id': id, 'main': main, 'description': description,
+             'icon': icon + ('n' if night else 'd')}]
+
+
+def r(rng, lo, hi, digits=2):
+    return round(rng.uniform(lo, hi), digits)
+
+
+def onecall(seed, lat, lon, timezone, offset, now, night, alerts,
+            minutely):
+    rng = random.Random(seed)
+    day = now - now % 86400
+    sunrise = day + 6 * 3600 + rng.randrange(3600) - offset
+    sunset = day + 18 * 3600 + rng.randrange(3600) - offset
+    current = {
+        'dt': now, 'sunrise': sunrise, 'sunset': sunset,
+        'temp': r(rng, 260, 305), 'feels_like': r(rng, 255, 305),
+        'pressure': rng.randrange(990, 1035), 'humidity': rng.randrange(100),
+        'dew_point': r(rng, 250, 295), 'uvi': r(rng, 0, 9),
+        'clouds': rng.randrange(101), 'visibility': 10000,
+        'wind_speed': r(rng, 0, 15), 'wind_deg': rng.randrange(360),
+        'wind_gust': r(rng, 0, 25),
+    }
+    if rng.random() < 0.5:
+        current['rain'] = {'1h': r(rng, 0.1, 5)}
+    current['weather'] = weather(rng, night)
+    doc = {'lat': lat, 'lon': lon, 'timezone': timezone,
+           'timezone_offset': offset, 'current': current}
+    if minutely:
+        doc['minutely'] = [{'dt': now - now % 60 + 60 * i,
+                            'precipitation': r(rng, 0, 3) if i % 7 else 0}
+                           for i in range(61)]
+    hourly = []
+    for i in range(48):
+        dt = now - now % 3600 + 3600 * i
+        h = {
+            'dt': dt, 'temp': r(rng, 260, 305),
+            'feels_like': r(rng, 255, 305),
+            'pressure': rng.randrange(990, 1035),
+            'humidity': rng.randrange(100), 'dew_point': r(rng, 250, 295),
+            'uvi': r(rng, 0, 9), 'clouds': rng.randrange(101),
+            'visibility': rng.choice([10000, 10000, 8000, 2500]),
+            'wind_speed': r(rng, 0, 15), 'wind_deg': rng.randrange(360),
+            'wind_gust': r(rng, 0, 25),
+            'weather': weather(rng, (dt + offset) % 86400 < 6 * 3600),
+            'pop': rng.choice([0, 0, r(rng, 0, 1)]),
+        }
+        if rng.random() < 0.3:
+            h['rain'] = {'1h': r(rng, 0.1, 5)}
+        if rng.random() < 0.1:
+            h['snow'] = {'1h': r(rng, 0.1, 3)}
+        hourly.append(h)
+    doc['hourly'] = hourly
+    daily = []
+    for i in range(8):
+        dt = day + 12 * 3600 - offset + 86400 * i
+        d = {
+            'dt': dt, 'sunrise': sunrise + 86400 * i,
+            'sunset': sunset + 86400 * i,
+            'moonrise': dt - rng.randrange(43200),
+            'moonset': dt + rng.randrange(43200),
+            'moon_phase': r(rng, 0, 1),
+            'summary': 'Expect a day of partly cloudy with rain',
+            'temp': {'day': r(rng, 260, 305), 'min': r(rng, 255, 280),
+                     'max': r(rng, 280, 310), 'night': r(rng, 255, 290),
+                     'eve': r(rng, 260, 300), 'morn': r(rng, 255, 290)},
+            'feels_like': {'day': r(rng, 255, 305), 'night': r(rng, 250, 290),
+                           'eve': r(rng, 255, 300), 'morn': r(rng, 250, 290)},
+            'pressure': rng.randrange(990, 1035),
+            'humidity': rng.randrange(100), 'dew_point': r(rng, 250, 295),
+            'wind_speed': r(rng, 0, 15), 'wind_deg': rng.randrange(360),
+            'wind_gust': r(rng, 0, 25), 'weather': weather(rng, False),
+            'clouds': rng.randrange(101), 'pop': r(rng, 0, 1),
+        }
+        if rng.random() < 0.5:
+            d['rain'] = r(rng, 0.1, 20)
+        if rng.random() < 0.2:
+            d['snow'] = r(rng, 0.1, 10)
+        d['uvi'] = r(rng, 0, 9)
+        daily.append(d)
+    doc['daily'] = daily
+    if alerts:
+        doc['alerts'] = [{
+            'sender_name': 'NWS Boulder (Northeast and Central Colorado)',
+            'event': rng.choice(['Winter Storm Warning', 'Wind Advisory',
+                                 'Flood Watch', 'Red Flag Warning']),
+            'start': now + 3600 * i, 'end': now + 3600 * (i + 24),
+            'description': ALERT_TEXT[:rng.randrange(300, len(ALERT_TEXT))],
+            'tags': ['Snow/Ice', 'Wind'][:1 + i % 2],
+        } for i in range(alerts)]
+    return doc
+
+
+def air_pollution(seed, lat, lon, now):
+    rng = random.Random(seed)
+    return {'coord': {'lon': lon, 'lat': lat}, 'list': [{
+        'main': {'aqi': rng.randrange(1, 6)},
+        'components': {'co': r(rng, 150, 600), 'no': r(rng, 0, 20),
+                       'no2': r(rng, 0, 80), 'o3': r(rng, 0, 150),
+                       'so2': r(rng, 0, 20), 'pm2_5': r(rng, 0, 60),
+                       'pm10': r(rng, 0, 90), 'nh3': r(rng, 0, 10)},
+        'dt': now - now % 3600 - 3600 * (23 - i),
+    } for i in range(24)]}
+
+
+# the WMO weather interpretation codes Open-Meteo reports, and one it does not
+WMO_CODES = [0, 1, 2, 3, 45, 48, 51, 53, 55, 56, 57, 61, 63, 65, 66, 67, 71,
+             73, 75, 77, 80, 81, 82, 85, 86, 95, 96, 99, 4]
+
+
+def open_meteo_header(lat, lon, timezone, offset, abbreviation):
+    # the grid cell the API answers for is not quite where was asked
+    return {'latitude': round(lat, 1), 'longitude': round(lon, 2),
+            'generationtime_ms': 0.0869035720825195,
+            'utc_offset_seconds': offset, 'timezone': timezone,
+            'timezone_abbreviation': abbreviation, 'elevation': 23.0}
+
+
+def open_meteo_forecast(seed, lat, lon, timezone, offset, abbreviation, now,
+                        hours, days):
+    # as requested by getOpenMeteoForecast, timeformat=unixtime&timezone=auto
+    rng = random.Random(seed)
+    doc = open_meteo_header(lat, lon, timezone, offset, abbreviation)
+    doc['current_units'] = {
+        'time': 'unixtime', 'interval': 'seconds', 'temperature_2m': '°C',
+        'apparent_temperature': '°C', 'relative_humidity_2m': '%',
+        'dew_point_2m': '°C', 'pressure_msl': 'hPa', 'cloud_cover': '%',
+        'uv_index': '', 'visibility': 'm', 'wind_speed_10m': 'm/s',
+        'wind_gusts_10m': 'm/s', 'wind_direction_10m': '°', 'rain': 'mm',
+        'snowfall': 'cm', 'weather_code': 'wmo code', 'is_day': '',
+    }
+    doc['current'] = {
+        'time': now - now % 900, 'interval': 900,
+        'temperature_2m': r(rng, -10, 30, 1),
+        'apparent_temperature': r(rng, -15, 30, 1),
+        'relative_humidity_2m': rng.randrange(101),
+        'dew_point_2m': r(rng, -20, 20, 1),
+        'pressure_msl': r(rng, 990, 1035, 1), 'cloud_cover': rng.randrange(101),
+        'uv_index': r(rng, 0, 9), 'visibility': float(rng.randrange(50000)),
+        'wind_speed_10m': r(rng, 0, 15), 'wind_gusts_10m': r(rng, 0, 25),
+        'wind_direction_10m': rng.randrange(360), 'rain': r(rng, 0, 1),
+        'snowfall': r(rng, 0, 0.5), 'weather_code': rng.choice(WMO_CODES),
+        'is_day': int(6 * 3600 <= (now + offset) % 86400 < 18 * 3600),
+    }
+    doc['hourly_units'] = {
+        'time': 'unixtime', 'temperature_2m': '°C',
+        'precipitation_probability': '%', 'rain': 'mm', 'snowfall': 'cm',
+    }
+    doc['hourly'] = {
+        'time': [now - now % 3600 + 3600 * i for i in range(hours)],
+        'temperature_2m': [r(rng, -10, 30, 1) for i in range(hours)],
+        'precipitation_probability': [rng.randrange(101)
+                                      for i in range(hours)],
+        'rain': [rng.choice([0.0, 0.0, r(rng, 0, 5)]) for i in range(hours)],
+        'snowfall': [rng.choice([0.0, 0.0, 0.0, r(rng, 0, 2)])
+                     for i in range(hours)],
+    }
+    doc['daily_units'] = {
+        'time': 'unixtime', 'weather_code': 'wmo code',
+        'temperature_2m_max': '°C', 'temperature_2m_min': '°C',
+        'sunrise': 'unixtime', 'sunset': 'unixtime', 'cloud_cover_mean': '%',
+        'uv_index_max': '', 'wind_speed_10m_max': 'm/s',
+        'wind_gusts_10m_max': 'm/s', 'precipitation_probability_max': '%',
+        'rain_sum': 'mm', 'snowfall_sum': 'cm',
+    }
+    # days start at local midnight
+    day = now - (now + offset) % 86400
+    doc['daily'] = {
+        'time': [day + 86400 * i for i in range(days)],
+        # a different code each day, so that more of the mapping is seen
+        'weather_code': rng.sample(WMO_CODES, days),
+        'temperature_2m_max': [r(rng, 10, 35, 1) for i in range(days)],
+        'temperature_2m_min': [r(rng, -15, 10, 1) for i in range(days)],
+        'sunrise': [day + 86400 * i + 6 * 3600 + rng.randrange(3600)
+                    for i in range(days)],
+        'sunset': [day + 86400 * i + 18 * 3600 + rng.randrange(3600)
+                   for i in range(days)],
+        'cloud_cover_mean': [rng.randrange(101) for i in range(days)],
+        'uv_index_max': [r(rng, 0, 9) for i in range(days)],
+        'wind_speed_10m_max': [r(rng, 0, 15) for i in range(days)],
+        'wind_gusts_10m_max': [r(rng, 0, 25) for i in range(days)],
+        'precipitation_probability_max': [rng.randrange(101)
+                                          for i in range(days)],
+        'rain_sum': [r(rng, 0, 20) for i in range(days)],
+        'snowfall_sum': [r(rng, 0, 10) for i in range(days)],
+    }
+    return doc
+
+
+def open_meteo_air_quality(seed, lat, lon, now, hours):
+    # as requested by getOpenMeteoAirQuality, the current hour last
+    rng = random.Random(seed)
+    doc = open_meteo_header(lat, lon, 'GMT', 0, 'GMT')
+    variables = [('carbon_monoxide', 150, 600), ('nitrogen_dioxide', 0, 80),
+                 ('ozone', 0, 150), ('sulphur_dioxide', 0, 20),
+                 ('pm2_5', 0, 60), ('pm10', 0, 90), ('ammonia', 0, 10)]
+    doc['hourly_units'] = {'time': 'unixtime'}
+    doc['hourly_units'].update({name: 'μg/m³' for name, lo, hi in variables})
+    doc['hourly'] = {'time': [now - now % 3600 - 3600 * (hours - 1 - i)
+                              for i in range(hours)]}
+    doc['hourly'].update({name: [r(rng, lo, hi, 1) for i in range(hours)]
+                          for name, lo, hi in variables})
+    return doc
+
+
+FIXTURES = {
+    # as the device requests them, minutely excluded
+    'onecall_london.json':
+        onecall(1, 51.5085, -0.1257, 'Europe/London', 0,
+                1700000000, False, 0, False),
+    'onecall_tokyo_night.json':
+        onecall(2, 35.6895, 139.6917, 'Asia/Tokyo', 32400,
+                1700056800, True, 0, False),
+    'onecall_denver_alerts.json':
+        onecall(3, 39.7392, -104.9903, 'America/Denver', -25200,
+                1700020000, False, 3, False),
+    # the largest response the API gives: minutely included, and more alerts
+    # than are kept
+    'onecall_max.json':
+        onecall(4, 39.7392, -104.9903, 'America/Denver', -25200,
+                1700020000, True, 10, True),
+    'air_pollution_london.json':
+        air_pollution(5, 51.5085, -0.1257, 1700000000),
+    'openmeteo_forecast_london.json':
+        open_meteo_forecast(6, 51.5085, -0.1257, 'Europe/London', 0, 'GMT',
+                            1700000000, 25, 5),
+    'openmeteo_forecast_tokyo.json':
+        open_meteo_forecast(7, 35.6895, 139.6917, 'Asia/Tokyo', 32400, 'JST',
+                            1700056800, 25, 5),
+    'openmeteo_air_quality_london.json':
+        open_meteo_air_quality(8, 51.5085, -0.1257, 1700000000, 24),
+}
+
+if __name__ == '__main__':
+    dir = os.path.dirname(os.path.abspath(__file__))
+    for name, doc in FIXTURES.items():
+        with open(os.path.join(dir, name), 'w', encoding='utf-8') as f:
+            # compact, as the APIs send it
+            json.dump(doc, f, separators=(',', ':'), ensure_ascii=False)
@@ -0,0 +1,15 @@
+#pragma once
+
+// The subset of FreeRTOS that the device code uses, on std::thread.
+
+#include <cstdint>
+#include <limits>
+
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+typedef uint32_t TickType_t;
+
+#define pdTRUE 1
+#define pdFALSE 0
+#define pdPASS pdTRUE
+#define portMAX_DELAY std::numeric_limits<TickType_t>::max()
@@ -0,0 +1,35 @@
+#pragma once
+
+#include "FreeRTOS.h"
+
+#include <chrono>
+#include <semaphore>
+
+struct StaticSemaphore_t
+{
+    std::binary_semaphore semaphore{0};
+};
+
+typedef StaticSemaphore_t *SemaphoreHandle_t;
+
+inline SemaphoreHandle_t xSemaphoreCreateBinaryStatic(StaticSemaphore_t *buffer)
+{
+    return buffer;
+}
+
+inline BaseType_t xSemaphoreTake(SemaphoreHandle_t s, TickType_t ticks)
+{
+    if (ticks == portMAX_DELAY) {
+        s->semaphore.acquire();
+        return pdTRUE;
+    }
+    return s->semaphore.try_acquire_for(std::chrono::milliseconds(ticks)) ? pdTRUE : pdFALSE;
+}
+
+inline BaseType_t xSemaphoreGive(SemaphoreHandle_t s)
+{
+    s->semaphore.release();
+    return pdTRUE;
+}
+
+inline void vSemaphoreDelete(SemaphoreHandle_t) {}
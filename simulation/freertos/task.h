@@ -0,0 +1,24 @@
+#pragma once
+
+#include "FreeRTOS.h"
+
+#include <thread>
+
+typedef void *TaskHandle_t;
+typedef void (*TaskFunction_t)(void *);
+
+// Tasks are detached threads, their stack size and priority are ignored.
+inline BaseType_t xTaskCreate(TaskFunction_t task, const char *, uint32_t, void *arg, UBaseType_t,
+                              TaskHandle_t *)
+{
+    std::thread(task, arg).detach();
+    return pdPASS;
+}
+
+inline UBaseType_t uxTaskPriorityGet(TaskHandle_t)
+{
+    return 1;
+}
+
+// A task ends by returning, which its body does right after this.
+inline void vTaskDelete(TaskHandle_t) {}
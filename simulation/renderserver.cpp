@@ -0,0 +1,342 @@
+// Render server: fetches the weather, renders it with the same code as the
+// device and serves the frame to devices configured with RENDER_SERVER.
+//
+//   RENDER_SERVER_TOKEN=<token> renderServer [address] [port] [freshness in minutes]
+//
+// GET /frame?planes=1|2&lat=&lon=[&units=][&bat=V][&rssi=dBm][&temp=C][&hum=%]
+//     [&status=text]&token=
+// responds with a deflated frame, see frame.h.
+//
+// The server makes requests with the API key of config.cpp for anyone who can
+// reach it, so, like the API proxy, it listens on one address only, localhost
+// unless another is given, and answers only requests with the token of its
+// RENDER_SERVER_TOKEN environment variable (RENDER_SERVER_TOKEN in
+// config.cpp). It does not start without one. Units are compiled into the
+// renderer, requests for units other than those of config.h are refused.
+//
+// The weather is cached by location for the freshness window (10 minutes by
+// default). Frames requested for a location while its weather is being fetched
+// wait for that fetch instead of making one of their own.
+
+#include "display_utils.h"
+#include "frame.h"
+#include "quantities.h"
+#include "renderer.h"
+#include "weatherdata.h"
+
+#include <QCoreApplication>
+#include <QDateTime>
+#include <QHash>
+#include <QJsonDocument>
+#include <QNetworkAccessManager>
+#include <QNetworkReply>
+#include <QPointer>
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QUrl>
+#include <QUrlQuery>
+
+#include <cmath>
+#include <cstdlib>
+#include <ctime>
+#include <functional>
+
+static constexpr int FETCH_TIMEOUT_MS = 10000;
+
+// A frame request. The socket is cleared if the device disconnects while the
+// weather is fetched.
+struct FrameRequest
+{
+    QPointer<QTcpSocket> socket;
+    QUrlQuery query;
+    time_t now;
+};
+
+// The weather of a location, both responses.
+struct Weather
+{
+    QByteArray oneCall;          // empty until fetched
+    QByteArray airPollution;
+    qint64 fetched = 0;          // when both were fetched, ms since epoch
+    int outstanding = 0;         // responses being fetched
+    bool failed = false;         // one of them could not be fetched
+    QList<FrameRequest> waiting; // requests waiting for the fetch
+};
+
+static QNetworkAccessManager *network;
+static QHash<QString, Weather> cache;
+static qint64 freshnessMs = 10 * 60 * 1000;
+static QByteArray token;
+static int hits = 0;
+static int coalesced = 0;
+static int fetches = 0;
+
+// Packs the display into a frame. With 1 plane the accent color is drawn
+// black.
+static QByteArray encodeFrame(const QImage &image, int planes)
+{
+    frame_header_t header{FRAME_MAGIC, DISP_WIDTH, DISP_HEIGHT, static_cast<uint8_t>(planes), {}};
+    QByteArray frame(reinterpret_cast<const char *>(&header), sizeof(header));
+    QByteArray row(FRAME_ROW_BYTES, 0);
+    for (int y = 0; y < DISP_HEIGHT; ++y) {
+        for (int plane = 0; plane < planes; ++plane) {
+            row.fill(char(0xFF));
+            for (int x = 0; x < DISP_WIDTH; ++x) {
+                int color = image.pixelIndex(x, y);
+                bool ink = plane == 1 ? color == GxEPD_RED
+                                      : planes == 1 ? color != 0 : color == GxEPD_BLACK;
+                if (ink)
+                    row[x / 8] = row[x / 8] & ~(0x80 >> (x % 8));
+            }
+            frame += row;
+        }
+    }
+    return frame;
+}
+
+// Fetches url without blocking, then calls done with the body, or nothing if
+// the request failed.
+static void fetchAsync(const QUrl &url, std::function<void(std::optional<QByteArray>)> done)
+{
+    QNetworkRequest request(url);
+    request.setTransferTimeout(FETCH_TIMEOUT_MS);
+    QNetworkReply *reply = network->get(request);
+    QObject::connect(reply, &QNetworkReply::finished, reply, [reply, done] {
+        reply->deleteLater();
+        if (reply->error() != QNetworkReply::NoError) {
+            qCritical() << "Request failed" << reply->url().host() << reply->errorString();
+            done(std::nullopt);
+            return;
+        }
+        done(reply->readAll());
+    });
+}
+
+// Renders the weather, with the readings the device sent.
+static QByteArray renderFrame(const Weather &weather, const FrameRequest &request)
+{
+    const QUrlQuery &query = request.query;
+    time_t now = request.now;
+    auto owm_onecall = parseOneCallResponse(QJsonDocument::fromJson(weather.oneCall));
+    auto owm_air_pollution = parseAirPollutionResponse(
+        QJsonDocument::fromJson(weather.airPollution));
+    hourly_store_t hourly_store;
+    daily_store_t daily_store;
+    timeline_t timeline;
+    packHourly(owm_onecall.hourly, OWM_NUM_HOURLY, hourly_store);
+    packDaily(owm_onecall.daily, OWM_NUM_DAILY, daily_store);
+    buildTimeline(timeline, hourly_store, daily_store, owm_onecall.current, owm_air_pollution);
+
+    tm *timeInfo = localtime(&now);
+    String refreshTimeStr;
+    getRefreshTimeStr(refreshTimeStr, true, timeInfo);
+    String dateStr;
+    getDateStr(dateStr, timeInfo);
+
+    bool ok = false;
+    float inTemp = query.queryItemValue("temp").toFloat(&ok);
+    std::optional<float> temp = ok ? std::optional{inTemp} : std::nullopt;
+    float inHumidity = query.queryItemValue("hum").toFloat(&ok);
+    std::optional<float> humidity = ok ? std::optional{inHumidity} : std::nullopt;
+    // the device's strings are UTF-8 bytes, which String holds as Latin-1
+    String statusStr(QString::fromLatin1(query.queryItemValue("status", QUrl::FullyDecoded).toUtf8()));
+    int rssi = query.queryItemValue("rssi").toInt();
+    double batteryVoltage = query.queryItemValue("bat").toDouble();
+
+    display.clear();
+    drawCurrentConditions(owm_onecall.current,
+                          owm_onecall.daily[0],
+                          owm_air_pollution,
+                          timeline,
+                          temp,
+                          humidity);
+    drawForecast(daily_store, timeline);
+    drawLocationDate(CITY_STRING, dateStr);
+    drawOutlookGraph(timeline);
+    drawPrecipNextHour(owm_onecall.precip_next_hour);
+#ifndef DISABLE_ALERTS
+    drawAlerts(owm_onecall.alerts, CITY_STRING, dateStr);
+#endif
+    drawStatusBar(statusStr, refreshTimeStr, rssi, batteryVoltage);
+
+    int planes = query.queryItemValue("planes").toInt() == 2 ? 2 : 1;
+    return encodeFrame(display.image(), planes);
+}
+
+static void respond(QTcpSocket *socket, const QByteArray &status, const QByteArray &body,
+                    const QByteArray &headers = {})
+{
+    socket->write("HTTP/1.0 " + status + "\r\n" + headers + "Content-Length: "
+                  + QByteArray::number(body.size()) + "\r\nConnection: close\r\n\r\n" + body);
+    socket->disconnectFromHost();
+}
+
+// Answers a frame request with the weather, if the device is still connected.
+static void finishFrame(const Weather &weather, const FrameRequest &request)
+{
+    QTcpSocket *socket = request.socket;
+    if (!socket) {
+        qDebug() << "Device disconnected before its frame was rendered";
+        return;
+    }
+    if (weather.failed) {
+        respond(socket, "502 Bad Gateway", {});
+        return;
+    }
+    QByteArray frame = renderFrame(weather, request);
+    // a zlib stream, without the length qCompress prefixes
+    QByteArray body = qCompress(frame, 9).mid(4);
+    qDebug() << "Serving frame to" << socket->peerAddress().toString() << frame.size() << "B,"
+             << body.size() << "B deflated";
+    respond(socket, "200 OK", body, "Content-Type: application/octet-stream\r\n"
+                                    "Content-Encoding: deflate\r\n");
+}
+
+// Stores one of the responses of the weather of key, then once both are in,
+// answers every request waiting for it.
+static void storeResponse(const QString &key, QByteArray Weather::*response,
+                          std::optional<QByteArray> body)
+{
+    Weather &weather = cache[key];
+    if (body)
+        weather.*response = std::move(*body);
+    else
+        weather.failed = true;
+    if (--weather.outstanding > 0)
+        return;
+    if (weather.failed) {
+        weather.oneCall.clear();
+        weather.airPollution.clear();
+    } else {
+        weather.fetched = QDateTime::currentMSecsSinceEpoch();
+    }
+    for (const FrameRequest &request : std::as_const(weather.waiting))
+        finishFrame(weather, request);
+    weather.waiting.clear();
+    qDebug() << "Cache:" << hits << "hit(s)," << coalesced << "coalesced," << fetches
+             << "fetch(es)";
+}
+
+// Fetches both responses of the weather of key concurrently.
+static void fetchWeather(const QString &key, const QString &lat, const QString &lon)
+{
+    ++fetches;
+    Weather &weather = cache[key];
+    weather.outstanding = 2;
+    weather.failed = false;
+    fetchAsync(oneCallUrl(lat, lon), [key](std::optional<QByteArray> body) {
+        storeResponse(key, &Weather::oneCall, std::move(body));
+    });
+    fetchAsync(airPollutionUrl(lat, lon, QDateTime::currentSecsSinceEpoch(),
+                               OWM_NUM_AIR_POLLUTION),
+               [key](std::optional<QByteArray> body) {
+                   storeResponse(key, &Weather::airPollution, std::move(body));
+               });
+}
+
+// Compares in constant time, not to give the token away a byte at a time.
+static bool tokenMatches(const QByteArray &given)
+{
+    if (given.size() != token.size())
+        return false;
+    char diff = 0;
+    for (qsizetype i = 0; i < token.size(); ++i)
+        diff |= given[i] ^ token[i];
+    return diff == 0;
+}
+
+static void handleRequest(QTcpSocket *socket)
+{
+    // wait for the whole request head
+    if (!socket->peek(socket->bytesAvailable()).contains("\r\n\r\n"))
+        return;
+    QList<QByteArray> requestLine = socket->readLine().trimmed().split(' ');
+    socket->readAll();
+    // one request per connection, anything sent after it is ignored
+    QObject::disconnect(socket, &QTcpSocket::readyRead, nullptr, nullptr);
+    if (requestLine.size() < 2 || requestLine[0] != "GET") {
+        respond(socket, "405 Method Not Allowed", {});
+        return;
+    }
+    QUrl url = QUrl::fromEncoded("http://localhost" + requestLine[1]);
+    QUrlQuery query(url);
+    if (!tokenMatches(query.queryItemValue("token", QUrl::FullyDecoded).toUtf8())) {
+        respond(socket, "403 Forbidden", {});
+        return;
+    }
+    if (url.path() != "/frame") {
+        respond(socket, "404 Not Found", {});
+        return;
+    }
+    bool latOk = false;
+    bool lonOk = false;
+    double lat = query.queryItemValue("lat").toDouble(&latOk);
+    double lon = query.queryItemValue("lon").toDouble(&lonOk);
+    QString units = query.queryItemValue("units", QUrl::FullyDecoded);
+    if (!latOk || !lonOk || (!units.isEmpty() && units != UNITS_STRING)) {
+        if (latOk && lonOk)
+            qWarning() << "Frame requested in" << units << "but drawn in" << UNITS_STRING;
+        respond(socket, "400 Bad Request", {});
+        return;
+    }
+    // about 10 m, the same place however the device spelled it
+    QString latStr = QString::number(lat, 'f', 4);
+    QString lonStr = QString::number(lon, 'f', 4);
+    QString key = latStr + "," + lonStr;
+
+    FrameRequest request{socket, query, time(nullptr)};
+    Weather &weather = cache[key];
+    qint64 age = QDateTime::currentMSecsSinceEpoch() - weather.fetched;
+    if (weather.outstanding == 0 && !weather.oneCall.isEmpty() && age < freshnessMs) {
+        ++hits;
+        finishFrame(weather, request);
+        return;
+    }
+    weather.waiting.append(request);
+    if (weather.outstanding > 0) {
+        ++coalesced;
+        return;
+    }
+    fetchWeather(key, latStr, lonStr);
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QHostAddress address = argc > 1 ? QHostAddress(QString(argv[1])) : QHostAddress::LocalHost;
+    quint16 port = argc > 2 ? QString(argv[2]).toUShort() : 8080;
+    if (argc > 3)
+        freshnessMs = QString(argv[3]).toLongLong() * 60 * 1000;
+    token = qgetenv("RENDER_SERVER_TOKEN");
+    if (address.isNull()) {
+        qCritical() << "Not an address" << argv[1];
+        return 1;
+    }
+    if (token.isEmpty()) {
+        qCritical() << "Set RENDER_SERVER_TOKEN, the token devices must send";
+        return 1;
+    }
+
+    // times are drawn in the time zone of the device
+    setenv("TZ", TIMEZONE, 1);
+    tzset();
+
+    QNetworkAccessManager nam;
+    network = &nam;
+
+    QTcpServer server;
+    QObject::connect(&server, &QTcpServer::newConnection, &server, [&server] {
+        while (QTcpSocket *socket = server.nextPendingConnection()) {
+            QObject::connect(socket, &QTcpSocket::disconnected, socket, &QObject::deleteLater);
+            QObject::connect(socket, &QTcpSocket::readyRead, socket,
+                             [socket] { handleRequest(socket); });
+        }
+    });
+    if (!server.listen(address, port)) {
+        qCritical() << "Cannot listen on" << address << "port" << port << server.errorString();
+        return 1;
+    }
+    qDebug() << "Serving frames on" << address << "port" << port << "for"
+             << freshnessMs / 60000 << "minute(s)";
+    return app.exec();
+}
@@ -0,0 +1,151 @@
+// Host tests of the wake arena (platformio/src/arena.cpp).
+
+#include "arena.h"
+
+#include <QTest>
+
+#include <cstddef>
+#include <cstdint>
+
+class TestArena : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void alignment();
+    void freeingTheLastAllocationReturnsIt();
+    void reallocateGrowsInPlace();
+    void exhaustionFallsBackToTheHeap();
+    void resetReleasesEverything();
+    void freeingAfterResetIsIgnored();
+};
+
+static bool aligned(const void *p)
+{
+    return reinterpret_cast<uintptr_t>(p) % alignof(std::max_align_t) == 0;
+}
+
+void TestArena::alignment()
+{
+    Arena arena(4096);
+    for (size_t size : {1, 3, 7, 8, 13, 16, 31, 100}) {
+        void *p = arena.allocate(size);
+        QVERIFY(p != nullptr);
+        QVERIFY2(aligned(p), qPrintable(QString("size %1").arg(size)));
+        memset(p, 0xAA, size);
+    }
+    QCOMPARE(arena.live(), size_t(8));
+    QCOMPARE(arena.reset(), size_t(8));
+}
+
+void TestArena::freeingTheLastAllocationReturnsIt()
+{
+    Arena arena(4096);
+    void *a = arena.allocate(100);
+    size_t used = arena.used();
+    void *b = arena.allocate(100);
+    QVERIFY(arena.used() > used);
+    arena.deallocate(b);
+    QCOMPARE(arena.used(), used);
+    // a is not the last allocation once c is made, its memory stays in use
+    void *c = arena.allocate(10);
+    arena.deallocate(a);
+    QVERIFY(arena.used() > used);
+    QCOMPARE(arena.live(), size_t(1));
+    arena.deallocate(c);
+    QCOMPARE(arena.live(), size_t(0));
+}
+
+void TestArena::reallocateGrowsInPlace()
+{
+    Arena arena(4096);
+    char *p = static_cast<char *>(arena.allocate(16));
+    memcpy(p, "0123456789abcdef", 16);
+    char *q = static_cast<char *>(arena.reallocate(p, 1000));
+    QCOMPARE(q, p);
+    QVERIFY(memcmp(q, "0123456789abcdef", 16) == 0);
+    QCOMPARE(arena.live(), size_t(1));
+}
+
+void TestArena::exhaustionFallsBackToTheHeap()
+{
+    Arena arena(256);
+    void *small = arena.allocate(64);
+    size_t used = arena.used();
+    char *big = static_cast<char *>(arena.allocate(4096));
+    QVERIFY(big != nullptr);
+    QVERIFY(aligned(big));
+    memset(big, 0x55, 4096);
+    // the fallback takes nothing from the block
+    QCOMPARE(arena.used(), used);
+    QCOMPARE(arena.live(), size_t(2));
+    QCOMPARE(arena.allocations(), size_t(2));
+
+    // a fallback can grow, and be freed, like any other allocation
+    big = static_cast<char *>(arena.reallocate(big, 8192));
+    QVERIFY(big != nullptr);
+    QCOMPARE(big[4095], char(0x55));
+    arena.deallocate(big);
+    QCOMPARE(arena.live(), size_t(1));
+    arena.deallocate(small);
+    QCOMPARE(arena.live(), size_t(0));
+
+    // growing past the block moves an allocation to the heap
+    char *p = static_cast<char *>(arena.allocate(16));
+    memcpy(p, "0123456789abcdef", 16);
+    char *q = static_cast<char *>(arena.reallocate(p, 1024));
+    QVERIFY(q != p);
+    QVERIFY(memcmp(q, "0123456789abcdef", 16) == 0);
+    QCOMPARE(arena.live(), size_t(1));
+    QCOMPARE(arena.reset(), size_t(1));
+}
+
+void TestArena::resetReleasesEverything()
+{
+    Arena arena(256);
+    QCOMPARE(arena.reserved(), size_t(0));
+    arena.allocate(32);
+    arena.allocate(1024); // falls back to the heap
+    QCOMPARE(arena.reserved(), size_t(256));
+    size_t peak = arena.peak();
+
+    QCOMPARE(arena.reset(), size_t(2));
+    QCOMPARE(arena.used(), size_t(0));
+    QCOMPARE(arena.live(), size_t(0));
+    QCOMPARE(arena.reserved(), size_t(0));
+    // the peak is kept for the report of the phase
+    QCOMPARE(arena.peak(), peak);
+
+    // and the arena is usable again
+    void *p = arena.allocate(32);
+    QVERIFY(p != nullptr);
+    QCOMPARE(arena.reserved(), size_t(256));
+    arena.deallocate(p);
+    QCOMPARE(arena.reset(), size_t(0));
+}
+
+void TestArena::freeingAfterResetIsIgnored()
+{
+    Arena arena(256);
+    arena.allocate(32);
+    void *stale = arena.allocate(32);
+    void *staleFallback = arena.allocate(1024);
+    arena.reset();
+
+    // the block may well be allocated at the same address again
+    void *p = arena.allocate(32);
+    size_t used = arena.used();
+    // neither may touch the counter nor the allocations of the new phase,
+    // and the fallback, freed by reset(), must not be freed twice
+    arena.deallocate(stale);
+    arena.deallocate(staleFallback);
+    QCOMPARE(arena.live(), size_t(1));
+    QCOMPARE(arena.used(), used);
+    arena.deallocate(p);
+    QCOMPARE(arena.live(), size_t(0));
+    arena.deallocate(stale);
+    QCOMPARE(arena.live(), size_t(0));
+}
+
+QTEST_APPLESS_MAIN(TestArena)
+#include "tst_arena.moc"
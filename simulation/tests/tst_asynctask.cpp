@@ -0,0 +1,135 @@
+// Host tests of the task futures (platformio/src/async_task.cpp) that the wake
+// makes its requests with, against a local HTTP server.
+
+#include "async_task.h"
+
+#include <WiFiClient.h>
+
+#include <QTest>
+
+#include <thread>
+
+// Answers each connection on localhost, on a thread of its own, after a delay,
+// as a slow API server would.
+class SlowServer
+{
+public:
+    explicit SlowServer(int delayMs)
+        : _delayMs(delayMs)
+    {
+        _fd = socket(AF_INET, SOCK_STREAM, 0);
+        sockaddr_in addr = {};
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        socklen_t len = sizeof(addr);
+        if (bind(_fd, reinterpret_cast<sockaddr *>(&addr), len) < 0 || listen(_fd, 4) < 0
+            || getsockname(_fd, reinterpret_cast<sockaddr *>(&addr), &len) < 0)
+            return;
+        _port = ntohs(addr.sin_port);
+        _thread = std::thread([this] {
+            int client;
+            while ((client = accept(_fd, nullptr, nullptr)) >= 0)
+                std::thread(answer, client, _delayMs).detach();
+        });
+    }
+
+    ~SlowServer()
+    {
+        // ends accept()
+        shutdown(_fd, SHUT_RDWR);
+        if (_thread.joinable())
+            _thread.join();
+        close(_fd);
+    }
+
+    // 0 if the server could not be set up
+    uint16_t port() const { return _port; }
+
+private:
+    // outlives the server, it is given all it needs
+    static void answer(int client, int delayMs)
+    {
+        QByteArray request;
+        char buf[256];
+        ssize_t n;
+        while (!request.contains("\r\n\r\n") && (n = recv(client, buf, sizeof(buf), 0)) > 0)
+            request.append(buf, n);
+        std::this_thread::sleep_for(std::chrono::milliseconds(delayMs));
+        const char response[] = "HTTP/1.0 200 OK\r\nContent-Length: 2\r\n\r\nok";
+        send(client, response, sizeof(response) - 1, MSG_NOSIGNAL);
+        close(client);
+    }
+
+    int _fd = -1;
+    int _delayMs;
+    uint16_t _port = 0;
+    std::thread _thread;
+};
+
+// Work of a task: a GET request to the server on port, returns the status code
+// of the response, or 0.
+static int get(void *port)
+{
+    WiFiClient client;
+    if (!client.connect(IPAddress(htonl(INADDR_LOOPBACK)), *static_cast<uint16_t *>(port)))
+        return 0;
+    const char request[] = "GET / HTTP/1.0\r\n\r\n";
+    client.write(reinterpret_cast<const uint8_t *>(request), sizeof(request) - 1);
+    QByteArray response;
+    unsigned long start = millis();
+    while (client.connected() && millis() - start < 5000) {
+        int c = client.read();
+        if (c >= 0)
+            response.append(static_cast<char>(c));
+        else
+            delay(1);
+    }
+    return response.startsWith("HTTP/1.0 ") ? response.mid(9, 3).toInt() : 0;
+}
+
+class TestAsyncTask : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void overlapsRequests();
+    void awaitDoesUnstartedWork();
+};
+
+static constexpr int DELAY_MS = 300;
+
+// Two requests started together take about as long as one, and the caller is
+// free until it awaits them.
+void TestAsyncTask::overlapsRequests()
+{
+    SlowServer server(DELAY_MS);
+    uint16_t port = server.port();
+    QVERIFY(port != 0);
+
+    unsigned long start = millis();
+    AsyncTask forecast(get, &port);
+    AsyncTask airPollution(get, &port);
+    QVERIFY(forecast.start("forecast", 8192));
+    QVERIFY(airPollution.start("airPollution", 8192));
+    QVERIFY(millis() - start < DELAY_MS / 2);
+
+    QCOMPARE(forecast.await(), 200);
+    QCOMPARE(airPollution.await(), 200);
+    unsigned long elapsed = millis() - start;
+    QVERIFY2(elapsed < 2 * DELAY_MS - DELAY_MS / 3, qPrintable(QString::number(elapsed)));
+}
+
+// A task that was not started, as when it could not be created, is done by
+// await in the caller.
+void TestAsyncTask::awaitDoesUnstartedWork()
+{
+    SlowServer server(0);
+    uint16_t port = server.port();
+    QVERIFY(port != 0);
+
+    AsyncTask request(get, &port);
+    QCOMPARE(request.await(), 200);
+}
+
+QTEST_APPLESS_MAIN(TestAsyncTask)
+#include "tst_asynctask.moc"
@@ -0,0 +1,226 @@
+// Host tests of the JSON stream adapters and of the reader the deserializers
+// read them through (platformio/src/stream_utils.cpp).
+
+#include "api_response.h"
+#include "stream_utils.h"
+
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QTest>
+
+#include <algorithm>
+
+class TestJsonStreams : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void scannerFollowsEscapes();
+    void scannerTracksKeys();
+    void truncatesLongStrings();
+    void leavesOtherKeysAlone();
+    void cutsWholeCharactersAtEveryLimit();
+    void tapFoldsMinutelyPrecip();
+    void countsSegments();
+};
+
+static void feed(JsonScanner &scanner, const char *json)
+{
+    while (*json)
+        scanner.feed(*json++);
+}
+
+void TestJsonStreams::scannerFollowsEscapes()
+{
+    JsonScanner scanner;
+    feed(scanner, R"({"k":"a\)");
+    QVERIFY(scanner.inEscape());
+    feed(scanner, "u");
+    QVERIFY(scanner.inEscape());
+    feed(scanner, "00e");
+    QVERIFY(scanner.inEscape());
+    QVERIFY(!scanner.atCharBoundary());
+    feed(scanner, "9");
+    QVERIFY(!scanner.inEscape());
+    QVERIFY(scanner.atCharBoundary());
+    QCOMPARE(scanner.stringLength(), size_t(7));
+
+    // a high surrogate is only a character with the low surrogate after it
+    feed(scanner, R"(\uD83C)");
+    QVERIFY(!scanner.inEscape());
+    QVERIFY(!scanner.atCharBoundary());
+    feed(scanner, R"(\udf27)");
+    QVERIFY(scanner.atCharBoundary());
+
+    // an escaped quote does not end the string, an escaped backslash does
+    // not escape the quote after it
+    feed(scanner, R"(\"\\)");
+    QVERIFY(scanner.inString());
+    feed(scanner, R"(")");
+    QVERIFY(!scanner.inString());
+}
+
+void TestJsonStreams::scannerTracksKeys()
+{
+    JsonScanner scanner;
+    feed(scanner, R"({"a\u0022":{"b\"":[1,"x"],"c":)");
+    QCOMPARE(scanner.key(), "c");
+    feed(scanner, R"(")");
+    QVERIFY(scanner.inMemberString());
+    feed(scanner, R"(\u00e9","d":[")");
+    QCOMPARE(scanner.key(), "d");
+    QVERIFY(scanner.inString());
+    QVERIFY(!scanner.inMemberString());
+}
+
+// A stream over bytes in memory that hands them out in segments of a given
+// size, as a client receives them, so that segments end anywhere.
+class ChunkedStream : public SegmentedStream
+{
+public:
+    ChunkedStream(const QByteArray &data, size_t chunk)
+        : _data(data)
+        , _chunk(chunk)
+    {}
+
+    int available() override { return _data.size() - _pos; }
+    int peek() override { return _pos < _data.size() ? static_cast<uint8_t>(_data[_pos]) : -1; }
+    int read() override { return _pos < _data.size() ? static_cast<uint8_t>(_data[_pos++]) : -1; }
+    size_t write(uint8_t) override { return 0; }
+
+    size_t readSegment(const uint8_t *&data) override
+    {
+        data = reinterpret_cast<const uint8_t *>(_data.constData()) + _pos;
+        size_t n = std::min(_chunk, static_cast<size_t>(_data.size() - _pos));
+        _pos += n;
+        return n;
+    }
+
+private:
+    const QByteArray &_data;
+    size_t _chunk;
+    qsizetype _pos = 0;
+};
+
+// Reads all of reader, as the deserializer does.
+static QByteArray readAll(JsonBodyReader &reader)
+{
+    QByteArray out;
+    int c;
+    while ((c = reader.read()) >= 0)
+        out.append(static_cast<char>(c));
+    return out;
+}
+
+// Reads src through a JsonBodyReader that truncates key, from segments of a
+// byte or a few.
+static QByteArray truncate(const QByteArray &src, const char *key, size_t maxLen,
+                           bool bytewise)
+{
+    ChunkedStream stream(src, bytewise ? 1 : 7);
+    JsonBodyReader json(stream);
+    json.truncate(key, maxLen);
+    return readAll(json);
+}
+
+static QJsonObject parse(const QByteArray &json)
+{
+    QJsonParseError err;
+    QJsonDocument doc = QJsonDocument::fromJson(json, &err);
+    if (err.error != QJsonParseError::NoError)
+        qWarning("%s: %s", json.constData(), qPrintable(err.errorString()));
+    return doc.object();
+}
+
+void TestJsonStreams::truncatesLongStrings()
+{
+    QByteArray json = R"({"alerts":[{"description":"0123456789","end":1}]})";
+    QByteArray out = truncate(json, "description", 4, true);
+    QCOMPARE(out, QByteArray(R"({"alerts":[{"description":"0123","end":1}]})"));
+    QCOMPARE(truncate(json, "description", 4, false), out);
+}
+
+void TestJsonStreams::leavesOtherKeysAlone()
+{
+    QByteArray json = R"({"description":["0123456789"],"event":"0123456789",)"
+                      R"("desc":"0123456789"})";
+    QCOMPARE(truncate(json, "description", 4, true), json);
+}
+
+// A description of multibyte characters, raw and escaped, cut at every
+// length: the result must stay valid JSON, and a prefix of the original.
+void TestJsonStreams::cutsWholeCharactersAtEveryLimit()
+{
+    QByteArray json = "{\"description\":\"Sn\xc3\xb8 \\u00e9t\\u00E9 \\\"\\ud83c\\udf27\\\" "
+                      "\xf0\x9f\x8c\xa7 \\n\\\\end\",\"event\":\"Storm\"}";
+    QString full = parse(json).value("description").toString();
+    QVERIFY(!full.isEmpty());
+
+    for (size_t maxLen = 0; maxLen <= 48; ++maxLen) {
+        for (bool bytewise : {true, false}) {
+            QByteArray out = truncate(json, "description", maxLen, bytewise);
+            QJsonObject obj = parse(out);
+            QVERIFY2(!obj.isEmpty(), out.constData());
+            QString desc = obj.value("description").toString();
+            QVERIFY2(full.startsWith(desc), out.constData());
+            QCOMPARE(obj.value("event").toString(), QString("Storm"));
+        }
+    }
+}
+
+static void foldPrecip(float value, void *ctx)
+{
+    foldMinutelyPrecip(*static_cast<owm_precip_next_hour_t *>(ctx), value);
+}
+
+// The minutely values are folded as they pass, and the document is passed on
+// unchanged. Values of the key outside of the root member are not.
+void TestJsonStreams::tapFoldsMinutelyPrecip()
+{
+    QByteArray json = R"({"current":{"precipitation":9},"minutely":[)";
+    for (int i = 0; i <= 60; ++i) {
+        // dry for the first 7 minutes, 0.26 mm/h in minute 11, heavy at the end
+        float p = i < 7 ? 0 : i == 11 ? 0.26f : i >= 55 ? 30 : 0.04f;
+        json += (i ? "," : "") + QByteArray(R"({"dt":)") + QByteArray::number(1700000000 + 60 * i)
+                + R"(,"precipitation":)" + QByteArray::number(p) + "}";
+    }
+    json += R"(],"hourly":[{"precipitation":9,"pop":0.5}]})";
+
+    for (size_t chunk : {1, 7}) {
+        ChunkedStream stream(json, chunk);
+        owm_precip_next_hour_t precip{};
+        precip.first_rain = -1;
+        JsonBodyReader tap(stream);
+        tap.tap("minutely", "precipitation", foldPrecip, &precip);
+        QCOMPARE(readAll(tap), json);
+
+        QCOMPARE(precip.samples, uint8_t(60));
+        QCOMPARE(precip.first_rain, int8_t(11));
+        QCOMPARE(precip.bucket[0], uint8_t(0));
+        QCOMPARE(precip.bucket[1], uint8_t(0)); // 0.04 mm/h rounds to 0
+        QCOMPARE(precip.bucket[2], uint8_t(3));
+        QCOMPARE(precip.bucket[10], uint8_t(0));
+        QCOMPARE(precip.bucket[11], uint8_t(255)); // saturates
+    }
+}
+
+// The reader counts the bytes taken from the stream, the truncated ones too,
+// whatever the segments are.
+void TestJsonStreams::countsSegments()
+{
+    QByteArray json = R"({"alerts":[{"description":"0123456789","end":1}]})";
+    for (size_t chunk : {1, 5, 1436}) {
+        ChunkedStream stream(json, chunk);
+        JsonBodyReader reader(stream);
+        reader.truncate("description", 4);
+        QCOMPARE(reader.count(), size_t(0));
+        QCOMPARE(reader.read(), int('{'));
+        QCOMPARE(reader.count(), size_t(1));
+        QCOMPARE(readAll(reader).size(), json.size() - 1 - 6);
+        QCOMPARE(reader.count(), size_t(json.size()));
+        QCOMPARE(reader.read(), -1);
+    }
+}
+
+QTEST_APPLESS_MAIN(TestJsonStreams)
+#include "tst_jsonstreams.moc"
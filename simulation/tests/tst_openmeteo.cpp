@@ -0,0 +1,380 @@
+// Host tests of the deserializers of Open-Meteo's responses
+// (platformio/src/api_deserializer.cpp), against the synthetic responses in
+// simulation/fixtures served by a local HTTP server, read off the socket as
+// the device reads them.
+
+#include "api_deserializer.h"
+#include "api_response.h"
+#include "arena.h"
+#include "stream_utils.h"
+
+#include <WiFiClient.h>
+
+#include <QDir>
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QTest>
+
+#include <algorithm>
+#include <cmath>
+#include <thread>
+
+// Answers each connection on localhost, on a thread of its own, with body, in
+// small writes a little apart, as a response arrives over WiFi in segments.
+class FixtureServer
+{
+public:
+    explicit FixtureServer(const QByteArray &body)
+        : _body(body)
+    {
+        _fd = socket(AF_INET, SOCK_STREAM, 0);
+        sockaddr_in addr = {};
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        socklen_t len = sizeof(addr);
+        if (bind(_fd, reinterpret_cast<sockaddr *>(&addr), len) < 0 || listen(_fd, 4) < 0
+            || getsockname(_fd, reinterpret_cast<sockaddr *>(&addr), &len) < 0)
+            return;
+        _port = ntohs(addr.sin_port);
+        _thread = std::thread([this] {
+            int client;
+            while ((client = accept(_fd, nullptr, nullptr)) >= 0)
+                std::thread(answer, client, _body).detach();
+        });
+    }
+
+    ~FixtureServer()
+    {
+        // ends accept()
+        shutdown(_fd, SHUT_RDWR);
+        if (_thread.joinable())
+            _thread.join();
+        close(_fd);
+    }
+
+    // 0 if the server could not be set up
+    uint16_t port() const { return _port; }
+
+private:
+    // a TCP segment of a typical home router's MTU, less than the device's
+    static constexpr qsizetype WRITE = 536;
+
+    // outlives the server, it is given all it needs
+    static void answer(int client, QByteArray body)
+    {
+        QByteArray request;
+        char buf[256];
+        ssize_t n;
+        while (!request.contains("\r\n\r\n") && (n = recv(client, buf, sizeof(buf), 0)) > 0)
+            request.append(buf, n);
+        QByteArray response = "HTTP/1.0 200 OK\r\nContent-Type: application/json\r\n"
+                              "Content-Length: "
+                              + QByteArray::number(body.size()) + "\r\n\r\n" + body;
+        for (qsizetype i = 0; i < response.size(); i += WRITE) {
+            send(client, response.constData() + i, std::min(WRITE, response.size() - i),
+                 MSG_NOSIGNAL);
+            std::this_thread::sleep_for(std::chrono::milliseconds(2));
+        }
+        close(client);
+    }
+
+    int _fd = -1;
+    QByteArray _body;
+    uint16_t _port = 0;
+    std::thread _thread;
+};
+
+// Requests the response of the server on port with client and reads past its
+// headers, leaving the body to be deserialized. False if that fails.
+static bool requestBody(WiFiClient &client, uint16_t port)
+{
+    if (!client.connect(IPAddress(htonl(INADDR_LOOPBACK)), port))
+        return false;
+    const char request[] = "GET / HTTP/1.0\r\n\r\n";
+    client.write(reinterpret_cast<const uint8_t *>(request), sizeof(request) - 1);
+    QByteArray headers;
+    unsigned long start = millis();
+    while (!headers.endsWith("\r\n\r\n") && millis() - start < 5000) {
+        int c = client.read();
+        if (c >= 0)
+            headers.append(static_cast<char>(c));
+        else
+            delay(1);
+    }
+    return headers.startsWith("HTTP/1.0 200 ");
+}
+
+// Serves json and deserializes it as the device does, into r.
+template<typename T>
+static DeserializationError fetch(const QByteArray &json,
+                                  DeserializationError (*deserialize)(SegmentedStream &, T &),
+                                  T &r)
+{
+    FixtureServer server(json);
+    WiFiClient client;
+    if (server.port() == 0 || !requestBody(client, server.port()))
+        return DeserializationError::IncompleteInput;
+    // RX_BUFFER_SIZE of client_utils.h
+    uint8_t buffer[1436];
+    BufferedClientStream body(client, buffer, sizeof(buffer));
+    DeserializationError error = deserialize(body, r);
+    // only copies of the document are kept in r
+    wakeArena.reset();
+    return error;
+}
+
+static QJsonObject readFixture(const QString &name)
+{
+    QFile file(QDir(FIXTURES_DIR).filePath(name));
+    if (!file.open(QIODevice::ReadOnly))
+        qFatal("cannot read %s", qPrintable(file.fileName()));
+    return QJsonDocument::fromJson(file.readAll()).object();
+}
+
+static QByteArray toJson(const QJsonObject &doc)
+{
+    return QJsonDocument(doc).toJson(QJsonDocument::Compact);
+}
+
+// The OpenWeatherMap condition id of each WMO weather interpretation code, as
+// wmoToOwmId gives it; 0 for a code it does not know.
+static int owmId(int wmoCode)
+{
+    switch (wmoCode) {
+    case 0: return 800;
+    case 1: return 801;
+    case 2: return 802;
+    case 3: return 804;
+    case 45: case 48: return 741;
+    case 51: return 300;
+    case 53: return 301;
+    case 55: return 302;
+    case 56: case 57: case 66: case 67: return 511;
+    case 61: return 500;
+    case 63: return 501;
+    case 65: return 502;
+    case 71: case 77: return 600;
+    case 73: return 601;
+    case 75: return 602;
+    case 80: return 520;
+    case 81: return 521;
+    case 82: return 522;
+    case 85: return 620;
+    case 86: return 622;
+    case 95: return 211;
+    case 96: return 201;
+    case 99: return 202;
+    default: return 0;
+    }
+}
+
+// Compares floats as the device stores them, to 6 significant digits.
+#define COMPARE_FLOAT(actual, expected)                                                        \
+    do {                                                                                       \
+        double a = (actual), e = (expected);                                                   \
+        QVERIFY2(std::abs(a - e) <= 1e-5 * std::max(1.0, std::abs(e)),                         \
+                 qPrintable(QStringLiteral(#actual " is %1, not %2").arg(a).arg(e)));          \
+    } while (false)
+
+static constexpr double ZERO_CELSIUS = 273.15;
+
+class TestOpenMeteo : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void forecast_data();
+    void forecast();
+    void mapsWeatherCodes_data();
+    void mapsWeatherCodes();
+    void airQuality_data();
+    void airQuality();
+};
+
+void TestOpenMeteo::forecast_data()
+{
+    QTest::addColumn<QString>("fixture");
+    QTest::newRow("london") << "openmeteo_forecast_london.json";
+    QTest::newRow("tokyo, night") << "openmeteo_forecast_tokyo.json";
+}
+
+// Every variable requested lands in its field, in the units of the One Call
+// API, and what Open-Meteo is not asked for is left zeroed.
+void TestOpenMeteo::forecast()
+{
+    QFETCH(QString, fixture);
+    const QJsonObject doc = readFixture(fixture);
+    static owm_resp_onecall_t r;
+    memset(&r, 0xff, sizeof(r));
+    r.alerts.clear();
+    DeserializationError error = fetch(toJson(doc), deserializeOpenMeteoForecast, r);
+    QVERIFY2(!error, error.c_str());
+
+    COMPARE_FLOAT(r.lat, doc["latitude"].toDouble());
+    COMPARE_FLOAT(r.lon, doc["longitude"].toDouble());
+    QCOMPARE(QString(r.timezone), doc["timezone"].toString());
+    QCOMPARE(r.timezone_offset, doc["utc_offset_seconds"].toInt());
+
+    const QJsonObject current = doc["current"].toObject();
+    // rain and snowfall are of the interval, rates are per hour
+    double perHour = 3600.0 / current["interval"].toInt();
+    QCOMPARE(r.current.dt, int64_t(current["time"].toInteger()));
+    COMPARE_FLOAT(r.current.temp.val(), current["temperature_2m"].toDouble() + ZERO_CELSIUS);
+    COMPARE_FLOAT(r.current.feels_like.val(),
+                  current["apparent_temperature"].toDouble() + ZERO_CELSIUS);
+    QCOMPARE(r.current.pressure, static_cast<int>(current["pressure_msl"].toDouble()));
+    QCOMPARE(r.current.humidity, current["relative_humidity_2m"].toInt());
+    COMPARE_FLOAT(r.current.dew_point, current["dew_point_2m"].toDouble() + ZERO_CELSIUS);
+    QCOMPARE(r.current.clouds, current["cloud_cover"].toInt());
+    COMPARE_FLOAT(r.current.uvi, current["uv_index"].toDouble());
+    COMPARE_FLOAT(r.current.visibility.val(), current["visibility"].toDouble());
+    COMPARE_FLOAT(r.current.wind_speed.val(), current["wind_speed_10m"].toDouble());
+    COMPARE_FLOAT(r.current.wind_gust.val(), current["wind_gusts_10m"].toDouble());
+    QCOMPARE(r.current.wind_deg, current["wind_direction_10m"].toInt());
+    COMPARE_FLOAT(r.current.rain_1h, current["rain"].toDouble() * perHour);
+    COMPARE_FLOAT(r.current.snow_1h, current["snowfall"].toDouble() * perHour * 10);
+    QCOMPARE(r.current.weather.id, owmId(current["weather_code"].toInt()));
+    QCOMPARE(QString(r.current.weather.icon), QString(current["is_day"].toInt() ? "01d" : "01n"));
+
+    const QJsonObject hourly = doc["hourly"].toObject();
+    const qsizetype numHourly = hourly["time"].toArray().size();
+    QVERIFY(numHourly < OWM_NUM_HOURLY);
+    for (qsizetype i = 0; i < numHourly; ++i) {
+        auto at = [&](const char *key) { return hourly[key].toArray()[i].toDouble(); };
+        QCOMPARE(r.hourly[i].dt, int64_t(hourly["time"].toArray()[i].toInteger()));
+        COMPARE_FLOAT(r.hourly[i].temp.val(), at("temperature_2m") + ZERO_CELSIUS);
+        COMPARE_FLOAT(r.hourly[i].pop, at("precipitation_probability") / 100);
+        COMPARE_FLOAT(r.hourly[i].rain_1h, at("rain"));
+        COMPARE_FLOAT(r.hourly[i].snow_1h, at("snowfall") * 10);
+    }
+    for (qsizetype i = numHourly; i < OWM_NUM_HOURLY; ++i)
+        QCOMPARE(r.hourly[i].dt, int64_t(0));
+
+    const QJsonObject daily = doc["daily"].toObject();
+    const qsizetype numDaily = daily["time"].toArray().size();
+    QVERIFY(numDaily < OWM_NUM_DAILY);
+    for (qsizetype i = 0; i < numDaily; ++i) {
+        auto at = [&](const char *key) { return daily[key].toArray()[i].toDouble(); };
+        QCOMPARE(r.daily[i].dt, int64_t(daily["time"].toArray()[i].toInteger()));
+        QCOMPARE(r.daily[i].sunrise, int64_t(daily["sunrise"].toArray()[i].toInteger()));
+        QCOMPARE(r.daily[i].sunset, int64_t(daily["sunset"].toArray()[i].toInteger()));
+        COMPARE_FLOAT(r.daily[i].temp.min.val(), at("temperature_2m_min") + ZERO_CELSIUS);
+        COMPARE_FLOAT(r.daily[i].temp.max.val(), at("temperature_2m_max") + ZERO_CELSIUS);
+        QCOMPARE(r.daily[i].clouds, static_cast<int>(at("cloud_cover_mean")));
+        COMPARE_FLOAT(r.daily[i].uvi, at("uv_index_max"));
+        COMPARE_FLOAT(r.daily[i].wind_speed.val(), at("wind_speed_10m_max"));
+        COMPARE_FLOAT(r.daily[i].wind_gust.val(), at("wind_gusts_10m_max"));
+        COMPARE_FLOAT(r.daily[i].pop, at("precipitation_probability_max") / 100);
+        COMPARE_FLOAT(r.daily[i].rain, at("rain_sum"));
+        COMPARE_FLOAT(r.daily[i].snow, at("snowfall_sum") * 10);
+        QCOMPARE(r.daily[i].weather.id, owmId(static_cast<int>(at("weather_code"))));
+    }
+    for (qsizetype i = numDaily; i < OWM_NUM_DAILY; ++i)
+        QCOMPARE(r.daily[i].dt, int64_t(0));
+    QCOMPARE(r.current.sunrise, r.daily[0].sunrise);
+    QCOMPARE(r.current.sunset, r.daily[0].sunset);
+
+    // not asked of Open-Meteo
+    QCOMPARE(r.precip_next_hour.first_rain, int8_t(-1));
+    QCOMPARE(r.precip_next_hour.samples, uint8_t(0));
+    QVERIFY(r.alerts.empty());
+}
+
+void TestOpenMeteo::mapsWeatherCodes_data()
+{
+    QTest::addColumn<int>("code");
+    for (int code : {0, 1, 2, 3, 45, 48, 51, 53, 55, 56, 57, 61, 63, 65, 66, 67, 71, 73, 75,
+                     77, 80, 81, 82, 85, 86, 95, 96, 99})
+        QTest::addRow("%d", code) << code;
+    // not a code of the WMO table
+    QTest::newRow("unknown") << 4;
+}
+
+// Each WMO code of the current conditions and of a day is drawn as the
+// OpenWeatherMap condition closest to it.
+void TestOpenMeteo::mapsWeatherCodes()
+{
+    QFETCH(int, code);
+    QJsonObject doc = readFixture("openmeteo_forecast_london.json");
+    QJsonObject current = doc["current"].toObject();
+    current["weather_code"] = code;
+    doc["current"] = current;
+    QJsonObject daily = doc["daily"].toObject();
+    QJsonArray codes = daily["weather_code"].toArray();
+    codes[codes.size() - 1] = code;
+    daily["weather_code"] = codes;
+    doc["daily"] = daily;
+
+    static owm_resp_onecall_t r;
+    DeserializationError error = fetch(toJson(doc), deserializeOpenMeteoForecast, r);
+    QVERIFY2(!error, error.c_str());
+    QCOMPARE(r.current.weather.id, owmId(code));
+    QCOMPARE(r.daily[codes.size() - 1].weather.id, owmId(code));
+}
+
+void TestOpenMeteo::airQuality_data()
+{
+    QTest::addColumn<int>("samples");
+    QTest::newRow("as requested") << OWM_NUM_AIR_POLLUTION;
+    QTest::newRow("fewer") << OWM_NUM_AIR_POLLUTION - 5;
+    QTest::newRow("one") << 1;
+    QTest::newRow("more") << OWM_NUM_AIR_POLLUTION + 6;
+}
+
+// The last sample, the current hour, lands at the end of the arrays as it does
+// for OpenWeatherMap, and the hours before it in the order they came. Hours
+// missing at the start are left zeroed, extra ones are dropped.
+void TestOpenMeteo::airQuality()
+{
+    QFETCH(int, samples);
+    QJsonObject doc = readFixture("openmeteo_air_quality_london.json");
+    QJsonObject hourly = doc["hourly"].toObject();
+    QCOMPARE(hourly["time"].toArray().size(), qsizetype(OWM_NUM_AIR_POLLUTION));
+    // the same hours and more or fewer of those before them
+    for (const QString &key : hourly.keys()) {
+        QJsonArray column = hourly[key].toArray();
+        while (column.size() > samples)
+            column.removeFirst();
+        while (column.size() < samples) {
+            if (key == "time")
+                column.prepend(column.first().toInteger() - 3600);
+            else
+                column.prepend(column.first());
+        }
+        hourly[key] = column;
+    }
+    doc["hourly"] = hourly;
+
+    static owm_resp_air_pollution_t r;
+    memset(&r, 0xff, sizeof(r));
+    DeserializationError error = fetch(toJson(doc), deserializeOpenMeteoAirQuality, r);
+    QVERIFY2(!error, error.c_str());
+
+    COMPARE_FLOAT(r.coord.lat, doc["latitude"].toDouble());
+    COMPARE_FLOAT(r.coord.lon, doc["longitude"].toDouble());
+    const int kept = std::min(samples, OWM_NUM_AIR_POLLUTION);
+    for (int i = 0; i < OWM_NUM_AIR_POLLUTION; ++i) {
+        int j = samples - OWM_NUM_AIR_POLLUTION + i;
+        auto at = [&](const char *key) {
+            return j >= 0 ? hourly[key].toArray()[j].toDouble() : 0.0;
+        };
+        QCOMPARE(r.dt[i], int64_t(j >= 0 ? hourly["time"].toArray()[j].toInteger() : 0));
+        COMPARE_FLOAT(r.components.co[i], at("carbon_monoxide"));
+        COMPARE_FLOAT(r.components.no2[i], at("nitrogen_dioxide"));
+        COMPARE_FLOAT(r.components.o3[i], at("ozone"));
+        COMPARE_FLOAT(r.components.so2[i], at("sulphur_dioxide"));
+        COMPARE_FLOAT(r.components.pm2_5[i], at("pm2_5"));
+        COMPARE_FLOAT(r.components.pm10[i], at("pm10"));
+        COMPARE_FLOAT(r.components.nh3[i], at("ammonia"));
+        // not given by Open-Meteo
+        COMPARE_FLOAT(r.components.no[i], 0.0);
+        QCOMPARE(r.main_aqi[i], 0);
+    }
+    QCOMPARE(r.dt[OWM_NUM_AIR_POLLUTION - 1], int64_t(hourly["time"].toArray().last().toInteger()));
+    QCOMPARE(std::count(std::begin(r.dt), std::end(r.dt), 0), std::ptrdiff_t(OWM_NUM_AIR_POLLUTION - kept));
+}
+
+QTEST_APPLESS_MAIN(TestOpenMeteo)
+#include "tst_openmeteo.moc"
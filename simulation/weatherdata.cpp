@@ -0,0 +1,244 @@
+#include "weatherdata.h"
+
+#include "_locale.h"
+#include "config.h"
+
+#include <QEventLoop>
+#include <QJsonArray>
+#include <QJsonObject>
+#include <QNetworkAccessManager>
+#include <QNetworkReply>
+#include <QNetworkRequest>
+#include <QTimer>
+#include <QUrlQuery>
+
+std::optional<QByteArray> fetch(const QUrl &url, int timeoutMs)
+{
+    QNetworkAccessManager nam;
+    auto reply = nam.get(QNetworkRequest(url));
+    QEventLoop eventLoop;
+    QObject::connect(reply, &QNetworkReply::finished, &eventLoop, &QEventLoop::quit);
+    QTimer::singleShot(timeoutMs, &eventLoop, [&eventLoop] { eventLoop.exit(1); });
+    if (eventLoop.exec() == 1) {
+        qCritical() << "Request timed out" << url.host();
+        return std::nullopt;
+    }
+    if (reply->error() != QNetworkReply::NoError) {
+        qCritical() << "Request failed" << url.host() << reply->error();
+        return std::nullopt;
+    }
+    return reply->readAll();
+}
+
+static QString fromConfig(const String &s)
+{
+    return QString::fromLatin1(s.c_str());
+}
+
+QUrl oneCallUrl()
+{
+    return oneCallUrl(fromConfig(LAT), fromConfig(LON));
+}
+
+QUrl oneCallUrl(const QString &lat, const QString &lon)
+{
+#ifdef ENABLE_MINUTELY_PRECIP
+    QString exclude = "";
+#else
+    QString exclude = "minutely";
+#endif
+    return oneCallUrl(lat, lon, fromConfig(OWM_LANG), exclude);
+}
+
+QUrl oneCallUrl(const QString &lat, const QString &lon, const QString &lang,
+                const QString &exclude)
+{
+    QUrl url("https://" + fromConfig(OWM_ENDPOINT) + "/data/" + fromConfig(OWM_ONECALL_VERSION)
+             + "/onecall");
+    QUrlQuery query;
+    query.addQueryItem("lat", lat);
+    query.addQueryItem("lon", lon);
+    query.addQueryItem("lang", lang);
+    query.addQueryItem("units", "standard");
+    query.addQueryItem("exclude", exclude);
+    query.addQueryItem("appid", fromConfig(OWM_APIKEY));
+    url.setQuery(query);
+    return url;
+}
+
+QUrl airPollutionUrl(qint64 now)
+{
+    return airPollutionUrl(fromConfig(LAT), fromConfig(LON), now, OWM_NUM_AIR_POLLUTION);
+}
+
+QUrl airPollutionUrl(const QString &lat, const QString &lon, qint64 now, int hours)
+{
+    QUrl url("https://" + fromConfig(OWM_ENDPOINT) + "/data/2.5/air_pollution/history");
+    QUrlQuery query;
+    query.addQueryItem("lat", lat);
+    query.addQueryItem("lon", lon);
+    // minus 1, otherwise we could get an extra hour of history
+    query.addQueryItem("start", QString::number(now - (3600 * hours - 1)));
+    query.addQueryItem("end", QString::number(now));
+    query.addQueryItem("appid", fromConfig(OWM_APIKEY));
+    url.setQuery(query);
+    return url;
+}
+
+owm_resp_onecall_t parseOneCallResponse(const QJsonDocument &doc)
+{
+    auto current = doc["current"].toObject();
+    auto current_weather = current["weather"].toArray()[0].toObject();
+
+    owm_resp_onecall_t
+        r{.lat = static_cast<float>(doc["lat"].toDouble()),
+          .lon = static_cast<float>(doc["lon"].toDouble()),
+          .timezone_offset = doc["timezone_offset"].toInt(),
+          .current = {.dt = current["dt"].toInteger(),
+                      .sunrise = current["sunrise"].toInteger(),
+                      .sunset = current["sunset"].toInteger(),
+                      .temp = static_cast<float>(current["temp"].toDouble()),
+                      .feels_like = static_cast<float>(current["feels_like"].toDouble()),
+                      .pressure = current["pressure"].toInt(),
+                      .humidity = current["humidity"].toInt(),
+                      .dew_point = static_cast<float>(current["dew_point"].toDouble()),
+                      .clouds = current["clouds"].toInt(),
+                      .uvi = static_cast<float>(current["uvi"].toDouble()),
+                      .visibility = static_cast<float>(current["visibility"].toInt()),
+                      .wind_speed = static_cast<float>(current["wind_speed"].toDouble()),
+                      .wind_gust = static_cast<float>(current["wind_gust"].toDouble()),
+                      .wind_deg = current["wind_deg"].toInt(),
+                      .rain_1h = static_cast<float>(current["rain"].toObject()["1h"].toDouble()),
+                      .snow_1h = static_cast<float>(current["snow"].toObject()["1h"].toDouble()),
+                      .weather = {
+                          .id = current_weather["id"].toInt(),
+                      }}};
+    setField(r.timezone, qPrintable(doc["timezone"].toString()));
+    setField(r.current.weather.main, qPrintable(current_weather["main"].toString()));
+    setField(r.current.weather.description,
+             current_weather["description"].toString().toUtf8().constData());
+    setField(r.current.weather.icon, qPrintable(current_weather["icon"].toString()));
+
+    r.precip_next_hour.first_rain = -1;
+    for (const auto &json : doc["minutely"].toArray())
+        foldMinutelyPrecip(r.precip_next_hour,
+                           static_cast<float>(json.toObject()["precipitation"].toDouble()));
+
+    int i = 0;
+    for (const auto &json : doc["hourly"].toArray()) {
+        if (i == OWM_NUM_HOURLY)
+            break;
+        auto hourly = json.toObject();
+        r.hourly[i] = {
+            .dt = hourly["dt"].toInteger(),
+            .temp = static_cast<float>(hourly["temp"].toDouble()),
+            .feels_like = static_cast<float>(hourly["feels_like"].toDouble()),
+            .pressure = hourly["pressure"].toInt(),
+            .humidity = hourly["humidity"].toInt(),
+            .dew_point = static_cast<float>(hourly["dew_point"].toDouble()),
+            .clouds = hourly["clouds"].toInt(),
+            .uvi = static_cast<float>(hourly["uvi"].toDouble()),
+            .visibility = static_cast<float>(hourly["visibility"].toInt()),
+            .wind_speed = static_cast<float>(hourly["wind_speed"].toDouble()),
+            .wind_gust = static_cast<float>(hourly["wind_gust"].toDouble()),
+            .wind_deg = hourly["wind_deg"].toInt(),
+            .pop = static_cast<float>(hourly["pop"].toDouble()),
+            .rain_1h = static_cast<float>(hourly["rain"].toObject()["1h"].toDouble()),
+            .snow_1h = static_cast<float>(hourly["snow"].toObject()["1h"].toDouble()),
+        };
+        ++i;
+    }
+
+    i = 0;
+    for (const auto &json : doc["daily"].toArray()) {
+        if (i == OWM_NUM_DAILY)
+            break;
+        auto daily = json.toObject();
+        auto daily_temp = daily["temp"].toObject();
+        auto daily_feels_like = daily["feels_like"].toObject();
+        auto daily_weather = daily["weather"][0].toObject();
+        r.daily[i] = {
+            .dt = daily["dt"].toInteger(),
+            .sunrise = daily["sunrise"].toInteger(),
+            .sunset = daily["sunset"].toInteger(),
+            .moonrise = daily["moonrise"].toInteger(),
+            .moonset = daily["moonset"].toInteger(),
+            .moon_phase = static_cast<float>(daily["moon_phase"].toDouble()),
+            .temp = {
+                .morn = {static_cast<float>(daily_temp["morn"].toDouble())},
+                .day = {static_cast<float>(daily_temp["day"].toDouble())},
+                .eve = {static_cast<float>(daily_temp["eve"].toDouble())},
+                .night = {static_cast<float>(daily_temp["night"].toDouble())},
+                .min = {static_cast<float>(daily_temp["min"].toDouble())},
+                .max = {static_cast<float>(daily_temp["max"].toDouble())},
+            },
+            .feels_like = {
+                .morn = static_cast<float>(daily_feels_like["morn"].toDouble()),
+                .day = static_cast<float>(daily_feels_like["day"].toDouble()),
+                .eve = static_cast<float>(daily_feels_like["eve"].toDouble()),
+                .night = static_cast<float>(daily_feels_like["night"].toDouble()),
+            },
+            .pressure = daily["pressure"].toInt(),
+            .humidity = daily["humidity"].toInt(),
+            .dew_point = static_cast<float>(daily["dew_point"].toDouble()),
+            .clouds = daily["clouds"].toInt(),
+            .uvi = static_cast<float>(daily["uvi"].toDouble()),
+            .visibility = daily["visibility"].toInt(),
+            .wind_speed = static_cast<float>(daily["wind_speed"].toDouble()),
+            .wind_gust = static_cast<float>(daily["wind_gust"].toDouble()),
+            .wind_deg = daily["wind_deg"].toInt(),
+            .pop = static_cast<float>(daily["pop"].toDouble()),
+            .rain = static_cast<float>(daily["rain"].toDouble()),
+            .snow = static_cast<float>(daily["snow"].toDouble()),
+            .weather = {
+                .id = daily_weather["id"].toInt(),
+            },
+        };
+        setField(r.daily[i].weather.main, qPrintable(daily_weather["main"].toString()));
+        setField(r.daily[i].weather.description,
+                 daily_weather["description"].toString().toUtf8().constData());
+        setField(r.daily[i].weather.icon, qPrintable(daily_weather["icon"].toString()));
+
+        ++i;
+    }
+
+    for (const auto &json : doc["alerts"].toArray()) {
+        auto alert = json.toObject();
+        owm_alerts_t a{.start = alert["start"].toInteger(), .end = alert["end"].toInteger()};
+        setField(a.event, alert["event"].toString().toUtf8().constData());
+        setField(a.description, alert["description"].toString().toUtf8().constData());
+        setField(a.tags, alert["tags"][0].toString().toUtf8().constData());
+        if (!r.alerts.push_back(a))
+            break;
+    }
+
+    return r;
+}
+
+owm_resp_air_pollution_t parseAirPollutionResponse(const QJsonDocument &doc)
+{
+    owm_resp_air_pollution_t r{};
+    auto coord = doc["coord"].toObject();
+    r.coord.lat = static_cast<float>(coord["lat"].toDouble());
+    r.coord.lon = static_cast<float>(coord["lon"].toDouble());
+
+    int i = 0;
+    for (const auto &json : doc["list"].toArray()) {
+        if (i == OWM_NUM_AIR_POLLUTION)
+            break;
+        auto entry = json.toObject();
+        auto components = entry["components"].toObject();
+        r.main_aqi[i] = entry["main"].toObject()["aqi"].toInt();
+        r.components.co[i] = static_cast<float>(components["co"].toDouble());
+        r.components.no[i] = static_cast<float>(components["no"].toDouble());
+        r.components.no2[i] = static_cast<float>(components["no2"].toDouble());
+        r.components.o3[i] = static_cast<float>(components["o3"].toDouble());
+        r.components.so2[i] = static_cast<float>(components["so2"].toDouble());
+        r.components.pm2_5[i] = static_cast<float>(components["pm2_5"].toDouble());
+        r.components.pm10[i] = static_cast<float>(components["pm10"].toDouble());
+        r.components.nh3[i] = static_cast<float>(components["nh3"].toDouble());
+        r.dt[i] = entry["dt"].toInteger();
+        ++i;
+    }
+    return r;
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <QByteArray>
+#include <QJsonDocument>
+#include <QUrl>
+#include <optional>
+
+#include "api_response.h"
+
+// Performs a GET request, waiting at most timeoutMs for the reply.
+std::optional<QByteArray> fetch(const QUrl &url, int timeoutMs);
+
+// URLs of OpenWeatherMap's APIs for the location in config.cpp.
+QUrl oneCallUrl();
+QUrl airPollutionUrl(qint64 now);
+// URL of One Call for any location, with the language and sections of
+// config.cpp and config.h.
+QUrl oneCallUrl(const QString &lat, const QString &lon);
+// URLs of OpenWeatherMap's APIs for any location, for One Call without the
+// comma-separated sections in exclude, and for air pollution, the given number
+// of hours of history.
+QUrl oneCallUrl(const QString &lat, const QString &lon, const QString &lang,
+                const QString &exclude);
+QUrl airPollutionUrl(const QString &lat, const QString &lon, qint64 now, int hours);
+
+owm_resp_onecall_t parseOneCallResponse(const QJsonDocument &doc);
+owm_resp_air_pollution_t parseAirPollutionResponse(const QJsonDocument &doc);